@@ -0,0 +1,103 @@
+#include "BlockingTransport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Most datagrams per receive call
+static const int MAX_BATCH = 64;
+
+BlockingTransport::BlockingTransport(SOCKET socket, const TransportConfig& config)
+	: socket(socket) {
+	configureSocket(socket, config, true);
+}
+
+const char* BlockingTransport::name() const {
+	return "blocking";
+}
+
+#ifdef __linux__
+
+bool BlockingTransport::placesPayloads() const {
+	return true;
+}
+
+int BlockingTransport::receive(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) {
+	mmsghdr messages[MAX_BATCH];
+	iovec vectors[MAX_BATCH][2];
+
+	if (count > MAX_BATCH) {
+		count = MAX_BATCH;
+	}
+
+	// Scatter every datagram: headers into the packet, payload to its predicted place
+	for (int i = 0; i < count; i++) {
+		vectors[i][0].iov_base = &packets[i];
+		vectors[i][0].iov_len = headerSize;
+		vectors[i][1].iov_base = payloads[i];
+		vectors[i][1].iov_len = lengths[i];
+
+		messages[i].msg_hdr = msghdr();
+		messages[i].msg_hdr.msg_iov = vectors[i];
+		messages[i].msg_hdr.msg_iovlen = 2;
+	}
+
+	// Block for the first datagram, then take whatever else is already queued
+	int ret = recvmmsg(socket, messages, count, MSG_WAITFORONE, NULL);
+
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			return 0;
+		}
+
+		printf("Receive failure: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < ret; i++) {
+		lengths[i] = messages[i].msg_len;
+	}
+
+	return ret;
+}
+
+#else
+
+// Winsock can't split a datagram over buffers without WSARecvFrom, receive whole packets
+bool BlockingTransport::placesPayloads() const {
+	return false;
+}
+
+int BlockingTransport::receive(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) {
+	int received = 0;
+
+	while (received < count) {
+
+		// Only block for the first datagram of a batch
+		if (received > 0) {
+			u_long available = 0;
+			if (ioctlsocket(socket, FIONREAD, &available) != 0 || available == 0) {
+				break;
+			}
+		}
+
+		int ret = recvfrom(socket, (char*)&packets[received], sizeof(UDPRecvPacket), 0, NULL, NULL);
+
+		if (ret < 0) {
+			int error = WSAGetLastError();
+			if (error == WSAETIMEDOUT || error == WSAEMSGSIZE) {
+				break;
+			}
+
+			printf("Receive failure: %d\n", error);
+			exit(EXIT_FAILURE);
+		}
+
+		payloads[received] = (char*)&packets[received] + headerSize;
+		lengths[received] = ret;
+		received++;
+	}
+
+	return received;
+}
+
+#endif
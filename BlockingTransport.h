@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Transport.h"
+
+// Blocks in the receive call itself, woken by the socket's receive timeout
+//	On Linux one recvmmsg takes the whole batch and scatters payloads into place,
+//	Winsock receives whole datagrams one at a time while more are queued.
+class BlockingTransport : public Transport {
+public:
+	BlockingTransport(SOCKET socket, const TransportConfig& config);
+
+	const char* name() const override;
+	bool placesPayloads() const override;
+	int receive(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) override;
+
+private:
+	SOCKET socket;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Monotonic time in microseconds, comparable between threads
+inline uint64_t nowMicroseconds() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Monotonic time in nanoseconds, for timing work shorter than a microsecond
+inline uint64_t nowNanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Processor time used by the calling thread, in microseconds
+inline uint64_t threadCpuMicroseconds() {
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+
+	// Counted in 100 ns steps
+	uint64_t kernelTime = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	uint64_t userTime = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return (kernelTime + userTime) / 10;
+#else
+	timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return (uint64_t)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+#endif
+}
@@ -0,0 +1,125 @@
+#include "Crc32c.h"
+
+#include <string.h>
+
+#include <SDL.h>
+
+#if defined(__SSE4_2__) || defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#include <nmmintrin.h>
+	#define CRC32C_SSE42
+
+	// Compiled for SSE 4.2 without the rest of the build assuming it
+	#if defined(__GNUC__)
+		#define SSE42_FUNCTION __attribute__((target("sse4.2")))
+	#else
+		#define SSE42_FUNCTION
+	#endif
+#elif defined(__ARM_FEATURE_CRC32)
+	#include <arm_acle.h>
+	#define CRC32C_ARM
+#endif
+
+// Reflected Castagnoli polynomial
+static const uint32_t POLYNOMIAL = 0x82F63B78;
+
+// Eight tables, so 8 bytes are folded in with one lookup each
+struct CrcTables {
+	uint32_t entries[8][256];
+
+	CrcTables() {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; bit++) {
+				crc = crc & 1 ? (crc >> 1) ^ POLYNOMIAL : crc >> 1;
+			}
+			entries[0][i] = crc;
+		}
+
+		for (int table = 1; table < 8; table++) {
+			for (int i = 0; i < 256; i++) {
+				uint32_t previous = entries[table - 1][i];
+				entries[table][i] = (previous >> 8) ^ entries[0][previous & 0xFF];
+			}
+		}
+	}
+};
+
+static const CrcTables tables;
+
+static uint32_t crc32cTable(uint32_t crc, const uint8_t* data, size_t size) {
+	const uint32_t (*t)[256] = tables.entries;
+
+	for (; size >= 8; data += 8, size -= 8) {
+		uint32_t low, high;
+		memcpy(&low, data, 4);
+		memcpy(&high, data + 4, 4);
+		low ^= crc;
+
+		crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+			^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+	}
+
+	for (; size > 0; data++, size--) {
+		crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+	}
+
+	return crc;
+}
+
+#ifdef CRC32C_SSE42
+SSE42_FUNCTION static uint32_t crc32cSse42(uint32_t crc, const uint8_t* data, size_t size) {
+#if defined(_M_X64) || defined(__x86_64__)
+	uint64_t wide = crc;
+	for (; size >= 8; data += 8, size -= 8) {
+		uint64_t value;
+		memcpy(&value, data, 8);
+		wide = _mm_crc32_u64(wide, value);
+	}
+	crc = (uint32_t)wide;
+#endif
+
+	for (; size >= 4; data += 4, size -= 4) {
+		uint32_t value;
+		memcpy(&value, data, 4);
+		crc = _mm_crc32_u32(crc, value);
+	}
+
+	for (; size > 0; data++, size--) {
+		crc = _mm_crc32_u8(crc, *data);
+	}
+
+	return crc;
+}
+#endif
+
+#ifdef CRC32C_ARM
+static uint32_t crc32cArm(uint32_t crc, const uint8_t* data, size_t size) {
+	for (; size >= 8; data += 8, size -= 8) {
+		uint64_t value;
+		memcpy(&value, data, 8);
+		crc = __crc32cd(crc, value);
+	}
+
+	for (; size > 0; data++, size--) {
+		crc = __crc32cb(crc, *data);
+	}
+
+	return crc;
+}
+#endif
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	crc = ~crc;
+
+#if defined(CRC32C_SSE42)
+	static const bool hardware = SDL_HasSSE42() == SDL_TRUE;
+	crc = hardware ? crc32cSse42(crc, bytes, size) : crc32cTable(crc, bytes, size);
+#elif defined(CRC32C_ARM)
+	crc = crc32cArm(crc, bytes, size);
+#else
+	crc = crc32cTable(crc, bytes, size);
+#endif
+
+	return ~crc;
+}
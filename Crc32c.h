@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC32C (Castagnoli) of size bytes, continuing from crc, which is 0 for a fresh one
+//	Uses the CRC instructions of SSE 4.2 or ARMv8 when the CPU has them, eight
+//	table lookups per 8 bytes otherwise.
+uint32_t crc32c(uint32_t crc, const void* data, size_t size);
@@ -0,0 +1,184 @@
+#include "EpollTransport.h"
+
+#ifdef __linux__
+
+#include <netinet/udp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+EpollTransport::EpollTransport(SOCKET socket, const TransportConfig& config)
+	: socket(socket), timeoutMs(config.timeoutMs), gro(config.gro) {
+
+	configureSocket(socket, config, false);
+
+	epollFd = epoll_create1(0);
+	if (epollFd < 0) {
+		printf("Epoll init failed: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = socket;
+	if (epoll_ctl(epollFd, EPOLL_CTL_ADD, socket, &event) != 0) {
+		printf("Epoll add failed: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	if (gro) {
+		int enable = 1;
+		if (setsockopt(socket, IPPROTO_UDP, UDP_GRO, &enable, sizeof(enable)) != 0) {
+			printf("UDP GRO not available: %d\n", errno);
+			gro = false;
+		} else {
+			groBuffer = new char[GRO_BUFFER_SIZE];
+		}
+	}
+}
+
+EpollTransport::~EpollTransport() {
+	close(epollFd);
+	delete[] groBuffer;
+}
+
+const char* EpollTransport::name() const {
+	return gro ? "epoll+gro" : "epoll";
+}
+
+bool EpollTransport::placesPayloads() const {
+	return !gro;
+}
+
+int EpollTransport::receive(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) {
+	if (count > MAX_BATCH) {
+		count = MAX_BATCH;
+	}
+
+	if (gro) {
+		return receiveCoalesced(packets, headerSize, payloads, lengths, count);
+	}
+
+	// Only sleep once the socket is drained
+	int ret = receiveBatch(packets, headerSize, payloads, lengths, count);
+	if (ret == 0 && wait()) {
+		ret = receiveBatch(packets, headerSize, payloads, lengths, count);
+	}
+
+	return ret;
+}
+
+bool EpollTransport::wait() {
+	epoll_event event;
+	int ret = epoll_wait(epollFd, &event, 1, timeoutMs);
+
+	if (ret < 0 && errno != EINTR) {
+		printf("Epoll wait failed: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	return ret > 0;
+}
+
+int EpollTransport::receiveBatch(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) {
+	mmsghdr messages[MAX_BATCH];
+	iovec vectors[MAX_BATCH][2];
+
+	// Scatter every datagram: headers into the packet, payload to its predicted place
+	for (int i = 0; i < count; i++) {
+		vectors[i][0].iov_base = &packets[i];
+		vectors[i][0].iov_len = headerSize;
+		vectors[i][1].iov_base = payloads[i];
+		vectors[i][1].iov_len = lengths[i];
+
+		messages[i].msg_hdr = msghdr();
+		messages[i].msg_hdr.msg_iov = vectors[i];
+		messages[i].msg_hdr.msg_iovlen = 2;
+	}
+
+	int ret = recvmmsg(socket, messages, count, MSG_DONTWAIT, NULL);
+
+	if (ret < 0) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+			return 0;
+		}
+
+		printf("Receive failure: %d\n", errno);
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < ret; i++) {
+		lengths[i] = messages[i].msg_len;
+	}
+
+	return ret;
+}
+
+// Hand out datagrams from the last coalesced run, receiving the next run once it's used up
+//	Datagrams are handed out in place, so a new run is only received at the start of a call
+int EpollTransport::receiveCoalesced(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) {
+	if (groOffset >= groLength) {
+		iovec vector = { groBuffer, GRO_BUFFER_SIZE };
+		char control[CMSG_SPACE(sizeof(int))];
+
+		msghdr message = msghdr();
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+		message.msg_control = control;
+		message.msg_controllen = sizeof(control);
+
+		int ret = recvmsg(socket, &message, MSG_DONTWAIT);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && wait()) {
+			message.msg_controllen = sizeof(control);
+			ret = recvmsg(socket, &message, MSG_DONTWAIT);
+		}
+
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+				return 0;
+			}
+
+			printf("Receive failure: %d\n", errno);
+			exit(EXIT_FAILURE);
+		}
+
+		// Without the control message the run is a single datagram
+		groSegmentSize = ret;
+		for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+			if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+				memcpy(&groSegmentSize, CMSG_DATA(cmsg), sizeof(int));
+			}
+		}
+
+		groLength = ret;
+		groOffset = 0;
+
+		if (groSegmentSize <= 0) {
+			groLength = 0;
+			return 0;
+		}
+	}
+
+	// Every datagram of a run is segment sized, except maybe the last
+	int received = 0;
+	while (received < count && groOffset < groLength) {
+		char* datagram = groBuffer + groOffset;
+		int length = groLength - groOffset < groSegmentSize ? groLength - groOffset : groSegmentSize;
+
+		memcpy(&packets[received], datagram, length < headerSize ? length : headerSize);
+		payloads[received] = datagram + headerSize;
+		lengths[received] = length;
+
+		groOffset += length;
+		received++;
+	}
+
+	return received;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#ifdef __linux__
+
+#include "Transport.h"
+
+// Non-blocking batched receive, sleeping in epoll only when the socket is drained
+//	Under load most calls find datagrams queued and never touch epoll. With GRO the
+//	kernel hands over runs of datagrams in one buffer, which are split up here;
+//	payloads then stay in that buffer instead of going to their predicted place.
+class EpollTransport : public Transport {
+public:
+	EpollTransport(SOCKET socket, const TransportConfig& config);
+	~EpollTransport();
+
+	const char* name() const override;
+	bool placesPayloads() const override;
+	int receive(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) override;
+
+private:
+	// Most datagrams per receive call
+	static const int MAX_BATCH = 64;
+
+	// Largest run of datagrams GRO delivers at once
+	static const int GRO_BUFFER_SIZE = 65535;
+
+	SOCKET socket;
+	int epollFd;
+	int timeoutMs;
+	bool gro;
+
+	// Coalesced datagrams not handed out yet
+	char* groBuffer = NULL;
+	int groLength = 0;
+	int groOffset = 0;
+	int groSegmentSize = 0;
+
+	// Wait for the socket to become readable, false on timeout
+	bool wait();
+
+	int receiveBatch(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count);
+	int receiveCoalesced(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count);
+};
+
+#endif
@@ -0,0 +1,533 @@
+#include "FrameDecoder.h"
+#include "Clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How often the decode thread checks whether it should stop
+static const int DECODE_WAIT_MS = 100;
+
+// Start of the last Annex B start code in data[from + 1, to), or from if there is none
+//	Everything before it is made of whole NAL units the codec can take on its own.
+static uint32_t lastStartCode(const char* data, uint32_t from, uint32_t to) {
+	for (uint32_t i = to; i >= from + 3; i--) {
+		if (data[i - 1] == 1 && data[i - 2] == 0 && data[i - 3] == 0) {
+			return i - 3;
+		}
+	}
+
+	return from;
+}
+
+// What the start of a frame holds, going by its start codes
+struct FrameStart {
+	bool picture;		// A picture header was found
+	bool keyframe;		// The picture refers to no other
+	bool configuration;	// The stream's configuration comes before it, a VOL header or SPS
+};
+
+// Look for the first picture header of the frame and configuration in front of it
+//	Headers come first, so only the start of the frame is read.
+static FrameStart inspectFrame(AVCodecID codecId, const char* data, uint32_t size) {
+	FrameStart start = { false, false, false };
+
+	// Codecs not known here are taken as they come
+	if (codecId != AV_CODEC_ID_MPEG4 && codecId != AV_CODEC_ID_H264) {
+		start.picture = start.keyframe = start.configuration = true;
+		return start;
+	}
+
+	for (uint32_t i = 0; i + 4 < size; i++) {
+		if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+			continue;
+		}
+
+		uint8_t code = (uint8_t)data[i + 3];
+		if (codecId == AV_CODEC_ID_H264) {
+			int type = code & 0x1F;
+			if (type == 7) {
+				start.configuration = true;
+			} else if (type == 5 || type == 1) {
+				start.picture = true;
+				start.keyframe = type == 5;
+				return start;
+			}
+		} else {
+
+			// Video object layer, and a video object plane with its coding type in the top bits
+			if (code >= 0x20 && code <= 0x2F) {
+				start.configuration = true;
+			} else if (code == 0xB6) {
+				start.picture = true;
+				start.keyframe = ((uint8_t)data[i + 4] >> 6) == 0;
+				return start;
+			}
+		}
+
+		i += 2;
+	}
+
+	return start;
+}
+
+// Called by libavcodec once it holds no more references to a slab
+static void releaseSlab(void* opaque, uint8_t* data) {
+	ReassemblySlot* slot = (ReassemblySlot*)opaque;
+	slot->owner->release(slot);
+}
+
+// Decode into a texture if one is free and the codec won't refer to the picture again,
+// into a buffer of the codec's own otherwise
+static int getTextureBuffer(AVCodecContext* context, AVFrame* frame, int flags) {
+	TexturePool* textures = (TexturePool*)context->opaque;
+	if (!(flags & AV_GET_BUFFER_FLAG_REF) && textures->attach(context, frame)) {
+		return 0;
+	}
+
+	return avcodec_default_get_buffer2(context, frame, flags);
+}
+
+FrameDecoder::FrameDecoder(FrameReassembler& reassembler, CompletedFrameQueue& completed, QueueSignal& completedSignal)
+	: reassembler(reassembler), completed(completed), completedSignal(completedSignal) {
+
+	packet = av_packet_alloc();
+	scratchFrame = av_frame_alloc();
+	if (!packet || !scratchFrame) {
+		printf("Decoder alloc failed..\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// All pictures are allocated once and reused
+	for (int i = 0; i < POOL_SIZE; i++) {
+		pool[i].frame = av_frame_alloc();
+		if (!pool[i].frame) {
+			printf("Frame alloc failed..\n");
+			exit(EXIT_FAILURE);
+		}
+
+		freeFrames.push(&pool[i]);
+	}
+}
+
+FrameDecoder::~FrameDecoder() {
+	stop();
+
+	for (int i = 0; i < POOL_SIZE; i++) {
+		av_frame_free(&pool[i].frame);
+	}
+
+	av_frame_free(&scratchFrame);
+	av_packet_free(&packet);
+	avcodec_free_context(&codecContext);
+	av_buffer_pool_uninit(&packetPool);
+}
+
+void FrameDecoder::open(AVCodecID codecId, int width, int height, int threadCount, int threadType, bool chunked) {
+
+	// Note: av_codec_register all is no longer necessary and deprecated in ffmpeg >4.0
+
+	// Get codec
+	AVCodec* codec = avcodec_find_decoder(codecId);
+	if (!codec) {
+		printf("Codec not found..\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Get codec context
+	codecContext = avcodec_alloc_context3(codec);
+	codecContext->width = width;
+	codecContext->height = height;
+
+	// Let the codec spread work over cores
+	codecContext->thread_count = threadCount;
+	codecContext->thread_type = threadType;
+
+	// Slices can be decoded as they come in, a frame thread would wait for the whole frame
+	if (chunked) {
+		codecContext->flags2 |= AV_CODEC_FLAG2_CHUNKS;
+		codecContext->thread_type &= ~FF_THREAD_FRAME;
+	}
+
+	// Write pictures straight into the renderer's textures
+	if (textures && (codec->capabilities & AV_CODEC_CAP_DR1)) {
+		codecContext->opaque = textures;
+		codecContext->get_buffer2 = getTextureBuffer;
+		codecContext->thread_safe_callbacks = 1;
+	}
+
+	// Open codec
+	int ret = avcodec_open2(codecContext, codec, NULL);
+	if (ret < 0) {
+		printf("could not open codec..\n");
+		exit(EXIT_FAILURE);
+	}
+
+	printf("Decoder: %d threads, %s threading\n", codecContext->thread_count,
+		codecContext->active_thread_type == FF_THREAD_FRAME ? "frame" :
+		codecContext->active_thread_type == FF_THREAD_SLICE ? "slice" : "no");
+
+	if (codecContext->active_thread_type & FF_THREAD_FRAME) {
+		packetPool = av_buffer_pool_init(FrameReassembler::slabSize(), NULL);
+		if (!packetPool) {
+			printf("Packet pool alloc failed..\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (prewarm) {
+		warmUp(codecId, width, height);
+	}
+}
+
+void FrameDecoder::warmUp(AVCodecID codecId, int width, int height) {
+	uint64_t start = nowMicroseconds();
+
+	AVCodec* codec = avcodec_find_encoder(codecId);
+	AVCodecContext* encoder = codec ? avcodec_alloc_context3(codec) : NULL;
+	if (!encoder) {
+		printf("No encoder to warm the decoder up with\n");
+		return;
+	}
+
+	encoder->width = width;
+	encoder->height = height;
+	encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+	encoder->time_base = { 1, 60 };
+	encoder->gop_size = 1;
+	encoder->max_b_frames = 0;
+
+	AVDictionary* options = NULL;
+	if (codecId == AV_CODEC_ID_H264) {
+		av_dict_set(&options, "preset", "ultrafast", 0);
+		av_dict_set(&options, "tune", "zerolatency", 0);
+	}
+
+	int ret = avcodec_open2(encoder, codec, &options);
+	av_dict_free(&options);
+
+	AVFrame* picture = av_frame_alloc();
+	AVPacket* encoded = av_packet_alloc();
+	if (ret < 0 || !picture || !encoded) {
+		printf("Decoder could not be warmed up\n");
+		av_packet_free(&encoded);
+		av_frame_free(&picture);
+		avcodec_free_context(&encoder);
+		return;
+	}
+
+	// A grey keyframe, carrying the configuration like the stream's first one will
+	picture->format = AV_PIX_FMT_YUV420P;
+	picture->width = width;
+	picture->height = height;
+	if (av_frame_get_buffer(picture, 0) == 0) {
+		for (int plane = 0; plane < 3; plane++) {
+			int rows = plane == 0 ? height : (height + 1) / 2;
+			memset(picture->data[plane], 128, (size_t)picture->linesize[plane] * rows);
+		}
+		avcodec_send_frame(encoder, picture);
+	}
+	avcodec_send_frame(encoder, NULL);
+
+	while (avcodec_receive_packet(encoder, encoded) == 0) {
+		avcodec_send_packet(codecContext, encoded);
+		av_packet_unref(encoded);
+
+		while (avcodec_receive_frame(codecContext, scratchFrame) == 0) {
+			av_frame_unref(scratchFrame);
+		}
+	}
+
+	// Drain the codec, then reset it so nothing of the warm-up is left to refer to
+	avcodec_send_packet(codecContext, NULL);
+	while (avcodec_receive_frame(codecContext, scratchFrame) == 0) {
+		av_frame_unref(scratchFrame);
+	}
+	avcodec_flush_buffers(codecContext);
+
+	av_packet_free(&encoded);
+	av_frame_free(&picture);
+	avcodec_free_context(&encoder);
+
+	prewarmMicroseconds = nowMicroseconds() - start;
+	printf("Decoder warmed up in %.1f ms\n", prewarmMicroseconds / 1000.0);
+}
+
+void FrameDecoder::start() {
+	running = true;
+	thread = std::thread(&FrameDecoder::decodeLoop, this);
+}
+
+void FrameDecoder::stop() {
+	running = false;
+	completedSignal.notify();
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void FrameDecoder::recycle(DecodedFrame* frame) {
+	av_frame_unref(frame->frame);
+	freeFrames.push(frame);
+}
+
+void FrameDecoder::decodeLoop() {
+	while (running) {
+		ReassemblySlot* slot;
+		if (!completed.pop(slot)) {
+			completedSignal.wait(DECODE_WAIT_MS);
+			continue;
+		}
+
+		decodeFrame(slot);
+	}
+}
+
+int FrameDecoder::decodeAvailable() {
+	int count = 0;
+
+	ReassemblySlot* slot;
+	while (completed.pop(slot)) {
+		decodeFrame(slot);
+		count++;
+	}
+
+	return count;
+}
+
+bool FrameDecoder::acceptFrame(ReassemblySlot* slot, uint64_t now) {
+
+	// A frame between the previous one and this one never came, what follows may refer to it
+	if (referenced && slot->nframe != nextFrame) {
+		loseReference(slot->nframe, now);
+	}
+	nextFrame = slot->nframe + 1;
+
+	if (referenced) {
+		return true;
+	}
+
+	// Of a streamed frame only what arrived so far, the headers come first
+	uint32_t size = slot->streamed ? slot->contiguousBytes.load(std::memory_order_acquire) : slot->framesize;
+	FrameStart start = inspectFrame(codecContext->codec_id, slot->data, size);
+
+	// Nothing to go by, the codec has to make what it can of it
+	if (!start.picture) {
+		return true;
+	}
+
+	if (!start.keyframe || !(configured || start.configuration)) {
+		keyframeRequester.request(slot->nframe, now);
+
+		// Without a keyframe coming, a broken picture beats a frozen one
+		if (configured && !keyframeRequester.pending(now)) {
+			concealedFrames++;
+			return true;
+		}
+
+		discardedFrames++;
+		return false;
+	}
+
+	referenced = true;
+	configured = true;
+	keyframeRequester.answered();
+
+	if (!firstKeyframe) {
+		firstKeyframe = now;
+	}
+	if (referenceLost) {
+		recoveryTimes.record(now - referenceLost);
+		referenceLost = 0;
+	}
+
+	return true;
+}
+
+void FrameDecoder::loseReference(uint32_t nframe, uint64_t now) {
+	if (!referenced) {
+		return;
+	}
+
+	referenced = false;
+	referenceLost = now;
+	referenceLosses++;
+	keyframeRequester.request(nframe, now);
+}
+
+// Send a reassembled frame to the codec and collect whatever it outputs
+void FrameDecoder::decodeFrame(ReassemblySlot* slot) {
+
+	// Decoding it would only make a broken picture, the slot goes straight back
+	if (!acceptFrame(slot, nowMicroseconds())) {
+		reassembler.release(slot);
+		return;
+	}
+
+	SubmittedFrame& submitted = history[slot->nframe % HISTORY_SIZE];
+	submitted.timings = FrameTimings();
+	submitted.timings.firstFragment = slot->firstArrival;
+
+	// Still arriving, decode it piece by piece
+	if (slot->streamed) {
+		decodeStreamed(slot, submitted);
+		return;
+	}
+
+	submitted.gameinfo = slot->gameinfo;
+	submitted.timings.lastFragment = slot->lastArrival;
+
+	// Lend the slab to the codec, so it doesn't copy the frame
+	//	The slot is handed back to the reassembler when the last reference goes.
+	//	Frame threads hold on to their packets, so they get a copy and the slot goes back now.
+	if (packetPool) {
+		packet->buf = av_buffer_pool_get(packetPool);
+		if (packet->buf) {
+			memcpy(packet->buf->data, slot->data, slot->framesize + AV_INPUT_BUFFER_PADDING_SIZE);
+			reassembler.release(slot);
+			copiedFrames++;
+		}
+	} else {
+		packet->buf = av_buffer_create((uint8_t*)slot->data, slot->framesize + AV_INPUT_BUFFER_PADDING_SIZE, releaseSlab, slot, 0);
+	}
+
+	if (!packet->buf) {
+		printf("Packet buffer alloc failed..\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Fill packet with frame data
+	packet->data = packet->buf->data;
+	packet->size = slot->framesize;
+	packet->pts = slot->nframe;
+
+	// Send packet to decoder
+	submitted.timings.decodeSubmit = nowMicroseconds();
+	int ret = avcodec_send_packet(codecContext, packet);
+	av_packet_unref(packet);
+
+	if (ret < 0) {
+		fprintf(stderr, "Error sending a packet for decoding: %d\n", ret);
+		decodeErrors++;
+		loseReference(slot->nframe, nowMicroseconds());
+		return;
+	}
+
+	receiveFrames();
+}
+
+// Send a frame that is still being reassembled, in runs of whole NAL units
+//	Each run goes out as soon as the fragments in front of it are in, so decoding
+//	overlaps with the rest of the frame still arriving.
+void FrameDecoder::decodeStreamed(ReassemblySlot* slot, SubmittedFrame& submitted) {
+
+	// Every run shares one reference to the slab, it is released after the last
+	//	Chunked decoding rules frame threads out, so nothing holds on to it for long.
+	AVBufferRef* slab = av_buffer_create((uint8_t*)slot->data, slot->framesize + AV_INPUT_BUFFER_PADDING_SIZE, releaseSlab, slot, 0);
+	if (!slab) {
+		printf("Packet buffer alloc failed..\n");
+		exit(EXIT_FAILURE);
+	}
+
+	uint32_t fed = 0;
+	while (running) {
+
+		// Receiver gave up on the rest of the frame
+		if (slot->abandoned.load(std::memory_order_acquire)) {
+			break;
+		}
+
+		bool complete = slot->state.load(std::memory_order_acquire) == ReassemblySlot::COMPLETE;
+		uint32_t end;
+		if (complete) {
+			end = slot->framesize;
+
+			// Game state and the final timing are only settled once complete
+			submitted.gameinfo = slot->gameinfo;
+			submitted.timings.lastFragment = slot->lastArrival;
+		} else {
+
+			// The last NAL unit in the prefix may still be cut short
+			end = lastStartCode(slot->data, fed, slot->contiguousBytes.load(std::memory_order_acquire));
+		}
+
+		if (end == fed) {
+			if (complete) {
+				break;
+			}
+
+			completedSignal.wait(DECODE_WAIT_MS);
+			continue;
+		}
+
+		packet->buf = av_buffer_ref(slab);
+		if (!packet->buf) {
+			printf("Packet buffer alloc failed..\n");
+			exit(EXIT_FAILURE);
+		}
+
+		packet->data = (uint8_t*)slot->data + fed;
+		packet->size = end - fed;
+		packet->pts = slot->nframe;
+
+		submitted.timings.decodeSubmit = nowMicroseconds();
+		int ret = avcodec_send_packet(codecContext, packet);
+		av_packet_unref(packet);
+		fed = end;
+
+		if (ret < 0) {
+			fprintf(stderr, "Error sending a packet for decoding: %d\n", ret);
+			decodeErrors++;
+			loseReference(slot->nframe, nowMicroseconds());
+			break;
+		}
+
+		receiveFrames();
+	}
+
+	av_buffer_unref(&slab);
+}
+
+// Get frames from decoder until it needs more input
+void FrameDecoder::receiveFrames() {
+	while (true) {
+
+		// Hold on to a pooled picture until the codec actually fills it
+		if (!target) {
+			freeFrames.pop(target);
+		}
+
+		AVFrame* frame = target ? target->frame : scratchFrame;
+
+		int ret = avcodec_receive_frame(codecContext, frame);
+		if (ret < 0) {
+			if (ret == AVERROR(EAGAIN)) {
+				// Codec needs the next packet
+			} else if (ret == AVERROR_EOF) {
+				printf("Error during decoding: Error during decoding\n");
+			} else {
+				fprintf(stderr, "Unknown error during decoding\n");
+				decodeErrors++;
+				loseReference(nextFrame - 1, nowMicroseconds());
+			}
+			return;
+		}
+
+		decodedFrames++;
+
+		// Renderer is holding on to every picture, skip this one
+		if (!target) {
+			droppedFrames++;
+			av_frame_unref(scratchFrame);
+			continue;
+		}
+
+		const SubmittedFrame& submitted = history[(uint32_t)frame->pts % HISTORY_SIZE];
+		target->nframe = (uint32_t)frame->pts;
+		target->gameinfo = submitted.gameinfo;
+		target->timings = submitted.timings;
+		target->timings.decodeReturn = nowMicroseconds();
+		decoded.push(target);
+		target = NULL;
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+extern "C" {
+	#include "libavcodec/avcodec.h"
+	#include "libavutil/buffer.h"
+	#include "libavutil/frame.h"
+}
+
+#include "Protocol.h"
+#include "LatencyStats.h"
+#include "FrameReassembler.h"
+#include "FrameReceiver.h"
+#include "TexturePool.h"
+#include "KeyframeRequester.h"
+#include "SPSCQueue.h"
+
+// A decoded picture on its way to the screen
+struct DecodedFrame {
+	AVFrame* frame;
+	uint32_t nframe;
+	UDPRecvGameInfo gameinfo;
+
+	// Filled up to decodeReturn, the render thread adds the rest
+	FrameTimings timings;
+};
+
+// Decodes completed frames on its own thread
+//	Decoded pictures come from a fixed pool and are handed to the render thread,
+//	which gives them back with recycle() once presented. Frames that refer to a
+//	picture the codec never got, at the start or after a lost frame, are thrown away
+//	undecoded while a keyframe is on its way, rather than shown broken. Without one
+//	coming they are decoded anyway, so the picture doesn't freeze.
+class FrameDecoder {
+public:
+	// Decoded pictures in flight between decoder and renderer
+	static const int POOL_SIZE = 8;
+
+	typedef SPSCQueue<DecodedFrame*, POOL_SIZE> DecodedFrameQueue;
+
+	// Pictures ready to present, consumed by the render thread
+	DecodedFrameQueue decoded;
+
+	std::atomic<uint64_t> decodedFrames{ 0 };
+	std::atomic<uint64_t> decodeErrors{ 0 };
+
+	// Pictures thrown away because the renderer had not returned any to the pool
+	std::atomic<uint64_t> droppedFrames{ 0 };
+
+	// Frames copied out of their slab rather than lent, because frame threads would hold it
+	std::atomic<uint64_t> copiedFrames{ 0 };
+
+	// Frames thrown away undecoded for lack of a reference, and the times a reference was lost
+	std::atomic<uint64_t> discardedFrames{ 0 };
+	std::atomic<uint64_t> referenceLosses{ 0 };
+
+	// Frames decoded without a reference, as no keyframe was on its way
+	std::atomic<uint64_t> concealedFrames{ 0 };
+
+	// From losing the reference to the next keyframe going to the codec
+	LatencyHistogram recoveryTimes;
+
+	// When the first keyframe went to the codec, 0 until then
+	std::atomic<uint64_t> firstKeyframe{ 0 };
+
+	// Time spent warming the codec up in open(), in microseconds
+	uint64_t prewarmMicroseconds = 0;
+
+	// Asks for a keyframe whenever there is no reference, off until enabled
+	KeyframeRequester keyframeRequester;
+
+	// Decode a picture of the stream's size in open(), so the first frame doesn't pay for
+	// allocating the codec's pictures and starting its threads
+	bool prewarm = true;
+
+	// Textures to decode pictures into, set before open() to use them
+	TexturePool* textures = NULL;
+
+	FrameDecoder(FrameReassembler& reassembler, CompletedFrameQueue& completed, QueueSignal& completedSignal);
+	~FrameDecoder();
+
+	// Set up the codec
+	//	threadCount 0 lets libavcodec use one thread per core, threadType is a mask of FF_THREAD_*
+	//	chunked takes frames in pieces as they arrive, which rules out frame threading
+	void open(AVCodecID codecId, int width, int height, int threadCount, int threadType, bool chunked);
+
+	void start();
+	void stop();
+
+	// Decode the completed frames waiting, instead of on the decoder's own thread
+	//	For decoders run as tasks of a pool. Never waits, so frames can't be taken in
+	//	chunks this way. Returns how many frames went to the codec.
+	int decodeAvailable();
+
+	// Hand a presented picture back to the pool, render thread only
+	void recycle(DecodedFrame* frame);
+
+private:
+	// Game state and timings are looked up by nframe once the codec returns the picture,
+	// which may be several frames later with frame threading
+	static const int HISTORY_SIZE = 64;
+
+	struct SubmittedFrame {
+		UDPRecvGameInfo gameinfo;
+		FrameTimings timings;
+	};
+
+	FrameReassembler& reassembler;
+	CompletedFrameQueue& completed;
+	QueueSignal& completedSignal;
+
+	AVCodecContext* codecContext = NULL;
+
+	// Reused for every frame sent to the codec, wraps the reassembly slab
+	AVPacket* packet = NULL;
+
+	// Buffers frames are copied into under frame threading, NULL otherwise
+	//	Every frame thread keeps its packet until it has decoded the next frame, so lent
+	//	slabs would stay out of reassembly, and with as many threads as slots, fragments
+	//	of new frames would have nowhere to go.
+	AVBufferPool* packetPool = NULL;
+
+	// Catches output when the pool is empty
+	AVFrame* scratchFrame = NULL;
+
+	DecodedFrame pool[POOL_SIZE];
+	DecodedFrameQueue freeFrames;
+
+	// Taken from the pool, not yet filled by the codec
+	DecodedFrame* target = NULL;
+
+	// The codec holds what the next frame refers to, and has seen the stream's configuration
+	//	Frames are expected in nframe order, a gap means a frame was dropped.
+	bool referenced = false;
+	bool configured = false;
+	uint32_t nextFrame = 0;
+	uint64_t referenceLost = 0;
+
+	SubmittedFrame history[HISTORY_SIZE];
+
+	std::thread thread;
+	std::atomic<bool> running{ false };
+
+	void decodeLoop();
+
+	// Send a keyframe of the stream's size through the codec and reset it
+	void warmUp(AVCodecID codecId, int width, int height);
+
+	// Whether the frame can be decoded, taking a reference from it if it is a keyframe
+	bool acceptFrame(ReassemblySlot* slot, uint64_t now);
+	void loseReference(uint32_t nframe, uint64_t now);
+
+	void decodeFrame(ReassemblySlot* slot);
+	void decodeStreamed(ReassemblySlot* slot, SubmittedFrame& submitted);
+	void receiveFrames();
+};
@@ -0,0 +1,398 @@
+#include "FrameReassembler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+	#include "libavcodec/avcodec.h"
+	#include "libavutil/mem.h"
+}
+
+// Slabs are kept cache line aligned so consecutive slots never share a line
+static const int SLAB_ALIGNMENT = 64;
+
+static bool testBit(const uint64_t* mask, uint32_t index) {
+	return (mask[index / 64] & (1ull << (index % 64))) != 0;
+}
+
+static void setBit(uint64_t* mask, uint32_t index) {
+	mask[index / 64] |= 1ull << (index % 64);
+}
+
+// Payload size of a fragment, the last one is smaller
+static int payloadSize(const ReassemblySlot& slot, uint32_t nfrag) {
+	if (nfrag == slot.nfrags - 1) {
+		return slot.framesize - slot.fragmentSize * (slot.nfrags - 1);
+	}
+
+	return slot.fragmentSize;
+}
+
+// XOR size bytes of source into target
+static void xorInto(char* target, const char* source, int size) {
+	int i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t a, b;
+		memcpy(&a, target + i, 8);
+		memcpy(&b, source + i, 8);
+		a ^= b;
+		memcpy(target + i, &a, 8);
+	}
+
+	for (; i < size; i++) {
+		target[i] ^= source[i];
+	}
+}
+
+int FrameReassembler::slabSize() {
+	int size = MAX_FRAGMENTS * PACKET_SIZE + AV_INPUT_BUFFER_PADDING_SIZE;
+	return (size + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT * SLAB_ALIGNMENT;
+}
+
+FrameReassembler::FrameReassembler() {
+
+	slabs = (char*)av_malloc((size_t)slabSize() * SLOT_COUNT);
+	paritySlabs = (char*)av_malloc((size_t)MAX_PARITY_FRAGMENTS * PACKET_SIZE * SLOT_COUNT);
+	if (!slabs || !paritySlabs) {
+		printf("Reassembly buffer alloc failed..\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < SLOT_COUNT; i++) {
+		slots[i].state.store(ReassemblySlot::FREE);
+		slots[i].nframe = 0;
+		slots[i].nfrags = 0;
+		slots[i].framesize = 0;
+		slots[i].fragsReceived = 0;
+		slots[i].fragmentSize = PACKET_SIZE;
+		slots[i].firstArrival = 0;
+		slots[i].lastArrival = 0;
+		slots[i].highestFragment = 0;
+		slots[i].contiguousFragments = 0;
+		slots[i].contiguousBytes.store(0);
+		slots[i].streamed = false;
+		slots[i].abandoned.store(false);
+		slots[i].fragmentMask = masks[i];
+		slots[i].fecGroupSize = 0;
+		slots[i].parityMask = parityMasks[i];
+		slots[i].parity = paritySlabs + (size_t)MAX_PARITY_FRAGMENTS * PACKET_SIZE * i;
+		slots[i].data = slabs + (size_t)slabSize() * i;
+		slots[i].owner = this;
+	}
+}
+
+FrameReassembler::~FrameReassembler() {
+	av_free(slabs);
+	av_free(paritySlabs);
+}
+
+// Start collecting a new frame in the given slot
+void FrameReassembler::reset(ReassemblySlot& slot, const UDPRecvHeader& header, uint32_t fragmentSize, uint64_t now) {
+	slot.state.store(ReassemblySlot::FILLING, std::memory_order_relaxed);
+	slot.nframe = header.nframe;
+	slot.nfrags = header.nfrags;
+	slot.framesize = header.framesize;
+	slot.fragsReceived = 0;
+	slot.fragmentSize = fragmentSize;
+	slot.firstArrival = now;
+	slot.lastArrival = now;
+	slot.highestFragment = 0;
+	slot.contiguousFragments = 0;
+	slot.contiguousBytes.store(0, std::memory_order_relaxed);
+	slot.streamed = false;
+	slot.abandoned.store(false, std::memory_order_relaxed);
+	memset(slot.fragmentMask, 0, sizeof(uint64_t) * MASK_WORDS);
+	slot.fecGroupSize = 0;
+	memset(slot.parityMask, 0, sizeof(uint64_t) * PARITY_MASK_WORDS);
+}
+
+ReassemblySlot* FrameReassembler::addFragment(const UDPRecvHeader& header, uint32_t fragmentSize, const UDPRecvGameInfo& gameinfo, const char* payload, uint64_t now) {
+	bool parity = isParityFragment(header);
+
+	// Reject anything that would not fit the slab
+	if (header.nfrags == 0 || header.nfrags > MAX_FRAGMENTS || (!parity && header.nfrag >= header.nfrags)
+		|| fragmentSize == 0 || fragmentSize > PACKET_SIZE
+		|| header.framesize > header.nfrags * fragmentSize
+		|| header.framesize <= (header.nfrags - 1) * fragmentSize) {
+		rejectedFragments++;
+		return NULL;
+	}
+
+	// Frames that were already given up on
+	if (hasOldestFrame) {
+		int32_t distance = (int32_t)(header.nframe - oldestFrame);
+
+		if (distance < -RESTART_DISTANCE) {
+			hasOldestFrame = false;
+			hasNewestFrame = false;
+		} else if (distance < 0) {
+			staleFragments++;
+			return NULL;
+		}
+	}
+
+	ReassemblySlot& slot = slots[header.nframe % SLOT_COUNT];
+	ReassemblySlot::State state = slot.state.load(std::memory_order_acquire);
+
+	if (state == ReassemblySlot::FREE) {
+		reset(slot, header, fragmentSize, now);
+	} else if (slot.nframe != header.nframe) {
+
+		// Wrap-safe check whether the slot holds an older frame
+		bool newer = (int32_t)(header.nframe - slot.nframe) > 0;
+
+		// A streamed frame stays put until the decoder lets go of it
+		if (!newer || state == ReassemblySlot::COMPLETE || slot.streamed) {
+			staleFragments++;
+			return NULL;
+		}
+
+		// An older frame never completed, give up on it
+		evictedFrames++;
+		lostFragments += slot.nfrags - slot.fragsReceived;
+		reset(slot, header, fragmentSize, now);
+	} else if (state == ReassemblySlot::COMPLETE) {
+		duplicateFragments++;
+		return NULL;
+	}
+
+	// Fragments of one frame have to agree on its layout
+	if (slot.nfrags != header.nfrags || slot.framesize != header.framesize || slot.fragmentSize != fragmentSize) {
+		rejectedFragments++;
+		return NULL;
+	}
+
+	slot.lastArrival = now;
+	if (!hasNewestFrame || (int32_t)(header.nframe - newest) > 0) {
+		hasNewestFrame = true;
+		newest = header.nframe;
+	}
+
+	if (parity) {
+		if (!addParity(slot, header, payload)) {
+			return NULL;
+		}
+
+		recover(slot, parityGroup(header));
+		advancePrefix(slot);
+		return complete(slot, gameinfo);
+	}
+
+	if (testBit(slot.fragmentMask, header.nfrag)) {
+		duplicateFragments++;
+		return NULL;
+	}
+	setBit(slot.fragmentMask, header.nfrag);
+
+	// Save fragment at its spot in the frame, unless it was received there
+	char* location = &slot.data[header.nfrag * slot.fragmentSize];
+	if (location != payload) {
+		memcpy(location, payload, payloadSize(slot, header.nfrag));
+	}
+	slot.fragsReceived++;
+
+	if (header.nfrag > slot.highestFragment) {
+		slot.highestFragment = header.nfrag;
+	}
+
+	// Parity normally trails its group, so this only kicks in when it was reordered ahead
+	if (slot.fecGroupSize > 0) {
+		recover(slot, header.nfrag / slot.fecGroupSize);
+	}
+
+	advancePrefix(slot);
+	return complete(slot, gameinfo);
+}
+
+bool FrameReassembler::addParity(ReassemblySlot& slot, const UDPRecvHeader& header, const char* payload) {
+	uint32_t group = parityGroup(header);
+	uint32_t groupSize = parityGroupSize(header);
+
+	// All parity of a frame has to use the same grouping
+	if (groupSize < MIN_FEC_GROUP || group * groupSize >= slot.nfrags
+		|| (slot.fecGroupSize != 0 && slot.fecGroupSize != groupSize)) {
+		rejectedFragments++;
+		return false;
+	}
+
+	if (testBit(slot.parityMask, group)) {
+		duplicateFragments++;
+		return false;
+	}
+
+	slot.fecGroupSize = groupSize;
+	setBit(slot.parityMask, group);
+	memcpy(&slot.parity[group * slot.fragmentSize], payload, slot.fragmentSize);
+
+	return true;
+}
+
+void FrameReassembler::recover(ReassemblySlot& slot, uint32_t group) {
+	if (!testBit(slot.parityMask, group)) {
+		return;
+	}
+
+	uint32_t first = group * slot.fecGroupSize;
+	uint32_t end = first + slot.fecGroupSize;
+	if (end > slot.nfrags) {
+		end = slot.nfrags;
+	}
+
+	// Parity can only stand in for a single fragment
+	int missing = -1;
+	for (uint32_t i = first; i < end; i++) {
+		if (!testBit(slot.fragmentMask, i)) {
+			if (missing >= 0) {
+				return;
+			}
+			missing = i;
+		}
+	}
+
+	if (missing < 0) {
+		return;
+	}
+
+	// XOR of the parity and every other fragment of the group is the missing one
+	char* target = &slot.data[missing * slot.fragmentSize];
+	memcpy(target, &slot.parity[group * slot.fragmentSize], slot.fragmentSize);
+	for (uint32_t i = first; i < end; i++) {
+		if ((int)i != missing) {
+			xorInto(target, &slot.data[i * slot.fragmentSize], payloadSize(slot, i));
+		}
+	}
+
+	setBit(slot.fragmentMask, missing);
+	slot.fragsReceived++;
+	recoveredFragments++;
+}
+
+void FrameReassembler::advancePrefix(ReassemblySlot& slot) {
+	uint32_t before = slot.contiguousFragments;
+	while (slot.contiguousFragments < slot.nfrags && testBit(slot.fragmentMask, slot.contiguousFragments)) {
+		slot.contiguousFragments++;
+	}
+
+	if (slot.contiguousFragments != before) {
+		uint32_t bytes = slot.contiguousFragments * slot.fragmentSize;
+		slot.contiguousBytes.store(bytes < slot.framesize ? bytes : slot.framesize, std::memory_order_release);
+	}
+}
+
+ReassemblySlot* FrameReassembler::complete(ReassemblySlot& slot, const UDPRecvGameInfo& gameinfo) {
+	if (slot.fragsReceived < slot.nfrags) {
+		return NULL;
+	}
+
+	// Frame has been fully assembled, zero the padding the decoder may read into
+	memset(&slot.data[slot.framesize], 0, AV_INPUT_BUFFER_PADDING_SIZE);
+	slot.gameinfo = gameinfo;
+	slot.state.store(ReassemblySlot::COMPLETE, std::memory_order_release);
+
+	return &slot;
+}
+
+char* FrameReassembler::fragmentLocation(uint32_t nframe, uint32_t nfrag, uint32_t fragmentSize) const {
+	if (nfrag >= MAX_FRAGMENTS || fragmentSize > PACKET_SIZE) {
+		return NULL;
+	}
+
+	return slots[nframe % SLOT_COUNT].data + (size_t)nfrag * fragmentSize;
+}
+
+char* FrameReassembler::predictLocation(uint32_t nframe, uint32_t nfrag, uint32_t fragmentSize, int& room) const {
+	if (nfrag >= MAX_FRAGMENTS) {
+		return NULL;
+	}
+
+	const ReassemblySlot& slot = slots[nframe % SLOT_COUNT];
+	ReassemblySlot::State state = slot.state.load(std::memory_order_acquire);
+
+	// Nothing in an unused slab is worth keeping
+	if (state == ReassemblySlot::FREE) {
+		room = fragmentSize;
+		return slot.data + (size_t)nfrag * fragmentSize;
+	}
+
+	// A frame being filled only has room where no fragment arrived yet
+	if (state == ReassemblySlot::FILLING && slot.nframe == nframe && nfrag < slot.nfrags
+		&& !testBit(slot.fragmentMask, nfrag)) {
+		room = slot.fragmentSize;
+		return slot.data + (size_t)nfrag * slot.fragmentSize;
+	}
+
+	return NULL;
+}
+
+void FrameReassembler::discardBefore(uint32_t nframe) {
+	hasOldestFrame = true;
+	oldestFrame = nframe;
+
+	for (int i = 0; i < SLOT_COUNT; i++) {
+		ReassemblySlot& slot = slots[i];
+		if (slot.state.load(std::memory_order_acquire) == ReassemblySlot::FILLING && (int32_t)(slot.nframe - nframe) < 0) {
+			if (slot.streamed) {
+				if (!slot.abandoned.load(std::memory_order_relaxed)) {
+					lostFragments += slot.nfrags - slot.fragsReceived;
+					slot.abandoned.store(true, std::memory_order_release);
+				}
+				continue;
+			}
+
+			lostFragments += slot.nfrags - slot.fragsReceived;
+			slot.state.store(ReassemblySlot::FREE, std::memory_order_relaxed);
+		}
+	}
+}
+
+uint64_t FrameReassembler::firstArrivalFrom(uint32_t nframe) const {
+	uint64_t earliest = 0;
+
+	for (int i = 0; i < SLOT_COUNT; i++) {
+		const ReassemblySlot& slot = slots[i];
+		if (slot.state.load(std::memory_order_acquire) == ReassemblySlot::FREE || (int32_t)(slot.nframe - nframe) < 0) {
+			continue;
+		}
+
+		if (earliest == 0 || slot.firstArrival < earliest) {
+			earliest = slot.firstArrival;
+		}
+	}
+
+	return earliest;
+}
+
+uint32_t FrameReassembler::newestFrame() const {
+	return newest;
+}
+
+int FrameReassembler::missingFragments(const ReassemblySlot& slot, uint32_t end, uint32_t* missing, int maxMissing) const {
+	int count = 0;
+
+	for (uint32_t i = 0; i < end && i < slot.nfrags && count < maxMissing; i++) {
+		if (!testBit(slot.fragmentMask, i)) {
+			missing[count++] = i;
+		}
+	}
+
+	return count;
+}
+
+ReassemblySlot* FrameReassembler::streamableSlot(uint32_t nframe) {
+	ReassemblySlot& slot = slots[nframe % SLOT_COUNT];
+	if (slot.state.load(std::memory_order_acquire) != ReassemblySlot::FILLING || slot.nframe != nframe
+		|| slot.streamed || slot.contiguousBytes.load(std::memory_order_relaxed) == 0) {
+		return NULL;
+	}
+
+	return &slot;
+}
+
+const ReassemblySlot& FrameReassembler::slotAt(int index) const {
+	return slots[index];
+}
+
+void FrameReassembler::release(ReassemblySlot* slot) {
+	slot->state.store(ReassemblySlot::FREE, std::memory_order_release);
+}
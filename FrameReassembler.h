@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "Protocol.h"
+
+class FrameReassembler;
+
+// A frame being reassembled from its fragments
+struct ReassemblySlot {
+	enum State {
+		FREE,		// Not in use
+		FILLING,	// Waiting for fragments
+		COMPLETE	// All fragments received, owned by the caller until released
+	};
+
+	// Written by the receiving thread, except for the hand back in release()
+	std::atomic<State> state;
+
+	uint32_t nframe;
+	uint32_t nfrags;
+	uint32_t framesize;
+	uint32_t fragsReceived;
+
+	// Payload of every fragment but the last, PACKET_SIZE for v1 streams
+	uint32_t fragmentSize;
+
+	// When the first and the latest fragment of this frame arrived, in microseconds
+	uint64_t firstArrival;
+	uint64_t lastArrival;
+
+	// Highest fragment index stored so far
+	uint32_t highestFragment;
+
+	// Fragments from the start of the frame that have all arrived, and the bytes they hold
+	//	The bytes are published for a decoder reading the frame while it is still filling
+	uint32_t contiguousFragments;
+	std::atomic<uint32_t> contiguousBytes;
+
+	// Handed to the decoder while still filling, the decoder releases it in any case
+	bool streamed;
+
+	// A streamed frame that missed its deadline, the decoder stops reading it
+	std::atomic<bool> abandoned;
+
+	// Game state carried by the fragment that completed the frame, set before it is published
+	UDPRecvGameInfo gameinfo;
+
+	// One bit per fragment index, set once that fragment has been stored
+	uint64_t* fragmentMask;
+
+	// Fragments per parity group, 0 until the first parity fragment arrives
+	uint32_t fecGroupSize;
+
+	// One bit per parity group, and the parity payloads themselves
+	uint64_t* parityMask;
+	char* parity;
+
+	// Frame data, followed by zeroed decoder padding once complete
+	char* data;
+
+	FrameReassembler* owner;
+};
+
+// Fixed-capacity reassembly store
+//	Frames map onto a slot by nframe modulo SLOT_COUNT. All slabs are allocated up
+//	front, so memory use is constant and nothing is allocated per packet.
+class FrameReassembler {
+public:
+	static const int SLOT_COUNT = 16;
+
+	// Largest frame that can be reassembled, in fragments
+	static const int MAX_FRAGMENTS = 512;
+
+	// Smallest parity group accepted, bounds the parity kept per slot
+	static const int MIN_FEC_GROUP = 4;
+	static const int MAX_PARITY_FRAGMENTS = MAX_FRAGMENTS / MIN_FEC_GROUP;
+
+	// A frame this far behind the oldest wanted frame means the server restarted its count
+	static const int RESTART_DISTANCE = 1024;
+
+	// Fragments dropped because they were duplicates, malformed or too late
+	std::atomic<uint64_t> duplicateFragments{ 0 };
+	std::atomic<uint64_t> rejectedFragments{ 0 };
+	std::atomic<uint64_t> staleFragments{ 0 };
+
+	// Incomplete frames overwritten by a newer frame mapping onto the same slot
+	std::atomic<uint64_t> evictedFrames{ 0 };
+
+	// Fragments rebuilt from parity
+	std::atomic<uint64_t> recoveredFragments{ 0 };
+
+	// Fragments that never arrived of frames given up on
+	std::atomic<uint64_t> lostFragments{ 0 };
+
+	FrameReassembler();
+	~FrameReassembler();
+
+	FrameReassembler(const FrameReassembler&) = delete;
+	FrameReassembler& operator=(const FrameReassembler&) = delete;
+
+	// Store a fragment, its frame split into fragments of fragmentSize bytes
+	//	The payload is not copied if it already sits at fragmentLocation()
+	//	Returns the slot if this fragment completed its frame, NULL otherwise
+	ReassemblySlot* addFragment(const UDPRecvHeader& header, uint32_t fragmentSize, const UDPRecvGameInfo& gameinfo, const char* payload, uint64_t now);
+
+	// Stop collecting frames before nframe, abandoning any that are still incomplete
+	void discardBefore(uint32_t nframe);
+
+	// Earliest first arrival of any frame from nframe on that is still held, 0 if there is none
+	uint64_t firstArrivalFrom(uint32_t nframe) const;
+
+	// Newest frame any fragment has been seen for
+	uint32_t newestFrame() const;
+
+	// Fragment indices below end that haven't arrived, returns how many were written
+	int missingFragments(const ReassemblySlot& slot, uint32_t end, uint32_t* missing, int maxMissing) const;
+
+	const ReassemblySlot& slotAt(int index) const;
+
+	// Slot of the given frame if it is still filling, has a prefix to decode and wasn't streamed yet
+	ReassemblySlot* streamableSlot(uint32_t nframe);
+
+	// Where the payload of a fragment ends up in its slab
+	char* fragmentLocation(uint32_t nframe, uint32_t nfrag, uint32_t fragmentSize) const;
+
+	// Where a fragment that hasn't arrived yet may be received directly, and how many bytes fit
+	//	A frame not seen yet is assumed to be split into fragments of fragmentSize
+	//	Returns NULL if writing there could clobber data still in use
+	char* predictLocation(uint32_t nframe, uint32_t nfrag, uint32_t fragmentSize, int& room) const;
+
+	// Hand a completed slot back for reuse
+	//	Safe to call from a thread other than the one adding fragments
+	void release(ReassemblySlot* slot);
+
+	// Size of each slab, including padding
+	static int slabSize();
+
+private:
+	static const int MASK_WORDS = MAX_FRAGMENTS / 64;
+	static const int PARITY_MASK_WORDS = MAX_PARITY_FRAGMENTS / 64;
+
+	ReassemblySlot slots[SLOT_COUNT];
+
+	char* slabs;
+	uint64_t masks[SLOT_COUNT][MASK_WORDS];
+
+	char* paritySlabs;
+	uint64_t parityMasks[SLOT_COUNT][PARITY_MASK_WORDS];
+
+	// Fragments of frames before this one are no longer wanted
+	bool hasOldestFrame = false;
+	uint32_t oldestFrame = 0;
+
+	// Newest frame seen, restarts along with oldestFrame
+	bool hasNewestFrame = false;
+	uint32_t newest = 0;
+
+	void reset(ReassemblySlot& slot, const UDPRecvHeader& header, uint32_t fragmentSize, uint64_t now);
+
+	// Extend the contiguous prefix over fragments that have arrived
+	void advancePrefix(ReassemblySlot& slot);
+
+	// Keep a parity fragment, returns false if it doesn't fit the frame
+	bool addParity(ReassemblySlot& slot, const UDPRecvHeader& header, const char* payload);
+
+	// Rebuild the one missing fragment of a parity group, if that is all that's missing
+	void recover(ReassemblySlot& slot, uint32_t group);
+
+	// Mark the slot complete if every fragment is in
+	ReassemblySlot* complete(ReassemblySlot& slot, const UDPRecvGameInfo& gameinfo);
+};
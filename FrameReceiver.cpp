@@ -0,0 +1,364 @@
+#include "FrameReceiver.h"
+#include "Clock.h"
+#include "Crc32c.h"
+
+#include <chrono>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest a replay waits for the decoder before it evicts a frame anyway
+static const uint64_t REPLAY_BLOCK_LIMIT = 1000000;
+
+// How often a finished replay checks for stopping and frame deadlines
+static const int REPLAY_POLL_MS = 10;
+
+FrameReceiver::FrameReceiver(Transport* transport, FrameReassembler& reassembler, CompletedFrameQueue& completed, QueueSignal& completedSignal)
+	: jitterBuffer(reassembler, completed, completedSignal), nackScheduler(reassembler), transport(transport), reassembler(reassembler) {
+	for (int i = 0; i < ECHO_FRAMES; i++) {
+		echoes[i] = 0;
+	}
+}
+
+FrameReceiver::~FrameReceiver() {
+	stop();
+}
+
+void FrameReceiver::start() {
+	running = true;
+	thread = std::thread(&FrameReceiver::receiveLoop, this);
+}
+
+void FrameReceiver::startReplay(CaptureReader* reader, bool realTime) {
+	replayReader = reader;
+	replayRealTime = realTime;
+
+	running = true;
+	thread = std::thread(&FrameReceiver::replayLoop, this);
+}
+
+void FrameReceiver::stop() {
+	running = false;
+	if (thread.joinable()) {
+		thread.join();
+	}
+}
+
+void FrameReceiver::receiveLoop() {
+	while (running) {
+		predictBatch();
+
+		int count = transport->receive(packets, headerSize, payloads, packetLengths, BATCH_SIZE);
+		receiveCalls++;
+		evacuateMispredicted(count);
+
+		uint64_t now = nowMicroseconds();
+		for (int i = 0; i < count; i++) {
+			processPacket((const char*)&packets[i], payloads[i], packetLengths[i], now);
+		}
+
+		nackScheduler.poll(now, jitterBuffer.latencyTarget);
+		jitterBuffer.poll(now);
+	}
+
+	cpuMicroseconds = threadCpuMicroseconds();
+}
+
+void FrameReceiver::replayLoop() {
+	uint64_t start = nowMicroseconds();
+
+	CaptureRecord record;
+	while (running && replayReader->next(record)) {
+		uint64_t now = start + record.timestamp;
+
+		// Records hold whole datagrams, headers are copied out when read as records aren't aligned
+		int size = datagramHeaderSize(record.length);
+		const char* payload = record.data + (record.length < size ? record.length : size);
+
+		Datagram datagram = Datagram();
+		bool fragment = readDatagram(record.data, payload, record.length, datagram) == FRAGMENT;
+
+		uint64_t waitStart = nowMicroseconds();
+		while (running) {
+			uint64_t current = nowMicroseconds();
+
+			// Wait for the recorded arrival time, keeping deadlines running meanwhile
+			bool early = replayRealTime && current < now;
+
+			// Or for the decoder to catch up, rather than evicting a frame it hasn't taken yet
+			const ReassemblySlot& slot = reassembler.slotAt(datagram.header.nframe % FrameReassembler::SLOT_COUNT);
+			bool blocked = !replayRealTime && fragment && slot.nframe != datagram.header.nframe
+				&& slot.state.load(std::memory_order_acquire) == ReassemblySlot::COMPLETE
+				&& current - waitStart < REPLAY_BLOCK_LIMIT;
+
+			if (!early && !blocked) {
+				break;
+			}
+
+			jitterBuffer.poll(replayRealTime ? current : now);
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		processPacket(record.data, payload, record.length, now);
+		jitterBuffer.poll(now);
+	}
+
+	replayFinished = true;
+
+	// Let the last frames reach their deadlines
+	while (running) {
+		jitterBuffer.poll(replayRealTime ? nowMicroseconds() : UINT64_MAX / 2);
+		std::this_thread::sleep_for(std::chrono::milliseconds(REPLAY_POLL_MS));
+	}
+}
+
+void FrameReceiver::ingest(const char* datagram, int length, uint64_t now) {
+	int size = datagramHeaderSize(length);
+	processPacket(datagram, datagram + (length < size ? length : size), length, now);
+	jitterBuffer.poll(now);
+}
+
+// Fragments arrive in order nearly all the time, so the next datagrams most likely
+// continue the current frame and then start the next one
+void FrameReceiver::predictBatch() {
+	uint32_t nframe = expectedFrame;
+	uint32_t nfrag = expectedFragment;
+
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		char* location = NULL;
+		int room = 0;
+
+		if (transport->placesPayloads()) {
+			location = reassembler.predictLocation(nframe, nfrag, expectedFragmentSize, room);
+
+			// Ran past the end of the frame
+			if (!location && nfrag > 0) {
+				nframe++;
+				nfrag = 0;
+				location = reassembler.predictLocation(nframe, nfrag, expectedFragmentSize, room);
+			}
+		}
+
+		// Only the room of the fragment is offered, so a longer datagram is cut short rather than spill into the next
+		if (location) {
+			predicted[i] = location;
+			packetLengths[i] = room;
+		} else {
+			predicted[i] = (char*)&packets[i] + headerSize;
+			packetLengths[i] = sizeof(UDPRecvPacket) - headerSize;
+		}
+
+		payloads[i] = predicted[i];
+		nfrag++;
+	}
+}
+
+// A wrong guess still landed in a spot no fragment has claimed yet, but another
+// datagram of this batch may need that spot, so copy all of them out before storing any
+void FrameReceiver::evacuateMispredicted(int count) {
+	for (int i = 0; i < count; i++) {
+		char* packet = (char*)&packets[i];
+		int length = packetLengths[i];
+		int size = datagramHeaderSize(length);
+		int payloadLength = length > headerSize ? length - headerSize : 0;
+
+		// Split at the header size of the other version, put it back together behind its header
+		//	Anything longer than a v1 datagram is of neither version and only partly kept
+		if (size != headerSize) {
+			if (payloadLength > (int)sizeof(UDPRecvPacket) - headerSize) {
+				payloadLength = sizeof(UDPRecvPacket) - headerSize;
+			}
+			if (payloads[i] != packet + headerSize) {
+				memmove(packet + headerSize, payloads[i], payloadLength);
+			}
+			payloads[i] = packet + (length < size ? length : size);
+			copiedPayloads++;
+			continue;
+		}
+
+		// Left in the packet or in the transport's own buffer, copied into place later
+		if (payloads[i] == packet + headerSize || payloads[i] != predicted[i]) {
+			copiedPayloads++;
+			continue;
+		}
+
+		Datagram datagram;
+		if (readDatagram(packet, payloads[i], length, datagram) == FRAGMENT
+			&& payloads[i] == reassembler.fragmentLocation(datagram.header.nframe, datagram.header.nfrag, datagram.fragmentSize)) {
+			placedPayloads++;
+			continue;
+		}
+
+		memcpy(packet + headerSize, payloads[i], payloadLength);
+		payloads[i] = packet + headerSize;
+		copiedPayloads++;
+	}
+}
+
+FrameReceiver::DatagramType FrameReceiver::readDatagram(const char* header, const char* payload, int length, Datagram& datagram) const {
+	datagram.payload = payload;
+	datagram.checksummed = false;
+	datagram.echoed = false;
+
+	if (length == (int)sizeof(UDPRecvPacket)) {
+		datagram.version = 1;
+		memcpy(&datagram.header, header, sizeof(UDPRecvHeader));
+		memcpy(&datagram.gameinfo, header + offsetof(UDPRecvPacket, gameinfo), sizeof(UDPRecvGameInfo));
+		datagram.fragmentSize = PACKET_SIZE;
+		datagram.payloadLength = PACKET_SIZE;
+		return FRAGMENT;
+	}
+
+	// Anything shorter can't hold the header
+	if (length < UDP_RECV_HEADER_V2_SIZE) {
+		return INVALID;
+	}
+
+	UDPRecvHeaderV2 v2;
+	memcpy(&v2, header, sizeof(v2));
+	if (v2.version != PROTOCOL_V2) {
+		return INVALID;
+	}
+
+	datagram.version = 2;
+	datagram.payloadLength = length - UDP_RECV_HEADER_V2_SIZE;
+	datagram.checksummed = (v2.flags & V2_FLAG_CHECKSUM) != 0;
+	datagram.checksum = v2.checksum;
+
+	if (v2.stream != streamId) {
+		return FOREIGN;
+	}
+
+	datagram.header.nframe = v2.nframe;
+
+	if (v2.flags & V2_FLAG_STATE) {
+		if (datagram.payloadLength == (int)(sizeof(UDPRecvGameInfo) + sizeof(UDPRecvInputEcho))) {
+			UDPRecvInputEcho echo;
+			memcpy(&echo, payload + sizeof(UDPRecvGameInfo), sizeof(echo));
+			datagram.echoed = true;
+			datagram.echo = echo.seq;
+		} else if (datagram.payloadLength != (int)sizeof(UDPRecvGameInfo)) {
+			return INVALID;
+		}
+
+		memcpy(&datagram.gameinfo, payload, sizeof(UDPRecvGameInfo));
+		return STATE;
+	}
+
+	datagram.header.nfrags = v2.nfrags;
+	datagram.header.framesize = v2.sizes & 0xFFFFFF;
+	datagram.fragmentSize = (v2.sizes >> 24) * 8;
+	if (datagram.fragmentSize == 0 || datagram.fragmentSize > PACKET_SIZE) {
+		return INVALID;
+	}
+
+	// Parity and all but the last fragment are full size, the last holds what is left
+	int expected = datagram.fragmentSize;
+	if (v2.flags & V2_FLAG_PARITY) {
+		datagram.header.nfrag = parityFragmentIndex(v2.nfrag & 0xFF, v2.nfrag >> 8);
+	} else {
+		datagram.header.nfrag = v2.nfrag;
+		if (v2.nfrags > 0 && v2.nfrag == v2.nfrags - 1) {
+			expected = (int)datagram.header.framesize - (int)(datagram.fragmentSize * (v2.nfrags - 1));
+		}
+	}
+
+	// A datagram cut short, or one that doesn't add up
+	if (datagram.payloadLength != expected) {
+		return INVALID;
+	}
+
+	return FRAGMENT;
+}
+
+uint32_t FrameReceiver::inputEcho(uint32_t nframe) const {
+	uint64_t entry = echoes[nframe % ECHO_FRAMES].load(std::memory_order_relaxed);
+	if ((uint32_t)(entry >> 32) != nframe) {
+		return 0;
+	}
+
+	return (uint32_t)entry;
+}
+
+// Add the given packet to the corresponding frame
+// If frame is now complete, queue it for the decoder
+void FrameReceiver::processPacket(const char* header, const char* payload, int length, uint64_t now) {
+
+	packetsReceived++;
+	receivedBytes += length;
+
+	if (capture.isOpen()) {
+		int size = datagramHeaderSize(length) < length ? datagramHeaderSize(length) : length;
+		capture.write(header, size, payload, length - size, now);
+	}
+
+	Datagram datagram;
+	DatagramType type = readDatagram(header, payload, length, datagram);
+
+	// The only datagrams cut short are v1 ones received at the smaller v2 split, so
+	//	anything that doesn't read goes back to v1 and the fragment size it implies
+	if (type == INVALID) {
+		headerSize = UDP_RECV_HEADER_SIZE;
+		expectedFragmentSize = PACKET_SIZE;
+		reassembler.rejectedFragments++;
+		return;
+	}
+
+	// Before anything of it is trusted
+	if (datagram.checksummed) {
+		UDPRecvHeaderV2 zeroed;
+		memcpy(&zeroed, header, sizeof(zeroed));
+		zeroed.checksum = 0;
+
+		if (crc32c(crc32c(0, &zeroed, sizeof(zeroed)), payload, datagram.payloadLength) != datagram.checksum) {
+			corruptPackets++;
+			return;
+		}
+	}
+
+	headerSize = datagramHeaderSize(length);
+	protocolVersion = datagram.version;
+
+	if (type == FOREIGN) {
+		return;
+	}
+
+	// Newer game state for the frames that follow, a reordered older one is ignored
+	if (type == STATE) {
+		int32_t distance = (int32_t)(datagram.header.nframe - streamStateFrame);
+		if (distance >= 0 || distance < -FrameReassembler::RESTART_DISTANCE) {
+			streamState = datagram.gameinfo;
+			streamStateFrame = datagram.header.nframe;
+			if (datagram.echoed) {
+				streamEcho = datagram.echo;
+			}
+		}
+		return;
+	}
+
+	if (datagram.version == 2) {
+		datagram.gameinfo = streamState;
+		echoes[datagram.header.nframe % ECHO_FRAMES].store((uint64_t)datagram.header.nframe << 32 | streamEcho, std::memory_order_relaxed);
+	}
+
+	// Continue predicting from here
+	if (!isParityFragment(datagram.header)) {
+		expectedFrame = datagram.header.nframe;
+		expectedFragment = datagram.header.nfrag + 1;
+		expectedFragmentSize = datagram.fragmentSize;
+
+		uint32_t offset = datagram.header.nfrag * datagram.fragmentSize;
+		if (offset < datagram.header.framesize) {
+			uint32_t remaining = datagram.header.framesize - offset;
+			frameBytes += remaining < datagram.fragmentSize ? remaining : datagram.fragmentSize;
+		}
+	}
+
+	ReassemblySlot* slot = reassembler.addFragment(datagram.header, datagram.fragmentSize, datagram.gameinfo, payload, now);
+
+	// Frame has been fully assembled
+	if (slot) {
+		jitterBuffer.add(slot);
+	}
+}
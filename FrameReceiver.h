@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+#include "Protocol.h"
+#include "FrameReassembler.h"
+#include "JitterBuffer.h"
+#include "NackScheduler.h"
+#include "PacketCapture.h"
+#include "SPSCQueue.h"
+#include "Transport.h"
+
+// Receives fragments on its own thread and reassembles them into frames
+class FrameReceiver {
+public:
+	// Most datagrams taken from the socket per receive call
+	static const int BATCH_SIZE = 32;
+
+	// Receive calls and datagrams received, to judge how well batching works
+	std::atomic<uint64_t> receiveCalls{ 0 };
+	std::atomic<uint64_t> packetsReceived{ 0 };
+
+	// Payloads received straight into place and ones that had to be copied
+	std::atomic<uint64_t> placedPayloads{ 0 };
+	std::atomic<uint64_t> copiedPayloads{ 0 };
+
+	// Processor time the receive thread used, set when it stops
+	std::atomic<uint64_t> cpuMicroseconds{ 0 };
+
+	// Bytes of every datagram received and the frame data among them, for the goodput
+	std::atomic<uint64_t> receivedBytes{ 0 };
+	std::atomic<uint64_t> frameBytes{ 0 };
+
+	// Datagrams whose checksum didn't match, dropped before reassembly
+	std::atomic<uint64_t> corruptPackets{ 0 };
+
+	// Version of the latest well formed datagram, 0 until one arrives
+	std::atomic<int> protocolVersion{ 0 };
+
+	// Stream taken from v2 senders, datagrams of other streams are ignored
+	uint16_t streamId = 0;
+
+	// Puts completed frames in order before they go to the decoder
+	JitterBuffer jitterBuffer;
+
+	// Requests resends of lost fragments, off until enabled
+	NackScheduler nackScheduler;
+
+	// Records every datagram received, once opened
+	CaptureWriter capture;
+
+	// Set when a replayed capture has been fed through completely
+	std::atomic<bool> replayFinished{ false };
+
+	// Newest input change the server had applied when it rendered the frame, 0 if unknown
+	//	Frames are remembered for the ECHO_FRAMES most recent ones received. Any thread.
+	uint32_t inputEcho(uint32_t nframe) const;
+
+	// Transport may be NULL when only replaying
+	FrameReceiver(Transport* transport, FrameReassembler& reassembler, CompletedFrameQueue& completed, QueueSignal& completedSignal);
+	~FrameReceiver();
+
+	void start();
+	void stop();
+
+	// Feed a capture through reassembly instead of the socket
+	//	In real time datagrams are fed with their recorded spacing, otherwise as fast
+	//	as reassembly slots free up. Either way the recorded timestamps drive the
+	//	jitter buffer, so its decisions are the same on every run.
+	void startReplay(CaptureReader* reader, bool realTime);
+
+	// Feed one whole datagram through reassembly on the calling thread, as if received at now
+	//	For benchmarks, not to be mixed with start() or startReplay().
+	void ingest(const char* datagram, int length, uint64_t now);
+
+private:
+	Transport* transport;
+	FrameReassembler& reassembler;
+
+	std::thread thread;
+	std::atomic<bool> running{ false };
+
+	// What a datagram holds once its header has been read, whichever version it came in
+	enum DatagramType {
+		INVALID,
+		FOREIGN,	// Of another stream
+		STATE,		// Game state of a v2 stream
+		FRAGMENT
+	};
+
+	struct Datagram {
+		int version;
+
+		// v1 layout, parity fragments of v2 included
+		UDPRecvHeader header;
+		uint32_t fragmentSize;
+
+		// Carried by every v1 fragment and by v2 state datagrams
+		UDPRecvGameInfo gameinfo;
+
+		const char* payload;
+		int payloadLength;
+
+		// Input echo of v2 state datagrams that carry one
+		bool echoed;
+		uint32_t echo;
+
+		// Checksum of v2 datagrams that carry one
+		bool checksummed;
+		uint32_t checksum;
+	};
+
+	// Datagrams of the current batch
+	//	Headers always land in packets, split off at headerSize. Payloads land wherever
+	//	payloads points to: their final place in a reassembly slab if predicted, right
+	//	behind the header in the packet otherwise, or a buffer of the transport if it
+	//	doesn't place payloads
+	UDPRecvPacket packets[BATCH_SIZE];
+	char* predicted[BATCH_SIZE];
+	char* payloads[BATCH_SIZE];
+	int packetLengths[BATCH_SIZE];
+
+	// Header size of the version the latest datagram was sent in
+	int headerSize = UDP_RECV_HEADER_SIZE;
+
+	// Fragment expected to arrive next, and the fragment size of its frame
+	uint32_t expectedFrame = 0;
+	uint32_t expectedFragment = 0;
+	uint32_t expectedFragmentSize = PACKET_SIZE;
+
+	// Game state of v2 streams and the frame it was sent with
+	UDPRecvGameInfo streamState = UDPRecvGameInfo();
+	uint32_t streamStateFrame = 0;
+	uint32_t streamEcho = 0;
+
+	// Input echo of recent frames, the frame number in the high half and the echo in the low
+	static const int ECHO_FRAMES = 64;
+	std::atomic<uint64_t> echoes[ECHO_FRAMES];
+
+	CaptureReader* replayReader = NULL;
+	bool replayRealTime = false;
+
+	void receiveLoop();
+	void replayLoop();
+
+	// Point each payload of the next batch at the slab position its fragment will most likely need
+	void predictBatch();
+
+	// Move payloads that were received at the wrong position out of the way
+	//	Datagrams split at the wrong size are put back together in their packet
+	void evacuateMispredicted(int count);
+
+	// Header and payload are where the datagram was split at its own header size
+	DatagramType readDatagram(const char* header, const char* payload, int length, Datagram& datagram) const;
+
+	void processPacket(const char* header, const char* payload, int length, uint64_t now);
+};
@@ -0,0 +1,122 @@
+#include "InputChannel.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Keycodes of keys without a character are their scancode with this bit set
+static const int32_t SCANCODE_MASK = 1 << 30;
+
+InputChannel::InputChannel(SOCKET socket, const sockaddr_in& address)
+	: socket(socket), address(address) {
+	packet.magic = INPUT_MAGIC;
+}
+
+int InputChannel::keyIndex(int32_t keycode) {
+	if (keycode >= 0 && keycode < 256) {
+		return keycode;
+	}
+
+	if ((keycode & SCANCODE_MASK) && (keycode & ~SCANCODE_MASK) < 512) {
+		return 256 + (keycode & ~SCANCODE_MASK);
+	}
+
+	return -1;
+}
+
+void InputChannel::keyChanged(int32_t keycode, bool down, uint64_t time) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Auto-repeat, or a release of a key that was never seen going down
+	int index = keyIndex(keycode);
+	if (index >= 0) {
+		if (keyDown[index] == down) {
+			changesCoalesced++;
+			return;
+		}
+		keyDown[index] = down;
+	}
+
+	newest++;
+	Change& change = history[newest % HISTORY_SIZE];
+	change.event.seq = newest;
+	change.event.time = (uint32_t)time;
+	change.event.keycode = keycode;
+	change.event.down = down ? 1 : 0;
+	change.time = time;
+	change.sends = 0;
+
+	// Changes this far behind would be overwritten, they had their chance
+	if (newest - unsent >= (uint32_t)HISTORY_SIZE) {
+		unsent = newest - HISTORY_SIZE + 1;
+	}
+}
+
+void InputChannel::poll(uint64_t now) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Repeats are only owed for changes that haven't gone out often enough
+	while (unsent <= newest && history[unsent % HISTORY_SIZE].sends >= redundancy) {
+		unsent++;
+	}
+
+	bool fresh = unsent <= newest && history[newest % HISTORY_SIZE].sends == 0;
+	bool repeat = unsent <= newest && now - lastSend >= repeatInterval;
+	bool keepalive = now - lastSend >= keepaliveInterval;
+
+	if (fresh || repeat || keepalive) {
+		send(now);
+	}
+}
+
+void InputChannel::send(uint64_t now) {
+	int count = 0;
+	for (uint32_t seq = unsent; seq <= newest && count < MAX_INPUT_EVENTS; seq++) {
+		Change& change = history[seq % HISTORY_SIZE];
+		if (change.sends >= redundancy) {
+			continue;
+		}
+
+		if (change.sends == 0) {
+			changesSent++;
+		}
+		change.sends++;
+		packet.events[count++] = change.event;
+	}
+
+	packet.newest = newest;
+	packet.count = count;
+	lastSend = now;
+
+	int ret = sendto(
+		socket,
+		(const char*)&packet,
+		offsetof(UDPInputEventPacket, events) + count * sizeof(UDPInputEvent),
+		0,
+		(const sockaddr*)&address,
+		sizeof(address)
+	);
+
+	if (ret < 0) {
+		printf("Input send failed\n");
+		return;
+	}
+
+	packetsSent++;
+}
+
+void InputChannel::presented(uint32_t echo, uint64_t now) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if ((int32_t)(echo - echoed) <= 0 || (int32_t)(echo - newest) > 0) {
+		return;
+	}
+
+	// Every change the frame shows for the first time, as long as it is still remembered
+	for (uint32_t seq = echoed + 1; seq != echo + 1; seq++) {
+		const Change& change = history[seq % HISTORY_SIZE];
+		if (change.event.seq == seq && newest - seq < (uint32_t)HISTORY_SIZE && now >= change.time) {
+			inputToPhoton.record(now - change.time);
+		}
+	}
+
+	echoed = echo;
+}
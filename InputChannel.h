@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+#include "Socket.h"
+
+#include "Protocol.h"
+#include "LatencyStats.h"
+
+// Sends key changes to the server as they happen, replacing a UDPInputPacket per input tick
+//	Changes polled together go out in one datagram right away. Each is repeated in the
+//	next datagrams until it went out redundancy times, spaced repeatInterval apart, and
+//	without changes a keepalive goes out every keepaliveInterval. Servers that echo the
+//	newest change they applied let presented frames be matched to the input they show.
+//	Changes are polled on the input thread, frames presented on the render thread.
+class InputChannel {
+public:
+	// Datagrams every change goes out in
+	int redundancy = 3;
+
+	// Time between repeats, and between keepalives when nothing changes, in microseconds
+	uint64_t repeatInterval = 4000;
+	uint64_t keepaliveInterval = 100000;
+
+	// Changes sent, auto-repeats and changes to the state a key already had dropped
+	std::atomic<uint64_t> changesSent{ 0 };
+	std::atomic<uint64_t> changesCoalesced{ 0 };
+	std::atomic<uint64_t> packetsSent{ 0 };
+
+	// From a change happening to the first presented frame the server had applied it for
+	LatencyHistogram inputToPhoton;
+
+	InputChannel(SOCKET socket, const sockaddr_in& address);
+
+	// A key went down or up at the given time, in microseconds
+	void keyChanged(int32_t keycode, bool down, uint64_t time);
+
+	// Send new changes, repeats and keepalives that are due
+	void poll(uint64_t now);
+
+	// A frame was presented, echo being the newest change the server applied to it
+	void presented(uint32_t echo, uint64_t now);
+
+private:
+	// Changes remembered to be repeated and to time the echo
+	static const int HISTORY_SIZE = 256;
+
+	// Keys tracked for coalescing, characters below 256 and keys named after their scancode
+	static const int KEY_STATES = 256 + 512;
+
+	struct Change {
+		UDPInputEvent event;
+		uint64_t time;
+		int sends;
+	};
+
+	SOCKET socket;
+	sockaddr_in address;
+
+	// Guards the history between the input and render threads
+	std::mutex mutex;
+
+	Change history[HISTORY_SIZE];
+
+	// Newest sequence number given out, and the oldest one that may still need sending
+	uint32_t newest = 0;
+	uint32_t unsent = 1;
+
+	// Newest change an echo has been seen for
+	uint32_t echoed = 0;
+
+	uint64_t lastSend = 0;
+
+	// Whether each key is down as far as the server was told
+	bool keyDown[KEY_STATES] = {};
+
+	UDPInputEventPacket packet;
+
+	// Where the key's state is tracked, -1 if it isn't
+	static int keyIndex(int32_t keycode);
+
+	void send(uint64_t now);
+};
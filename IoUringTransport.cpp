@@ -0,0 +1,127 @@
+#include "IoUringTransport.h"
+
+#if defined(__linux__) && defined(USE_LIBURING)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+IoUringTransport::IoUringTransport(SOCKET socket, const TransportConfig& config)
+	: socket(socket), timeoutMs(config.timeoutMs) {
+
+	configureSocket(socket, config, false);
+
+	int ret = io_uring_queue_init(QUEUE_DEPTH, &ring, 0);
+	if (ret < 0) {
+		printf("io_uring init failed: %d\n", -ret);
+		exit(EXIT_FAILURE);
+	}
+
+	bufferRing = io_uring_setup_buf_ring(&ring, BUFFER_COUNT, BUFFER_GROUP, 0, &ret);
+	if (!bufferRing) {
+		printf("io_uring buffer ring failed: %d\n", -ret);
+		exit(EXIT_FAILURE);
+	}
+
+	buffers = new char[BUFFER_COUNT * BUFFER_SIZE];
+	for (int i = 0; i < BUFFER_COUNT; i++) {
+		io_uring_buf_ring_add(bufferRing, buffers + i * BUFFER_SIZE, BUFFER_SIZE, i, io_uring_buf_ring_mask(BUFFER_COUNT), i);
+	}
+	io_uring_buf_ring_advance(bufferRing, BUFFER_COUNT);
+}
+
+IoUringTransport::~IoUringTransport() {
+	io_uring_free_buf_ring(&ring, bufferRing, BUFFER_COUNT, BUFFER_GROUP);
+	io_uring_queue_exit(&ring);
+	delete[] buffers;
+}
+
+const char* IoUringTransport::name() const {
+	return "io_uring";
+}
+
+bool IoUringTransport::placesPayloads() const {
+	return false;
+}
+
+void IoUringTransport::arm() {
+	io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+	io_uring_prep_recv_multishot(sqe, socket, NULL, 0, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BUFFER_GROUP;
+
+	io_uring_submit(&ring);
+	armed = true;
+}
+
+void IoUringTransport::returnBuffers() {
+	for (int i = 0; i < lentCount; i++) {
+		io_uring_buf_ring_add(bufferRing, buffers + lent[i] * BUFFER_SIZE, BUFFER_SIZE, lent[i], io_uring_buf_ring_mask(BUFFER_COUNT), i);
+	}
+	io_uring_buf_ring_advance(bufferRing, lentCount);
+	lentCount = 0;
+}
+
+int IoUringTransport::receive(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) {
+
+	// The last batch has been processed
+	returnBuffers();
+
+	// The kernel ends a multishot receive when it ran out of buffers
+	if (!armed) {
+		arm();
+	}
+
+	io_uring_cqe* cqe;
+	__kernel_timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000LL };
+	int ret = io_uring_wait_cqe_timeout(&ring, &cqe, &timeout);
+	if (ret == -ETIME || ret == -EINTR) {
+		return 0;
+	}
+	if (ret < 0) {
+		printf("io_uring wait failed: %d\n", -ret);
+		exit(EXIT_FAILURE);
+	}
+
+	int received = 0;
+	unsigned seen = 0;
+	unsigned head;
+
+	io_uring_for_each_cqe(&ring, head, cqe) {
+		if (received == count) {
+			break;
+		}
+		seen++;
+
+		if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			armed = false;
+		}
+
+		if (cqe->res < 0) {
+			if (cqe->res != -ENOBUFS) {
+				printf("Receive failure: %d\n", -cqe->res);
+				exit(EXIT_FAILURE);
+			}
+			continue;
+		}
+
+		if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+			continue;
+		}
+
+		int buffer = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		char* datagram = buffers + buffer * BUFFER_SIZE;
+		int length = cqe->res;
+
+		memcpy(&packets[received], datagram, length < headerSize ? length : headerSize);
+		payloads[received] = datagram + headerSize;
+		lengths[received] = length;
+		lent[lentCount++] = buffer;
+		received++;
+	}
+
+	io_uring_cq_advance(&ring, seen);
+	return received;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#pragma once
+
+#if defined(__linux__) && defined(USE_LIBURING)
+
+#include <liburing.h>
+
+#include "Transport.h"
+
+// One multishot receive that stays armed, filling buffers the kernel picks from a ring
+//	Each datagram costs a completion instead of a system call, and a batch needs a
+//	single wait. The kernel picks the buffer, so payloads are never placed up front;
+//	buffers go back to the ring at the start of the next receive.
+//	Built only with USE_LIBURING defined and liburing 2.4 or later linked.
+class IoUringTransport : public Transport {
+public:
+	IoUringTransport(SOCKET socket, const TransportConfig& config);
+	~IoUringTransport();
+
+	const char* name() const override;
+	bool placesPayloads() const override;
+	int receive(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) override;
+
+private:
+	static const int QUEUE_DEPTH = 64;
+
+	// Buffer count must be a power of two, each holds one datagram
+	static const int BUFFER_COUNT = 256;
+	static const int BUFFER_SIZE = 2048;
+	static const int BUFFER_GROUP = 0;
+
+	SOCKET socket;
+	int timeoutMs;
+
+	io_uring ring;
+	io_uring_buf_ring* bufferRing = NULL;
+	char* buffers = NULL;
+
+	// The multishot receive is still active
+	bool armed = false;
+
+	// Buffers handed out by the last receive, returned to the ring on the next
+	int lent[BUFFER_COUNT];
+	int lentCount = 0;
+
+	void arm();
+	void returnBuffers();
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include "JitterBuffer.h"
+
+JitterBuffer::JitterBuffer(FrameReassembler& reassembler, CompletedFrameQueue& completed, QueueSignal& completedSignal)
+	: reassembler(reassembler), completed(completed), completedSignal(completedSignal) {
+}
+
+void JitterBuffer::skipTo(uint32_t nframe) {
+	for (int i = 0; i < FrameReassembler::SLOT_COUNT; i++) {
+		if (ready[i] && (int32_t)(ready[i]->nframe - nframe) < 0) {
+			reassembler.release(ready[i]);
+			ready[i] = NULL;
+		}
+	}
+
+	// Whatever was streamed is left behind as well
+	streaming = NULL;
+
+	nextFrame = nframe;
+	reassembler.discardBefore(nframe);
+}
+
+void JitterBuffer::discardPassed() {
+	reassembler.discardBefore(streaming ? streaming->nframe : nextFrame);
+}
+
+void JitterBuffer::add(ReassemblySlot* slot) {
+
+	// Finished while the decoder was already reading it
+	if (slot->streamed) {
+		if (slot == streaming) {
+			streaming = NULL;
+			discardPassed();
+		}
+		return;
+	}
+
+	// Start playing from the first frame that completes
+	if (!started) {
+		started = true;
+		skipTo(slot->nframe);
+	}
+
+	int32_t distance = (int32_t)(slot->nframe - nextFrame);
+
+	if (distance < -FrameReassembler::RESTART_DISTANCE) {
+
+		// Server restarted its frame count, start over
+		skipTo(slot->nframe);
+		distance = 0;
+	} else if (distance < 0) {
+
+		// A newer frame has already been passed on
+		lateFrames++;
+		reassembler.release(slot);
+		return;
+	} else if (distance >= FrameReassembler::SLOT_COUNT) {
+
+		// Everything in between is gone, only keep what fits the window
+		droppedFrames += distance - (FrameReassembler::SLOT_COUNT - 1);
+		skipTo(slot->nframe - (FrameReassembler::SLOT_COUNT - 1));
+		distance = FrameReassembler::SLOT_COUNT - 1;
+	}
+
+	if (distance > 0) {
+		reorderedFrames++;
+	}
+
+	ready[slot->nframe % FrameReassembler::SLOT_COUNT] = slot;
+}
+
+void JitterBuffer::poll(uint64_t now) {
+	bool delivered = false;
+
+	// The frame being streamed missed its deadline, the decoder stops reading it
+	if (streaming && now >= streaming->firstArrival + latencyTarget) {
+		abandonedFrames++;
+		streaming = NULL;
+		discardPassed();
+		delivered = true;
+	}
+
+	while (started) {
+		ReassemblySlot*& slot = ready[nextFrame % FrameReassembler::SLOT_COUNT];
+
+		// Next frame is complete, pass it on unless the decoder is full
+		if (slot && slot->nframe == nextFrame) {
+			if (!completed.push(slot)) {
+				break;
+			}
+
+			slot = NULL;
+			delivered = true;
+			deliveredFrames++;
+			nextFrame++;
+			discardPassed();
+			continue;
+		}
+
+		// Start decoding the next frame from what has arrived of it so far
+		if (progressive && !streaming) {
+			ReassemblySlot* filling = reassembler.streamableSlot(nextFrame);
+			if (filling) {
+				if (!completed.push(filling)) {
+					break;
+				}
+
+				filling->streamed = true;
+				streaming = filling;
+				delivered = true;
+				deliveredFrames++;
+				nextFrame++;
+				continue;
+			}
+		}
+
+		// Nothing known from here on, keep waiting
+		uint64_t arrival = reassembler.firstArrivalFrom(nextFrame);
+		if (arrival == 0 || now < arrival + latencyTarget) {
+			break;
+		}
+
+		// Next frame missed its deadline, give up on it
+		droppedFrames++;
+		nextFrame++;
+		discardPassed();
+	}
+
+	// A streamed frame may have grown with every batch
+	if (delivered || streaming) {
+		completedSignal.notify();
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "FrameReassembler.h"
+#include "SPSCQueue.h"
+
+// Completed frames, handed from the receive thread to the decoder
+typedef SPSCQueue<ReassemblySlot*, FrameReassembler::SLOT_COUNT> CompletedFrameQueue;
+
+// Playout buffer between reassembly and decoding
+//	Frames are passed on strictly in nframe order. A frame that is still incomplete
+//	when its deadline passes is given up on, so one lost fragment can't hold up the
+//	stream, and anything older than the last frame passed on is dropped.
+class JitterBuffer {
+public:
+	// How long a frame may wait for its missing fragments, counted from the first
+	// fragment of the oldest frame still held, in microseconds
+	uint64_t latencyTarget = 30000;
+
+	// Pass the next frame on as soon as its first fragments are in, for a decoder
+	// that takes frames in chunks, instead of waiting for it to complete
+	//	One frame is streamed at a time. It is abandoned if it misses its deadline.
+	bool progressive = false;
+
+	// Frames passed on to the decoder
+	std::atomic<uint64_t> deliveredFrames{ 0 };
+
+	// Frames that completed after a newer frame had already been passed on
+	std::atomic<uint64_t> lateFrames{ 0 };
+
+	// Frames given up on, because they missed their deadline or never showed up
+	std::atomic<uint64_t> droppedFrames{ 0 };
+
+	// Frames that completed before an older frame, and had to wait for it
+	std::atomic<uint64_t> reorderedFrames{ 0 };
+
+	// Streamed frames that missed their deadline after decoding had started
+	std::atomic<uint64_t> abandonedFrames{ 0 };
+
+	JitterBuffer(FrameReassembler& reassembler, CompletedFrameQueue& completed, QueueSignal& completedSignal);
+
+	// Take a completed frame
+	void add(ReassemblySlot* slot);
+
+	// Pass on every frame that is due, drop the ones that missed their deadline
+	void poll(uint64_t now);
+
+private:
+	FrameReassembler& reassembler;
+	CompletedFrameQueue& completed;
+	QueueSignal& completedSignal;
+
+	// Completed frames waiting for their turn, by nframe modulo SLOT_COUNT
+	ReassemblySlot* ready[FrameReassembler::SLOT_COUNT] = {};
+
+	// Frame to pass on next
+	bool started = false;
+	uint32_t nextFrame = 0;
+
+	// Frame passed on while still filling, fragments for it are still wanted
+	ReassemblySlot* streaming = NULL;
+
+	// Forget frames before nextFrame, or before the one being streamed
+	void discardPassed();
+
+	// Continue from the given frame, forgetting everything before it
+	void skipTo(uint32_t nframe);
+};
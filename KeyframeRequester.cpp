@@ -0,0 +1,51 @@
+#include "KeyframeRequester.h"
+
+#include <stdio.h>
+
+void KeyframeRequester::enable(SOCKET socket, const sockaddr_in& address) {
+	this->socket = socket;
+	this->address = address;
+	enabled = true;
+}
+
+void KeyframeRequester::request(uint32_t nframe, uint64_t now) {
+	if (!enabled) {
+		return;
+	}
+
+	if (requested && now - lastRequest < minInterval) {
+		requestsSuppressed++;
+		return;
+	}
+
+	UDPKeyframeRequest packet = { KEYFRAME_MAGIC, nframe };
+	int ret = sendto(
+		socket,
+		(const char*)&packet,
+		sizeof(packet),
+		0,
+		(const sockaddr*)&address,
+		sizeof(address)
+	);
+
+	if (ret < 0) {
+		printf("Keyframe request send failed\n");
+		return;
+	}
+
+	requested = true;
+	lastRequest = now;
+	if (!firstRequest) {
+		firstRequest = now;
+	}
+	requestsSent++;
+}
+
+void KeyframeRequester::answered() {
+	requested = false;
+	firstRequest = 0;
+}
+
+bool KeyframeRequester::pending(uint64_t now) const {
+	return firstRequest && now - firstRequest < answerTimeout;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "Socket.h"
+
+#include "Protocol.h"
+
+// Asks the server for a keyframe when the decoder has nothing to decode the next frames against
+//	Requests are at least minInterval apart, as the keyframe takes a round trip and an
+//	encode to arrive and each one costs a burst of bandwidth. A request that got lost
+//	is repeated once the interval is over. A request that isn't answered within
+//	answerTimeout is taken as the server ignoring them. Decode thread only.
+class KeyframeRequester {
+public:
+	// Time between requests, in microseconds
+	uint64_t minInterval = 100000;
+
+	// Time a keyframe may take to answer the first request, in microseconds
+	uint64_t answerTimeout = 500000;
+
+	// Requests sent, and ones held back as a request had just gone out
+	std::atomic<uint64_t> requestsSent{ 0 };
+	std::atomic<uint64_t> requestsSuppressed{ 0 };
+
+	// Start sending requests to the given address, nothing is sent before
+	void enable(SOCKET socket, const sockaddr_in& address);
+
+	// Ask for a keyframe, nframe being the newest frame seen
+	void request(uint32_t nframe, uint64_t now);
+
+	// A keyframe arrived, the next loss asks for one right away
+	void answered();
+
+	// Whether a keyframe is on its way, asked for less than answerTimeout ago
+	bool pending(uint64_t now) const;
+
+private:
+	bool enabled = false;
+	SOCKET socket;
+	sockaddr_in address;
+
+	bool requested = false;
+	uint64_t lastRequest = 0;
+
+	// First request since the last keyframe, 0 if there was none
+	uint64_t firstRequest = 0;
+};
@@ -0,0 +1,166 @@
+#include "LatencyStats.h"
+
+// Large enough that rows leave in a few writes a second
+static const int CSV_BUFFER_SIZE = 64 * 1024;
+
+static const uint64_t FPS_WINDOW = 1000000;
+
+const char* LatencyStats::stageNames[STAGE_COUNT] = {
+	"network", "queue", "decode", "wait", "upload", "present", "total"
+};
+
+LatencyHistogram::LatencyHistogram() {
+	reset();
+}
+
+int LatencyHistogram::bucketOf(uint64_t value) {
+	if (value < LINEAR_BUCKETS) {
+		return (int)value;
+	}
+
+	// Keep the top bits of the value, the shift picks the range
+	int shift = 0;
+	while ((value >> shift) >= 2 * SUB_BUCKETS) {
+		shift++;
+	}
+
+	int bucket = LINEAR_BUCKETS + (shift - 1) * SUB_BUCKETS + (int)(value >> shift) - SUB_BUCKETS;
+	return bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1;
+}
+
+uint64_t LatencyHistogram::bucketValue(int bucket) {
+	if (bucket < LINEAR_BUCKETS) {
+		return bucket;
+	}
+
+	int shift = (bucket - LINEAR_BUCKETS) / SUB_BUCKETS + 1;
+	uint64_t top = (bucket - LINEAR_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+	return top << shift;
+}
+
+void LatencyHistogram::record(uint64_t value) {
+	buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(1, std::memory_order_relaxed);
+
+	uint64_t current = max.load(std::memory_order_relaxed);
+	while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+	}
+}
+
+uint64_t LatencyHistogram::percentile(double fraction) const {
+	uint64_t recorded = total.load(std::memory_order_relaxed);
+	if (recorded == 0) {
+		return 0;
+	}
+
+	uint64_t wanted = (uint64_t)(fraction * recorded);
+	uint64_t seen = 0;
+
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		seen += buckets[i].load(std::memory_order_relaxed);
+		if (seen > wanted) {
+			return bucketValue(i);
+		}
+	}
+
+	return maximum();
+}
+
+uint64_t LatencyHistogram::maximum() const {
+	return max.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+	return total.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		buckets[i].store(0, std::memory_order_relaxed);
+	}
+	total.store(0, std::memory_order_relaxed);
+	max.store(0, std::memory_order_relaxed);
+}
+
+LatencyStats::~LatencyStats() {
+	closeCsv();
+}
+
+bool LatencyStats::openCsv(const char* path) {
+	closeCsv();
+
+#ifdef _MSC_VER
+	if (fopen_s(&csv, path, "w") != 0) {
+		csv = NULL;
+	}
+#else
+	csv = fopen(path, "w");
+#endif
+
+	if (!csv) {
+		return false;
+	}
+
+	setvbuf(csv, NULL, _IOFBF, CSV_BUFFER_SIZE);
+	fprintf(csv, "nframe,first_fragment_us");
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		fprintf(csv, ",%s_us", stageNames[i]);
+	}
+	fprintf(csv, "\n");
+
+	return true;
+}
+
+void LatencyStats::closeCsv() {
+	if (csv) {
+		fclose(csv);
+		csv = NULL;
+	}
+}
+
+void LatencyStats::record(uint32_t nframe, const FrameTimings& timings) {
+	uint64_t durations[STAGE_COUNT];
+	durations[NETWORK] = timings.lastFragment - timings.firstFragment;
+	durations[QUEUE] = timings.decodeSubmit - timings.lastFragment;
+	durations[DECODE] = timings.decodeReturn - timings.decodeSubmit;
+	durations[WAIT] = timings.uploadStart - timings.decodeReturn;
+	durations[UPLOAD] = timings.uploadDone - timings.uploadStart;
+	durations[PRESENT] = timings.presented - timings.uploadDone;
+	durations[TOTAL] = timings.presented - timings.firstFragment;
+
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		stages[i].record(durations[i]);
+	}
+
+	if (csv) {
+		fprintf(csv, "%u,%llu", nframe, (unsigned long long)timings.firstFragment);
+		for (int i = 0; i < STAGE_COUNT; i++) {
+			fprintf(csv, ",%llu", (unsigned long long)durations[i]);
+		}
+		fprintf(csv, "\n");
+	}
+
+	// Frame rate over whole windows, so it doesn't flicker
+	if (fpsWindowFrames == 0) {
+		fpsWindowStart = timings.presented;
+		fpsWindowFrames = 1;
+		return;
+	}
+	fpsWindowFrames++;
+
+	uint64_t elapsed = timings.presented - fpsWindowStart;
+	if (elapsed >= FPS_WINDOW) {
+		fps = (float)((fpsWindowFrames - 1) * 1000000.0 / elapsed);
+		fpsWindowStart = timings.presented;
+		fpsWindowFrames = 1;
+	}
+}
+
+void LatencyStats::reset() {
+	for (int i = 0; i < STAGE_COUNT; i++) {
+		stages[i].reset();
+	}
+
+	fps = 0.0f;
+	fpsWindowFrames = 0;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+
+// When a frame passed each stage on its way to the screen, in microseconds
+struct FrameTimings {
+	uint64_t firstFragment = 0;
+	uint64_t lastFragment = 0;
+	uint64_t decodeSubmit = 0;
+	uint64_t decodeReturn = 0;
+	uint64_t uploadStart = 0;
+	uint64_t uploadDone = 0;
+	uint64_t presented = 0;
+};
+
+// Distribution of durations in microseconds
+//	Buckets are exact below 64 and about 3% wide above that, up to a minute.
+//	Recording is a relaxed increment, so any thread may record while another reads.
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+
+	void record(uint64_t value);
+
+	// Value that the given fraction of recorded values doesn't exceed
+	uint64_t percentile(double fraction) const;
+
+	uint64_t maximum() const;
+	uint64_t count() const;
+
+	void reset();
+
+private:
+	static const int LINEAR_BUCKETS = 64;
+	static const int SUB_BUCKETS = 32;
+	static const int BUCKET_COUNT = LINEAR_BUCKETS + 20 * SUB_BUCKETS;
+
+	std::atomic<uint32_t> buckets[BUCKET_COUNT];
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> max;
+
+	static int bucketOf(uint64_t value);
+
+	// Smallest value falling into the bucket
+	static uint64_t bucketValue(int bucket);
+};
+
+// Latency of every stage presented frames went through, and the rate they were presented at
+class LatencyStats {
+public:
+	enum Stage {
+		NETWORK,	// First to last fragment
+		QUEUE,		// Last fragment to decode submit, mostly the jitter buffer
+		DECODE,		// Decode submit to return
+		WAIT,		// Decode return to the render thread picking it up
+		UPLOAD,		// Texture upload
+		PRESENT,	// Composition, overlay and present
+		TOTAL,		// First fragment to present
+		STAGE_COUNT
+	};
+
+	static const char* stageNames[STAGE_COUNT];
+
+	LatencyHistogram stages[STAGE_COUNT];
+
+	// Presented frames per second, measured over about a second, render thread only
+	float fps = 0.0f;
+
+	~LatencyStats();
+
+	// Write a row per presented frame to the given file from now on
+	bool openCsv(const char* path);
+	void closeCsv();
+
+	// Account for a frame that has just been presented, render thread only
+	void record(uint32_t nframe, const FrameTimings& timings);
+
+	void reset();
+
+private:
+	FILE* csv = NULL;
+
+	uint64_t fpsWindowStart = 0;
+	int fpsWindowFrames = 0;
+};
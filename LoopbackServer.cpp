@@ -0,0 +1,528 @@
+#include "LoopbackServer.h"
+#include "Crc32c.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+LoopbackServer::LoopbackServer(const LoopbackConfig& config)
+	: config(config), random(1234) {
+
+	// v2 parity headers keep the group size in a byte
+	if (config.protocol == 2) {
+		fragmentSize = fragmentSizeForMtu(config.mtu);
+		if (this->config.fecGroupSize > 255) {
+			this->config.fecGroupSize = 255;
+		}
+	} else {
+		fragmentSize = PACKET_SIZE;
+	}
+}
+
+LoopbackServer::~LoopbackServer() {
+	stop();
+
+	av_frame_free(&picture);
+	av_packet_free(&encoded);
+	avcodec_free_context(&encoder);
+}
+
+void LoopbackServer::initEncoder() {
+	AVCodec* codec = avcodec_find_encoder(config.codecId);
+	if (!codec) {
+		printf("Loopback encoder not found..\n");
+		exit(EXIT_FAILURE);
+	}
+
+	encoder = avcodec_alloc_context3(codec);
+	encoder->width = config.width;
+	encoder->height = config.height;
+	encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+	encoder->time_base = { 1, config.fps };
+	encoder->framerate = { config.fps, 1 };
+	encoder->bit_rate = 4000000;
+	encoder->gop_size = config.fps;
+	encoder->max_b_frames = 0;
+
+	// Several slices per frame, each a NAL unit a progressive client can decode on arrival
+	AVDictionary* options = NULL;
+	if (config.codecId == AV_CODEC_ID_H264) {
+		encoder->slices = 8;
+		av_dict_set(&options, "preset", "ultrafast", 0);
+		av_dict_set(&options, "tune", "zerolatency", 0);
+	}
+
+	int ret = avcodec_open2(encoder, codec, &options);
+	av_dict_free(&options);
+	if (ret < 0) {
+		printf("could not open loopback encoder..\n");
+		exit(EXIT_FAILURE);
+	}
+
+	picture = av_frame_alloc();
+	encoded = av_packet_alloc();
+	if (!picture || !encoded) {
+		printf("Loopback alloc failed..\n");
+		exit(EXIT_FAILURE);
+	}
+
+	picture->format = AV_PIX_FMT_YUV420P;
+	picture->width = config.width;
+	picture->height = config.height;
+	if (av_frame_get_buffer(picture, 32) < 0) {
+		printf("Loopback picture alloc failed..\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+// Split the stream into frames once, so replaying costs no more than sending
+void LoopbackServer::loadStream() {
+	std::ifstream file(config.streamPath, std::ios::binary);
+	if (!file) {
+		printf("Could not open %s\n", config.streamPath);
+		exit(EXIT_FAILURE);
+	}
+
+	std::vector<uint8_t> stream((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	stream.resize(stream.size() + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+
+	AVCodecParserContext* parser = av_parser_init(config.codecId);
+	AVCodecContext* context = avcodec_alloc_context3(NULL);
+	if (!parser || !context) {
+		printf("Loopback parser init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	const uint8_t* data = stream.data();
+	int remaining = (int)stream.size() - AV_INPUT_BUFFER_PADDING_SIZE;
+
+	// An empty input at the end flushes out the last frame
+	while (true) {
+		uint8_t* frame;
+		int frameSize;
+		int used = av_parser_parse2(parser, context, &frame, &frameSize, data, remaining, AV_NOPTS_VALUE, AV_NOPTS_VALUE, 0);
+		if (used < 0) {
+			break;
+		}
+
+		data += used;
+		remaining -= used;
+
+		if (frameSize > 0) {
+			replayFrames.push_back(std::vector<uint8_t>(frame, frame + frameSize));
+			replayKeyframes.push_back(parser->key_frame == 1 || parser->pict_type == AV_PICTURE_TYPE_I);
+		} else if (remaining == 0 && used == 0) {
+			break;
+		}
+	}
+
+	av_parser_close(parser);
+	avcodec_free_context(&context);
+
+	if (replayFrames.empty()) {
+		printf("No frames found in %s\n", config.streamPath);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("Loopback replaying %d frames from %s\n", (int)replayFrames.size(), config.streamPath);
+}
+
+void LoopbackServer::initSocket() {
+
+	// Configure address
+	sendAddress.sin_family = AF_INET;
+	sendAddress.sin_addr.s_addr = inet_addr(config.address);
+	sendAddress.sin_port = htons(config.port);
+
+	// Initialize the socket, winsock is already up as the client started it
+	sendSocket = socket(PF_INET, SOCK_DGRAM, 0);
+	if (sendSocket < 0) {
+		printf("Loopback socket init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Take the place of the server's input socket
+	sockaddr_in feedbackAddress;
+	feedbackAddress.sin_family = AF_INET;
+	feedbackAddress.sin_addr.s_addr = inet_addr(config.address);
+	feedbackAddress.sin_port = htons(config.feedbackPort);
+
+	feedbackSocket = socket(PF_INET, SOCK_DGRAM, 0);
+	if (feedbackSocket < 0) {
+		printf("Loopback feedback socket init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (bind(feedbackSocket, (const sockaddr*)&feedbackAddress, sizeof(feedbackAddress)) != 0) {
+		printf("Loopback feedback socket bind failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// Wake up periodically so stop() doesn't wait on a silent socket
+#ifdef _WIN32
+	DWORD timeout = 10;
+#else
+	timeval timeout = { 0, 10000 };
+#endif
+	setsockopt(feedbackSocket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+void LoopbackServer::start() {
+	if (config.streamPath) {
+		loadStream();
+	} else {
+		initEncoder();
+	}
+	initSocket();
+
+	running = true;
+	thread = std::thread(&LoopbackServer::serverLoop, this);
+	feedbackThread = std::thread(&LoopbackServer::feedbackLoop, this);
+}
+
+void LoopbackServer::stop() {
+	running = false;
+	if (thread.joinable()) {
+		thread.join();
+	}
+	if (feedbackThread.joinable()) {
+		feedbackThread.join();
+	}
+}
+
+void LoopbackServer::serverLoop() {
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	std::chrono::microseconds interval(1000000 / config.fps);
+
+	int index = 0;
+	while (running) {
+		bool keyframe = keyframeRequested.exchange(false);
+
+		if (!replayFrames.empty()) {
+
+			// Skip ahead to the next keyframe, a stream without any is sent as it is
+			if (keyframe) {
+				for (size_t skipped = 0; skipped < replayFrames.size() && !replayKeyframes[index % replayFrames.size()]; skipped++) {
+					index++;
+				}
+				keyframesForced++;
+			}
+
+			const std::vector<uint8_t>& frame = replayFrames[index++ % replayFrames.size()];
+			sendFrame(frame.data(), (int)frame.size());
+		} else {
+			drawPicture(index);
+			picture->pts = index++;
+			picture->pict_type = keyframe ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+			if (keyframe) {
+				keyframesForced++;
+			}
+
+			if (avcodec_send_frame(encoder, picture) < 0) {
+				printf("Loopback encode failed\n");
+				exit(EXIT_FAILURE);
+			}
+
+			while (avcodec_receive_packet(encoder, encoded) == 0) {
+				sendFrame(encoded->data, encoded->size);
+				av_packet_unref(encoded);
+			}
+		}
+
+		next += interval;
+		std::this_thread::sleep_until(next);
+	}
+}
+
+// Legacy input packets are of no interest here, only retransmission and keyframe requests and input changes
+void LoopbackServer::feedbackLoop() {
+	union {
+		uint32_t magic;
+		UDPNackPacket nack;
+		UDPKeyframeRequest keyframe;
+		UDPInputEventPacket input;
+	} packet;
+
+	while (running) {
+		int ret = recvfrom(feedbackSocket, (char*)&packet, sizeof(packet), 0, NULL, NULL);
+		if (ret < (int)sizeof(uint32_t)) {
+			continue;
+		}
+
+		if (packet.magic == NACK_MAGIC && ret >= (int)offsetof(UDPNackPacket, nfrag)) {
+
+			// Never trust the count beyond what actually arrived
+			uint32_t received = (ret - offsetof(UDPNackPacket, nfrag)) / sizeof(uint32_t);
+			if (packet.nack.count > received) {
+				packet.nack.count = received;
+			}
+
+			nacksReceived++;
+			resend(packet.nack);
+		} else if (packet.magic == INPUT_MAGIC && ret >= (int)offsetof(UDPInputEventPacket, events)) {
+			uint32_t received = (ret - offsetof(UDPInputEventPacket, events)) / sizeof(UDPInputEvent);
+			if (packet.input.count > received) {
+				packet.input.count = received;
+			}
+
+			inputPackets++;
+			applyInput(packet.input);
+		} else if (packet.magic == KEYFRAME_MAGIC && ret >= (int)sizeof(UDPKeyframeRequest)) {
+			keyframeRequests++;
+			keyframeRequested = true;
+		}
+	}
+}
+
+void LoopbackServer::applyInput(const UDPInputEventPacket& input) {
+	uint32_t applied = appliedInput;
+
+	// Events come oldest first, so anything skipped was sent as often as it will ever be
+	for (uint32_t i = 0; i < input.count; i++) {
+		uint32_t seq = input.events[i].seq;
+		if ((int32_t)(seq - applied) <= 0) {
+			continue;
+		}
+
+		inputGaps += seq - applied - 1;
+		inputEvents++;
+		applied = seq;
+	}
+
+	appliedInput = applied;
+}
+
+void LoopbackServer::resend(const UDPNackPacket& nack) {
+	std::lock_guard<std::mutex> lock(historyMutex);
+
+	const SentFrame& frame = history[nack.nframe % HISTORY_SIZE];
+	if (!frame.valid || frame.nframe != nack.nframe) {
+		return;
+	}
+
+	char payload[PACKET_SIZE];
+	uint32_t nfrags = (frame.data.size() + fragmentSize - 1) / fragmentSize;
+
+	for (uint32_t i = 0; i < nack.count; i++) {
+		if (nack.nfrag[i] < nfrags) {
+			sendFragment(frame, nack.nfrag[i], payload);
+			fragmentsResent++;
+		}
+	}
+}
+
+// A gradient scrolling diagonally with a bar sweeping across, enough motion for P-frames
+void LoopbackServer::drawPicture(int index) {
+	av_frame_make_writable(picture);
+
+	for (int y = 0; y < config.height; y++) {
+		uint8_t* row = picture->data[0] + y * picture->linesize[0];
+		for (int x = 0; x < config.width; x++) {
+			row[x] = (uint8_t)(x + y + index * 3);
+		}
+	}
+
+	int barX = (index * 8) % config.width;
+	for (int y = 0; y < config.height; y++) {
+		uint8_t* row = picture->data[0] + y * picture->linesize[0];
+		for (int x = barX; x < barX + 32 && x < config.width; x++) {
+			row[x] = 235;
+		}
+	}
+
+	for (int y = 0; y < config.height / 2; y++) {
+		memset(picture->data[1] + y * picture->linesize[1], 128 + (index % 64), config.width / 2);
+		memset(picture->data[2] + y * picture->linesize[2], 128 - (index % 64), config.width / 2);
+	}
+}
+
+void LoopbackServer::sendFrame(const uint8_t* data, int size) {
+	std::lock_guard<std::mutex> lock(historyMutex);
+
+	// Keep the frame for resends
+	SentFrame& frame = history[nframe % HISTORY_SIZE];
+	frame.valid = true;
+	frame.nframe = nframe++;
+	frame.data.assign(data, data + size);
+
+	if (config.protocol == 2) {
+		sendState(frame.nframe);
+	}
+
+	uint32_t nfrags = (size + fragmentSize - 1) / fragmentSize;
+	char payload[PACKET_SIZE];
+	char parity[PACKET_SIZE];
+
+	for (uint32_t nfrag = 0; nfrag < nfrags; nfrag++) {
+		sendFragment(frame, nfrag, payload);
+
+		if (config.fecGroupSize <= 0) {
+			continue;
+		}
+		uint32_t groupSize = (uint32_t)config.fecGroupSize;
+
+		// Accumulate parity, send it after the last fragment of each group
+		uint32_t group = nfrag / groupSize;
+		if (nfrag % groupSize == 0) {
+			memset(parity, 0, fragmentSize);
+		}
+		for (int i = 0; i < fragmentSize; i++) {
+			parity[i] ^= payload[i];
+		}
+
+		if (nfrag % groupSize == groupSize - 1 || nfrag == nfrags - 1) {
+			sendPayload(frame, parityFragmentIndex(group, groupSize), parity, fragmentSize);
+		}
+	}
+
+	framesSent++;
+}
+
+// Counts down like a round of the game
+UDPRecvGameInfo LoopbackServer::gameInfo(uint32_t nframe) const {
+	UDPRecvGameInfo gameinfo;
+	gameinfo.currentTime = 60.0f - (float)(nframe % (60 * config.fps)) / config.fps;
+	gameinfo.prestart = false;
+	gameinfo.won = false;
+	gameinfo.lost = false;
+
+	return gameinfo;
+}
+
+void LoopbackServer::sendState(uint32_t nframe) {
+	UDPRecvGameInfo gameinfo = gameInfo(nframe);
+	uint32_t echo = appliedInput;
+	if (stateSent && gameinfo.currentTime == sentState.currentTime && gameinfo.prestart == sentState.prestart
+		&& gameinfo.won == sentState.won && gameinfo.lost == sentState.lost && echo == sentEcho) {
+		return;
+	}
+
+	UDPRecvHeaderV2 header = UDPRecvHeaderV2();
+	header.flags = V2_FLAG_STATE;
+	header.nframe = nframe;
+
+	char state[sizeof(UDPRecvGameInfo) + sizeof(UDPRecvInputEcho)];
+	memcpy(state, &gameinfo, sizeof(gameinfo));
+	memcpy(state + sizeof(gameinfo), &echo, sizeof(echo));
+
+	Datagram datagram;
+	frameV2(datagram, header, state, sizeof(state));
+	sendPacket(datagram);
+
+	stateSent = true;
+	sentState = gameinfo;
+	sentEcho = echo;
+}
+
+void LoopbackServer::sendFragment(const SentFrame& frame, uint32_t nfrag, char* payload) {
+	int framesize = (int)frame.data.size();
+	int offset = nfrag * fragmentSize;
+	int size = framesize - offset < fragmentSize ? framesize - offset : fragmentSize;
+
+	memset(payload, 0, fragmentSize);
+	memcpy(payload, frame.data.data() + offset, size);
+	sendPayload(frame, nfrag, payload, size);
+}
+
+void LoopbackServer::sendPayload(const SentFrame& frame, uint32_t nfrag, const char* payload, int size) {
+	uint32_t framesize = (uint32_t)frame.data.size();
+	uint32_t nfrags = (framesize + fragmentSize - 1) / fragmentSize;
+	Datagram datagram;
+
+	// Padded to PACKET_SIZE and with the game state in every datagram
+	if (config.protocol != 2) {
+		UDPRecvHeader header = { frame.nframe, nfrag, nfrags, framesize };
+		UDPRecvGameInfo gameinfo = gameInfo(frame.nframe);
+
+		memcpy(datagram.data, &header, sizeof(header));
+		memcpy(datagram.data + offsetof(UDPRecvPacket, gameinfo), &gameinfo, sizeof(gameinfo));
+		memcpy(datagram.data + UDP_RECV_HEADER_SIZE, payload, size);
+		memset(datagram.data + UDP_RECV_HEADER_SIZE + size, 0, PACKET_SIZE - size);
+		datagram.length = sizeof(UDPRecvPacket);
+
+		sendPacket(datagram);
+		return;
+	}
+
+	UDPRecvHeaderV2 header = UDPRecvHeaderV2();
+	header.nframe = frame.nframe;
+	header.nfrags = (uint16_t)nfrags;
+	header.sizes = packFragmentSizes(framesize, fragmentSize);
+
+	if (nfrag & FEC_PARITY_FLAG) {
+		header.flags = V2_FLAG_PARITY;
+		header.nfrag = (uint16_t)((nfrag & 0xFF) | (((nfrag & ~FEC_PARITY_FLAG) >> 16) << 8));
+	} else {
+		header.nfrag = (uint16_t)nfrag;
+	}
+
+	frameV2(datagram, header, payload, size);
+	sendPacket(datagram);
+}
+
+void LoopbackServer::frameV2(Datagram& datagram, UDPRecvHeaderV2& header, const char* payload, int size) {
+	header.version = PROTOCOL_V2;
+	header.stream = config.streamId;
+	header.checksum = 0;
+	if (config.checksum) {
+		header.flags |= V2_FLAG_CHECKSUM;
+	}
+
+	memcpy(datagram.data, &header, sizeof(header));
+	memcpy(datagram.data + UDP_RECV_HEADER_V2_SIZE, payload, size);
+	datagram.length = UDP_RECV_HEADER_V2_SIZE + size;
+
+	if (config.checksum) {
+		header.checksum = crc32c(0, datagram.data, datagram.length);
+		memcpy(datagram.data + offsetof(UDPRecvHeaderV2, checksum), &header.checksum, sizeof(header.checksum));
+	}
+}
+
+void LoopbackServer::sendPacket(const Datagram& datagram) {
+	std::lock_guard<std::mutex> lock(sendMutex);
+
+	// Simulated loss
+	if (config.lossRate > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < config.lossRate) {
+		packetsLost++;
+		return;
+	}
+
+	// Simulated reordering, the held datagram follows the next one
+	if (!holding && config.reorderRate > 0 && std::uniform_real_distribution<double>(0.0, 1.0)(random) < config.reorderRate) {
+		held = datagram;
+		holding = true;
+		return;
+	}
+
+	transmit(datagram);
+
+	if (holding) {
+		transmit(held);
+		holding = false;
+	}
+}
+
+void LoopbackServer::transmit(const Datagram& datagram) {
+	int ret = sendto(
+		sendSocket,
+		datagram.data,
+		datagram.length,
+		0,
+		(const sockaddr*)&sendAddress,
+		sizeof(sendAddress)
+	);
+
+	if (ret < 0) {
+		printf("Loopback send failed\n");
+	}
+
+	packetsSent++;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Socket.h"
+
+extern "C" {
+	#include "libavcodec/avcodec.h"
+	#include "libavutil/frame.h"
+}
+
+#include "Protocol.h"
+
+// Settings of the stand-in server
+struct LoopbackConfig {
+	int width = 1280;
+	int height = 720;
+	int fps = 60;
+
+	// Fragments per parity group, 0 sends no parity
+	int fecGroupSize = 0;
+
+	// Wire protocol version, 1 or 2
+	int protocol = 1;
+
+	// Path MTU v2 fragments are sized to
+	int mtu = 1500;
+
+	// Checksum every v2 datagram with a CRC32C
+	bool checksum = false;
+
+	// Stream id of v2 datagrams
+	uint16_t streamId = 0;
+
+	// Chance of dropping each datagram, to simulate a lossy link
+	double lossRate = 0.0;
+
+	// Chance of holding a datagram back until after the next one
+	double reorderRate = 0.0;
+
+	// Codec to encode with, and of the stream to replay
+	AVCodecID codecId = AV_CODEC_ID_MPEG4;
+
+	// Elementary stream to send in a loop instead of encoding, NULL to encode
+	const char* streamPath = NULL;
+
+	const char* address = "127.0.0.1";
+	int port = 8888;
+
+	// Where input and retransmission requests from the client arrive
+	int feedbackPort = 8880;
+};
+
+// Stand-in for the game server
+//	Encodes a synthetic stream, or replays a recorded one, and sends it
+//	fragmented exactly like the game server does, so the client can be exercised on loopback. Retransmission
+//	requests are honoured for the most recent frames, resends go through the same
+//	simulated loss. Input changes are applied in order and echoed with v2 frames.
+//	Keyframe requests make the next frame a keyframe.
+class LoopbackServer {
+public:
+	std::atomic<uint64_t> framesSent{ 0 };
+	std::atomic<uint64_t> packetsSent{ 0 };
+	std::atomic<uint64_t> packetsLost{ 0 };
+	std::atomic<uint64_t> nacksReceived{ 0 };
+	std::atomic<uint64_t> fragmentsResent{ 0 };
+
+	// Input change datagrams, changes applied, and changes lost in every datagram they went out in
+	std::atomic<uint64_t> inputPackets{ 0 };
+	std::atomic<uint64_t> inputEvents{ 0 };
+	std::atomic<uint64_t> inputGaps{ 0 };
+
+	// Keyframe requests received, and frames made keyframes, or skipped to, to answer them
+	std::atomic<uint64_t> keyframeRequests{ 0 };
+	std::atomic<uint64_t> keyframesForced{ 0 };
+
+	LoopbackServer(const LoopbackConfig& config);
+	~LoopbackServer();
+
+	void start();
+	void stop();
+
+private:
+	// Frames kept around for resends
+	static const int HISTORY_SIZE = 32;
+
+	struct SentFrame {
+		bool valid = false;
+		uint32_t nframe = 0;
+		std::vector<char> data;
+	};
+
+	// A datagram ready to go out, of either version
+	struct Datagram {
+		int length = 0;
+		char data[sizeof(UDPRecvPacket)];
+	};
+
+	LoopbackConfig config;
+
+	// Payload of every fragment but the last of a frame
+	int fragmentSize;
+
+	// Game state and input echo last sent in a v2 state datagram
+	bool stateSent = false;
+	UDPRecvGameInfo sentState;
+	uint32_t sentEcho = 0;
+
+	// Newest input change applied, changes are applied in order
+	std::atomic<uint32_t> appliedInput{ 0 };
+
+	SOCKET sendSocket;
+	sockaddr_in sendAddress;
+	SOCKET feedbackSocket;
+
+	AVCodecContext* encoder = NULL;
+	AVFrame* picture = NULL;
+	AVPacket* encoded = NULL;
+
+	// Encoded frames of the replayed stream, and which of them are keyframes
+	std::vector<std::vector<uint8_t>> replayFrames;
+	std::vector<bool> replayKeyframes;
+
+	// The client asked for a keyframe, taken by the server thread
+	std::atomic<bool> keyframeRequested{ false };
+
+	// Simulated loss and reordering, resends come from the feedback thread
+	std::mt19937 random;
+	std::mutex sendMutex;
+
+	// Datagram held back to be sent after the next one
+	bool holding = false;
+	Datagram held;
+
+	SentFrame history[HISTORY_SIZE];
+	std::mutex historyMutex;
+
+	std::thread thread;
+	std::thread feedbackThread;
+	std::atomic<bool> running{ false };
+
+	uint32_t nframe = 0;
+
+	void initEncoder();
+	void loadStream();
+	void initSocket();
+
+	void serverLoop();
+	void feedbackLoop();
+
+	// Draw the next synthetic picture
+	void drawPicture(int index);
+
+	// Split an encoded frame into fragments and send them
+	void sendFrame(const uint8_t* data, int size);
+
+	// Game state while the given frame is shown
+	UDPRecvGameInfo gameInfo(uint32_t nframe) const;
+
+	// Send the game state with a v2 frame if it changed since it was last sent
+	void sendState(uint32_t nframe);
+
+	// Send one data fragment of a frame from the history, its payload is left zero padded in payload
+	void sendFragment(const SentFrame& frame, uint32_t nfrag, char* payload);
+
+	// Frame a data or parity fragment in the configured version and send it
+	void sendPayload(const SentFrame& frame, uint32_t nfrag, const char* payload, int size);
+
+	// Put a v2 header, the payload and the checksum if configured into the datagram
+	void frameV2(Datagram& datagram, UDPRecvHeaderV2& header, const char* payload, int size);
+
+	// Resend the fragments asked for, if the frame is still in the history
+	void resend(const UDPNackPacket& nack);
+
+	// Apply the changes that are new, skipping over ones that never arrived
+	void applyInput(const UDPInputEventPacket& input);
+
+	void sendPacket(const Datagram& datagram);
+	void transmit(const Datagram& datagram);
+};
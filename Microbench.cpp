@@ -0,0 +1,727 @@
+#include "Clock.h"
+#include "Protocol.h"
+#include "FrameReassembler.h"
+#include "FrameReceiver.h"
+#include "FrameDecoder.h"
+#include "JitterBuffer.h"
+
+#include <algorithm>
+#include <new>
+#include <random>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+	#include "libavcodec/avcodec.h"
+	#include "libavutil/frame.h"
+}
+
+#include <SDL.h>
+
+#include "external/imgui/imgui.h"
+#include "external/imgui_sdl.h"
+
+// Component microbenchmarks, built on their own apart from the receiver
+//	Each case times one stage on its own, on input made from fixed seeds, so runs are
+//	comparable with each other: fragment ingestion through reassembly at several loss
+//	and reorder rates, decoding canned MPEG-4 frames, uploading pictures to a software
+//	renderer's texture and drawing the overlay with cold and warm triangle caches.
+//	Nothing needs a display, pictures and the overlay are drawn into memory.
+//
+//	Every case writes one line of JSON with the median and fastest of its samples in
+//	nanoseconds per operation, the allocations and the bytes the receiver copied per
+//	operation. Allocations are those through operator new and SDL's allocator on the
+//	timed thread, libavcodec allocates on its own and isn't counted. Bytes copied are
+//	null where the stage copies in ways not counted.
+struct MicrobenchConfig {
+	// Only cases whose name starts with this run, all of them if NULL
+	const char* filter = NULL;
+
+	// Where the results go, other output still goes to stdout
+	FILE* output = stdout;
+
+	// Timed runs of every case, the median is reported
+	int samples = 5;
+
+	// Overlay triangles kept rasterized, 0 for the default
+	size_t solidTriangleCache = 0;
+	size_t texturedTriangleCache = 0;
+};
+
+// Spacing of frames in the streams fed through reassembly, as at 60 fps
+static const uint64_t FRAME_INTERVAL = 16667;
+
+// Frames of each stream fed before timing starts, and the ones timed
+static const int INGEST_WARMUP_FRAMES = 60;
+static const int INGEST_FRAMES = 600;
+
+// Length of the canned MPEG-4 sequence, two groups of pictures
+static const int CANNED_FRAMES = 120;
+static const int CANNED_GOP = 60;
+
+// Operations per sample of the render thread's stages
+static const int UPLOAD_OPERATIONS = 100;
+static const int OVERLAY_OPERATIONS = 200;
+
+// Heap allocations made by the calling thread, counted by replacing operator new
+// and delete in every form
+static thread_local uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+	allocations++;
+
+	void* memory = malloc(size > 0 ? size : 1);
+	if (!memory) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+	free(memory);
+}
+
+// SDL's allocator as set up before counting, every call is passed on to it
+static SDL_malloc_func sdlMalloc;
+static SDL_calloc_func sdlCalloc;
+static SDL_realloc_func sdlRealloc;
+static SDL_free_func sdlFree;
+
+static void* SDLCALL countedMalloc(size_t size) {
+	allocations++;
+	return sdlMalloc(size);
+}
+
+static void* SDLCALL countedCalloc(size_t count, size_t size) {
+	allocations++;
+	return sdlCalloc(count, size);
+}
+
+static void* SDLCALL countedRealloc(void* memory, size_t size) {
+	allocations++;
+	return sdlRealloc(memory, size);
+}
+
+static void SDLCALL countedFree(void* memory) {
+	sdlFree(memory);
+}
+
+// Memory SDL already handed out is still freed by the allocator it came from
+static void countSdlAllocations() {
+	SDL_GetMemoryFunctions(&sdlMalloc, &sdlCalloc, &sdlRealloc, &sdlFree);
+	SDL_SetMemoryFunctions(countedMalloc, countedCalloc, countedRealloc, countedFree);
+}
+
+// One timed run of a case
+struct Sample {
+	uint64_t operations = 0;
+	uint64_t nanoseconds = 0;
+	uint64_t allocations = 0;
+	uint64_t bytesCopied = 0;
+
+	double nanosecondsPerOperation() const {
+		return operations > 0 ? (double)nanoseconds / operations : 0.0;
+	}
+};
+
+// Adds the time and allocations between begin() and end() to a sample
+struct Stopwatch {
+	uint64_t start = 0;
+	uint64_t startAllocations = 0;
+
+	void begin() {
+		startAllocations = allocations;
+		start = nowNanoseconds();
+	}
+
+	void end(Sample& sample) {
+		sample.nanoseconds += nowNanoseconds() - start;
+		sample.allocations += allocations - startAllocations;
+	}
+};
+
+static bool selected(const MicrobenchConfig& config, const std::string& name) {
+	return !config.filter || name.compare(0, strlen(config.filter), config.filter) == 0;
+}
+
+// One line of JSON for the case, extra holds further fields, each starting with a comma
+static void report(const MicrobenchConfig& config, const std::string& name, std::vector<Sample>& samples, bool copiesCounted,
+	const std::string& extra = "") {
+
+	if (samples.empty()) {
+		return;
+	}
+
+	std::sort(samples.begin(), samples.end(), [](const Sample& a, const Sample& b) {
+		return a.nanosecondsPerOperation() < b.nanosecondsPerOperation();
+	});
+	const Sample& median = samples[samples.size() / 2];
+	double operations = median.operations > 0 ? (double)median.operations : 1.0;
+
+	char copied[32];
+	if (copiesCounted) {
+		snprintf(copied, sizeof(copied), "%.1f", median.bytesCopied / operations);
+	} else {
+		snprintf(copied, sizeof(copied), "null");
+	}
+
+	fprintf(config.output, "{\"benchmark\":\"%s\",\"samples\":%d,\"operations\":%llu,\"ns_per_op\":%.1f,\"ns_per_op_min\":%.1f,"
+		"\"allocs_per_op\":%.3f,\"bytes_copied_per_op\":%s%s}\n",
+		name.c_str(), (int)samples.size(), (unsigned long long)median.operations, median.nanosecondsPerOperation(),
+		samples[0].nanosecondsPerOperation(), median.allocations / operations, copied, extra.c_str());
+	fflush(config.output);
+}
+
+// Completed frames go straight back, as if decoded at once
+static void releaseCompleted(FrameReassembler& reassembler, CompletedFrameQueue& completed) {
+	ReassemblySlot* slot;
+	while (completed.pop(slot)) {
+		reassembler.release(slot);
+	}
+}
+
+// v1 datagrams of a stream of keyframes and smaller frames between them, in arrival order
+//	Some are dropped and some swapped with the next one, at the given rates.
+struct IngestStream {
+	std::vector<UDPRecvPacket> datagrams;
+	std::vector<uint64_t> arrivals;
+
+	// Datagrams of the warm-up frames, at the front
+	size_t warmup = 0;
+};
+
+static void buildIngestStream(double loss, double reorder, IngestStream& stream) {
+	std::mt19937 sizes(1);
+	std::mt19937 network(2);
+	std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+	UDPRecvPacket packet;
+	packet.gameinfo = UDPRecvGameInfo();
+
+	for (int nframe = 0; nframe < INGEST_WARMUP_FRAMES + INGEST_FRAMES; nframe++) {
+		uint32_t framesize = nframe % CANNED_GOP == 0 ? 60000 : 12000 + sizes() % 12000;
+		uint32_t nfrags = (framesize + PACKET_SIZE - 1) / PACKET_SIZE;
+
+		if (nframe == INGEST_WARMUP_FRAMES) {
+			stream.warmup = stream.datagrams.size();
+		}
+
+		for (uint32_t nfrag = 0; nfrag < nfrags; nfrag++) {
+			packet.header.nframe = nframe;
+			packet.header.nfrag = nfrag;
+			packet.header.nfrags = nfrags;
+			packet.header.framesize = framesize;
+			memset(packet.packet, (int)(nframe + nfrag), sizeof(packet.packet));
+
+			uint64_t arrival = nframe * FRAME_INTERVAL + nfrag * 20;
+			if (chance(network) < loss) {
+				continue;
+			}
+
+			// Swapped with the one that follows, arrival times stay in order
+			size_t last = stream.datagrams.size();
+			stream.datagrams.push_back(packet);
+			stream.arrivals.push_back(arrival);
+			if (last > stream.warmup && chance(network) < reorder) {
+				std::swap(stream.datagrams[last], stream.datagrams[last - 1]);
+			}
+		}
+	}
+}
+
+// processPacket() and the jitter buffer, one datagram per operation
+//	Bytes copied are the frame data moved into reassembly slabs, which is all of
+//	it when datagrams aren't received in place.
+static bool benchmarkIngest(const MicrobenchConfig& config, int lossPercent, int reorderPercent) {
+	char name[64];
+	snprintf(name, sizeof(name), "ingest/loss%d/reorder%d", lossPercent, reorderPercent);
+	if (!selected(config, name)) {
+		return false;
+	}
+
+	IngestStream stream;
+	buildIngestStream(lossPercent / 100.0, reorderPercent / 100.0, stream);
+
+	std::vector<Sample> samples;
+	uint64_t dropped = 0;
+
+	for (int i = 0; i < config.samples; i++) {
+		FrameReassembler* reassembler = new FrameReassembler();
+		CompletedFrameQueue* completed = new CompletedFrameQueue();
+		QueueSignal* completedSignal = new QueueSignal();
+		FrameReceiver* receiver = new FrameReceiver(NULL, *reassembler, *completed, *completedSignal);
+
+		Sample sample;
+		Stopwatch stopwatch;
+		uint64_t frameBytes = 0;
+
+		for (size_t n = 0; n < stream.datagrams.size(); n++) {
+			if (n == stream.warmup) {
+				frameBytes = receiver->frameBytes;
+				stopwatch.begin();
+			}
+
+			receiver->ingest((const char*)&stream.datagrams[n], sizeof(UDPRecvPacket), stream.arrivals[n]);
+			releaseCompleted(*reassembler, *completed);
+		}
+
+		stopwatch.end(sample);
+		sample.operations = stream.datagrams.size() - stream.warmup;
+		sample.bytesCopied = receiver->frameBytes - frameBytes;
+		samples.push_back(sample);
+
+		dropped = receiver->jitterBuffer.droppedFrames;
+
+		delete receiver;
+		delete completedSignal;
+		delete completed;
+		delete reassembler;
+	}
+
+	std::string extra = ",\"frames_dropped\":" + std::to_string(dropped);
+	report(config, name, samples, true, extra);
+	return true;
+}
+
+// A moving gradient with a bar across it, like the stand-in server's pictures
+static void drawPicture(AVFrame* picture, int index) {
+	av_frame_make_writable(picture);
+
+	for (int y = 0; y < picture->height; y++) {
+		uint8_t* row = picture->data[0] + y * picture->linesize[0];
+		for (int x = 0; x < picture->width; x++) {
+			row[x] = (uint8_t)(x + y + index * 3);
+		}
+
+		int barX = (index * 8) % picture->width;
+		for (int x = barX; x < barX + 32 && x < picture->width; x++) {
+			row[x] = 235;
+		}
+	}
+
+	for (int y = 0; y < picture->height / 2; y++) {
+		memset(picture->data[1] + y * picture->linesize[1], 128 + (index % 64), picture->width / 2);
+		memset(picture->data[2] + y * picture->linesize[2], 128 - (index % 64), picture->width / 2);
+	}
+}
+
+// Encode the canned sequence once, the same on every run of the same libavcodec
+static bool encodeCannedFrames(int width, int height, std::vector<std::vector<uint8_t>>& frames) {
+	AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+	AVCodecContext* encoder = codec ? avcodec_alloc_context3(codec) : NULL;
+	if (!encoder) {
+		printf("No MPEG-4 encoder to make canned frames with\n");
+		return false;
+	}
+
+	encoder->width = width;
+	encoder->height = height;
+	encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+	encoder->time_base = { 1, 60 };
+	encoder->framerate = { 60, 1 };
+	encoder->bit_rate = 4000000;
+	encoder->gop_size = CANNED_GOP;
+	encoder->max_b_frames = 0;
+	encoder->thread_count = 1;
+
+	AVFrame* picture = av_frame_alloc();
+	AVPacket* encoded = av_packet_alloc();
+	if (avcodec_open2(encoder, codec, NULL) < 0 || !picture || !encoded) {
+		printf("Canned frames could not be encoded\n");
+		av_packet_free(&encoded);
+		av_frame_free(&picture);
+		avcodec_free_context(&encoder);
+		return false;
+	}
+
+	picture->format = AV_PIX_FMT_YUV420P;
+	picture->width = width;
+	picture->height = height;
+	bool allocated = av_frame_get_buffer(picture, 32) == 0;
+
+	for (int i = 0; allocated && i <= CANNED_FRAMES; i++) {
+		if (i < CANNED_FRAMES) {
+			drawPicture(picture, i);
+			picture->pts = i;
+		}
+		avcodec_send_frame(encoder, i < CANNED_FRAMES ? picture : NULL);
+
+		while (avcodec_receive_packet(encoder, encoded) == 0) {
+			frames.push_back(std::vector<uint8_t>(encoded->data, encoded->data + encoded->size));
+			av_packet_unref(encoded);
+		}
+	}
+
+	av_packet_free(&encoded);
+	av_frame_free(&picture);
+	avcodec_free_context(&encoder);
+
+	return (int)frames.size() == CANNED_FRAMES;
+}
+
+// Reassemble a canned frame into a slot, as v1 fragments of PACKET_SIZE
+static ReassemblySlot* reassemble(FrameReassembler& reassembler, const std::vector<uint8_t>& frame, uint32_t nframe, uint64_t now) {
+	UDPRecvHeader header;
+	header.nframe = nframe;
+	header.nfrags = (uint32_t)(frame.size() + PACKET_SIZE - 1) / PACKET_SIZE;
+	header.framesize = (uint32_t)frame.size();
+
+	ReassemblySlot* slot = NULL;
+	for (header.nfrag = 0; header.nfrag < header.nfrags; header.nfrag++) {
+		slot = reassembler.addFragment(header, PACKET_SIZE, UDPRecvGameInfo(), (const char*)frame.data() + header.nfrag * PACKET_SIZE, now);
+	}
+
+	return slot;
+}
+
+// decodeFrame() on the canned sequence, one frame per operation, the codec on one thread
+//	Frames are reassembled before timing starts. The codec reads the slab in place, so
+//	the receiver copies nothing.
+static bool benchmarkDecode(const MicrobenchConfig& config, int width, int height) {
+	char name[64];
+	snprintf(name, sizeof(name), "decode/mpeg4/%dx%d", width, height);
+	if (!selected(config, name)) {
+		return false;
+	}
+
+	std::vector<std::vector<uint8_t>> frames;
+	if (!encodeCannedFrames(width, height, frames)) {
+		return false;
+	}
+
+	FrameReassembler* reassembler = new FrameReassembler();
+	CompletedFrameQueue* completed = new CompletedFrameQueue();
+	QueueSignal* completedSignal = new QueueSignal();
+	FrameDecoder* decoder = new FrameDecoder(*reassembler, *completed, *completedSignal);
+
+	// The first pass warms the codec up instead
+	decoder->prewarm = false;
+	decoder->open(AV_CODEC_ID_MPEG4, width, height, 1, FF_THREAD_SLICE, false);
+
+	std::vector<Sample> samples;
+	uint32_t nframe = 0;
+
+	for (int i = -1; i < config.samples; i++) {
+		Sample sample;
+		Stopwatch stopwatch;
+
+		for (const std::vector<uint8_t>& frame : frames) {
+			ReassemblySlot* slot = reassemble(*reassembler, frame, nframe, nframe * FRAME_INTERVAL);
+			nframe++;
+			if (!slot || !completed->push(slot)) {
+				continue;
+			}
+
+			stopwatch.begin();
+			sample.operations += decoder->decodeAvailable();
+			stopwatch.end(sample);
+
+			DecodedFrame* decoded;
+			while (decoder->decoded.pop(decoded)) {
+				decoder->recycle(decoded);
+			}
+		}
+
+		if (i >= 0) {
+			samples.push_back(sample);
+		}
+	}
+
+	std::string extra = ",\"decode_errors\":" + std::to_string((unsigned long long)decoder->decodeErrors)
+		+ ",\"frames_discarded\":" + std::to_string((unsigned long long)decoder->discardedFrames);
+
+	delete decoder;
+	delete completedSignal;
+	delete completed;
+	delete reassembler;
+
+	report(config, name, samples, true, extra);
+	return true;
+}
+
+// A software renderer drawing into memory, NULL if there is none
+static SDL_Renderer* createSoftwareRenderer(int width, int height, SDL_Surface*& surface) {
+	surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+	SDL_Renderer* renderer = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+	if (!renderer) {
+		printf("Software renderer could not be created: %s\n", SDL_GetError());
+		if (surface) {
+			SDL_FreeSurface(surface);
+			surface = NULL;
+		}
+	}
+
+	return renderer;
+}
+
+// SDL_UpdateYUVTexture() into a software renderer's IYUV texture, as renderFrame() does
+//	The renderer keeps the planes as they are until the texture is copied, so the bytes
+//	copied are those of the three planes.
+static bool benchmarkUpload(const MicrobenchConfig& config, int width, int height) {
+	char name[64];
+	snprintf(name, sizeof(name), "upload/iyuv/%dx%d", width, height);
+	if (!selected(config, name)) {
+		return false;
+	}
+
+	SDL_Surface* surface;
+	SDL_Renderer* renderer = createSoftwareRenderer(width, height, surface);
+	if (!renderer) {
+		return false;
+	}
+
+	AVFrame* frame = av_frame_alloc();
+	frame->format = AV_PIX_FMT_YUV420P;
+	frame->width = width;
+	frame->height = height;
+	if (av_frame_get_buffer(frame, 0) < 0) {
+		printf("Picture could not be allocated\n");
+		av_frame_free(&frame);
+		SDL_DestroyRenderer(renderer);
+		SDL_FreeSurface(surface);
+		return false;
+	}
+	drawPicture(frame, 0);
+
+	SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, width, height);
+	uint64_t planeBytes = (uint64_t)width * height + 2 * (uint64_t)((width + 1) / 2) * ((height + 1) / 2);
+
+	std::vector<Sample> samples;
+	for (int i = -1; i < config.samples; i++) {
+		Sample sample;
+		Stopwatch stopwatch;
+
+		stopwatch.begin();
+		for (int n = 0; n < UPLOAD_OPERATIONS; n++) {
+			SDL_UpdateYUVTexture(texture, NULL, frame->data[0], frame->linesize[0], frame->data[1], frame->linesize[1],
+				frame->data[2], frame->linesize[2]);
+		}
+		stopwatch.end(sample);
+
+		sample.operations = UPLOAD_OPERATIONS;
+		sample.bytesCopied = planeBytes * UPLOAD_OPERATIONS;
+		if (i >= 0) {
+			samples.push_back(sample);
+		}
+	}
+
+	SDL_DestroyTexture(texture);
+	av_frame_free(&frame);
+	SDL_DestroyRenderer(renderer);
+	SDL_FreeSurface(surface);
+
+	report(config, name, samples, true);
+	return true;
+}
+
+// Stands in for the game and stats windows, the same on every call
+static void buildOverlay() {
+	ImGui::NewFrame();
+
+	ImGui::SetNextWindowPos(ImVec2(10, 10));
+	ImGui::SetNextWindowSize(ImVec2(300, 200));
+	ImGui::Begin("game", NULL, 0);
+	ImGui::Text("Reach the large cube as fast as you can");
+	ImGui::Text("Make sure to avoid the small cubes");
+	ImGui::Text("Move forward with [W]");
+	ImGui::Text("Turn with [A] [D]");
+	ImGui::TextColored(ImVec4(0.2f, 0.3f, 1, 1), "Time left: %4.1f", 42.0);
+	ImGui::End();
+
+	ImGui::SetNextWindowPos(ImVec2(370, 60));
+	ImGui::SetNextWindowSize(ImVec2(320, 375));
+	ImGui::Begin("stats", NULL, 0);
+
+	float latencies[120];
+	for (int i = 0; i < 120; i++) {
+		latencies[i] = 20.0f + (float)((i * 37) % 17);
+	}
+	ImGui::PlotLines("latency", latencies, 120, 0, NULL, 0.0f, 50.0f, ImVec2(0, 60));
+
+	ImGui::Columns(4, "stages", false);
+	for (int stage = 0; stage < 12; stage++) {
+		ImGui::Text("stage %d", stage);
+		ImGui::NextColumn();
+		ImGui::Text("%.2f", stage * 1.25);
+		ImGui::NextColumn();
+		ImGui::Text("%.2f", stage * 2.5);
+		ImGui::NextColumn();
+		ImGui::Text("%.2f", stage * 5.0);
+		ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+	ImGui::End();
+
+	ImGui::Render();
+}
+
+// ImGuiSDL::Render() of the overlay, both triangle caches emptied before every
+// operation when cold, the first draw left out of the timing when warm
+static bool benchmarkOverlay(const MicrobenchConfig& config, bool cold) {
+	std::string name = cold ? "overlay/cold" : "overlay/warm";
+	if (!selected(config, name)) {
+		return false;
+	}
+
+	const int WIDTH = 1280;
+	const int HEIGHT = 720;
+
+	SDL_Surface* surface;
+	SDL_Renderer* renderer = createSoftwareRenderer(WIDTH, HEIGHT, surface);
+	if (!renderer) {
+		return false;
+	}
+
+	ImGuiContext* context = ImGui::CreateContext();
+	ImGui::SetCurrentContext(context);
+	ImGui::GetIO().IniFilename = NULL;
+	ImGui::GetIO().DeltaTime = 1.0f / 60.0f;
+
+	ImGuiSDL::Initialize(renderer, WIDTH, HEIGHT);
+	ImGuiSDL::SetTriangleCacheCapacity(config.solidTriangleCache, config.texturedTriangleCache);
+
+	ImGuiSDL::TriangleCacheStats solid, textured;
+	ImGuiSDL::GetTriangleCacheStats(solid, textured);
+
+	buildOverlay();
+	ImDrawData* drawData = ImGui::GetDrawData();
+
+	std::vector<Sample> samples;
+	for (int i = -1; i < config.samples; i++) {
+		Sample sample;
+		Stopwatch stopwatch;
+
+		for (int n = 0; n < OVERLAY_OPERATIONS; n++) {
+			if (cold) {
+				ImGuiSDL::SetTriangleCacheCapacity(solid.Capacity, textured.Capacity);
+			}
+
+			stopwatch.begin();
+			ImGuiSDL::Render(drawData);
+			SDL_RenderFlush(renderer);
+			stopwatch.end(sample);
+		}
+
+		sample.operations = OVERLAY_OPERATIONS;
+		if (i >= 0) {
+			samples.push_back(sample);
+		}
+	}
+
+	ImGuiSDL::RenderStats stats;
+	ImGuiSDL::GetRenderStats(stats);
+	ImGuiSDL::TriangleCacheStats solidAfter, texturedAfter;
+	ImGuiSDL::GetTriangleCacheStats(solidAfter, texturedAfter);
+
+	double operations = (double)(config.samples + 1) * OVERLAY_OPERATIONS;
+	char extra[160];
+	snprintf(extra, sizeof(extra), ",\"draw_calls\":%d,\"primitives\":%d,\"cache_hits_per_op\":%.1f,\"cache_misses_per_op\":%.1f",
+		stats.DrawCalls, stats.Primitives,
+		(solidAfter.Hits - solid.Hits + texturedAfter.Hits - textured.Hits) / operations,
+		(solidAfter.Misses - solid.Misses + texturedAfter.Misses - textured.Misses) / operations);
+
+	ImGuiSDL::Deinitialize();
+	ImGui::DestroyContext(context);
+	SDL_DestroyRenderer(renderer);
+	SDL_FreeSurface(surface);
+
+	// Cached triangles are drawn by copying their pixels, which isn't counted
+	report(config, name, samples, false, extra);
+	return true;
+}
+
+// Run the cases selected, returns how many ran
+static int runMicrobenchmarks(const MicrobenchConfig& config) {
+	countSdlAllocations();
+
+	int cases = 0;
+
+	const int lossRates[] = { 0, 1, 5 };
+	const int reorderRates[] = { 0, 5 };
+	for (int loss : lossRates) {
+		for (int reorder : reorderRates) {
+			cases += benchmarkIngest(config, loss, reorder);
+		}
+	}
+
+	cases += benchmarkDecode(config, 1280, 720);
+	cases += benchmarkDecode(config, 1920, 1080);
+	cases += benchmarkUpload(config, 1280, 720);
+	cases += benchmarkUpload(config, 1920, 1080);
+	cases += benchmarkOverlay(config, true);
+	cases += benchmarkOverlay(config, false);
+
+	return cases;
+}
+
+// Options
+//	--filter <prefix>			only the cases whose name starts with it
+//	--samples <n>				timed runs of each case, the median is reported
+//	--out <path>				write the results there instead of to stdout
+//	--triangle-cache <solid>,<textured>	overlay triangles kept rasterized, 0 for the default
+int main(int argc, char* args[]) {
+	MicrobenchConfig config;
+	const char* path = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = args[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--filter" && hasValue) {
+			config.filter = args[++i];
+		} else if (arg == "--samples" && hasValue) {
+			config.samples = atoi(args[++i]);
+		} else if (arg == "--out" && hasValue) {
+			path = args[++i];
+		} else if (arg == "--triangle-cache" && hasValue) {
+			std::string sizes = args[++i];
+			config.solidTriangleCache = atoi(sizes.c_str());
+			config.texturedTriangleCache = sizes.find(',') != std::string::npos ? atoi(sizes.substr(sizes.find(',') + 1).c_str()) : 0;
+		} else {
+			printf("Unknown option: %s\n", arg.c_str());
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (config.samples < 1) {
+		config.samples = 1;
+	}
+
+	if (path) {
+		config.output = fopen(path, "w");
+		if (!config.output) {
+			printf("Could not open %s for writing\n", path);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (runMicrobenchmarks(config) == 0) {
+		printf("No microbenchmark matches %s\n", config.filter);
+	}
+
+	if (path) {
+		fclose(config.output);
+	}
+
+	return EXIT_SUCCESS;
+}
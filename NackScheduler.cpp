@@ -0,0 +1,86 @@
+#include "NackScheduler.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+NackScheduler::NackScheduler(const FrameReassembler& reassembler)
+	: reassembler(reassembler) {
+	nack.magic = NACK_MAGIC;
+}
+
+void NackScheduler::enable(SOCKET socket, const sockaddr_in& address) {
+	this->socket = socket;
+	this->address = address;
+	enabled = true;
+}
+
+void NackScheduler::poll(uint64_t now, uint64_t deadline) {
+	if (!enabled) {
+		return;
+	}
+
+	uint32_t newest = reassembler.newestFrame();
+
+	for (int i = 0; i < FrameReassembler::SLOT_COUNT; i++) {
+		const ReassemblySlot& slot = reassembler.slotAt(i);
+		if (slot.state.load(std::memory_order_acquire) != ReassemblySlot::FILLING || slot.abandoned.load(std::memory_order_relaxed)) {
+			continue;
+		}
+
+		// A new frame in this slot starts with a clean record
+		if (requestedFrame[i] != slot.nframe || lastRequest[i] < slot.firstArrival) {
+			requestedFrame[i] = slot.nframe;
+			requestCount[i] = 0;
+			lastRequest[i] = 0;
+		}
+
+		if (requestCount[i] >= maxRetries) {
+			continue;
+		}
+
+		// A resend couldn't arrive in time anymore
+		if (now + retryInterval > slot.firstArrival + deadline) {
+			continue;
+		}
+
+		uint64_t due = requestCount[i] == 0 ? slot.lastArrival + reorderGrace : lastRequest[i] + retryInterval;
+		if (now < due) {
+			continue;
+		}
+
+		// The server has moved on from older frames, so their tail is missing as well
+		uint32_t end = slot.nframe == newest ? slot.highestFragment : slot.nfrags;
+
+		int count = reassembler.missingFragments(slot, end, nack.nfrag, MAX_NACK_FRAGMENTS);
+		if (count == 0) {
+			continue;
+		}
+
+		nack.nframe = slot.nframe;
+		send(count);
+
+		requestCount[i]++;
+		lastRequest[i] = now;
+	}
+}
+
+void NackScheduler::send(int count) {
+	nack.count = count;
+
+	int ret = sendto(
+		socket,
+		(const char*)&nack,
+		offsetof(UDPNackPacket, nfrag) + count * sizeof(uint32_t),
+		0,
+		(const sockaddr*)&address,
+		sizeof(address)
+	);
+
+	if (ret < 0) {
+		printf("NACK send failed\n");
+		return;
+	}
+
+	nacksSent++;
+	fragmentsRequested += count;
+}
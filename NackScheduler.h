@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "Socket.h"
+
+#include "Protocol.h"
+#include "FrameReassembler.h"
+
+// Asks the server to resend fragments that went missing, while there's still time to use them
+//	A gap counts as lost once later fragments of the same frame arrived and no more
+//	showed up for reorderGrace, or once a newer frame started. Requests for a frame are
+//	repeated at most maxRetries times and stop when a resend couldn't make its deadline.
+//	Runs on the receive thread, which owns every slot that is still filling.
+class NackScheduler {
+public:
+	// How long a gap may stay open before it is taken for loss rather than reordering, in microseconds
+	uint64_t reorderGrace = 1000;
+
+	// Time between requests for the same frame, should be about one round trip, in microseconds
+	uint64_t retryInterval = 5000;
+
+	int maxRetries = 3;
+
+	// Requests sent and fragments asked for in them
+	std::atomic<uint64_t> nacksSent{ 0 };
+	std::atomic<uint64_t> fragmentsRequested{ 0 };
+
+	NackScheduler(const FrameReassembler& reassembler);
+
+	// Start sending requests to the given address, nothing is sent before
+	void enable(SOCKET socket, const sockaddr_in& address);
+
+	// Request whatever is missing, deadline is how long a frame may take after its first fragment
+	void poll(uint64_t now, uint64_t deadline);
+
+private:
+	const FrameReassembler& reassembler;
+
+	bool enabled = false;
+	SOCKET socket;
+	sockaddr_in address;
+
+	// Requests already made for the frame in each slot
+	uint32_t requestedFrame[FrameReassembler::SLOT_COUNT] = {};
+	int requestCount[FrameReassembler::SLOT_COUNT] = {};
+	uint64_t lastRequest[FrameReassembler::SLOT_COUNT] = {};
+
+	UDPNackPacket nack;
+
+	void send(int count);
+};
@@ -0,0 +1,238 @@
+#include "PacketCapture.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// How often the writer checks whether it should stop
+static const int WRITE_WAIT_MS = 100;
+
+CaptureWriter::~CaptureWriter() {
+	close();
+}
+
+bool CaptureWriter::open(const char* path) {
+#ifdef _MSC_VER
+	if (fopen_s(&file, path, "wb") != 0) {
+		file = NULL;
+	}
+#else
+	file = fopen(path, "wb");
+#endif
+
+	if (!file) {
+		return false;
+	}
+
+	CaptureFileHeader header = { CAPTURE_MAGIC, CAPTURE_VERSION };
+	fwrite(&header, sizeof(header), 1, file);
+
+	// All blocks are allocated up front, the receive thread never allocates
+	for (int i = 0; i < BLOCK_COUNT; i++) {
+		blocks[i].data = new char[BLOCK_SIZE];
+		blocks[i].size = 0;
+		freeBlocks.push(&blocks[i]);
+	}
+
+	running = true;
+	thread = std::thread(&CaptureWriter::writeLoop, this);
+	return true;
+}
+
+void CaptureWriter::close() {
+	if (!file) {
+		return;
+	}
+
+	if (current && current->size > 0) {
+		fullBlocks.push(current);
+		current = NULL;
+	}
+
+	running = false;
+	blockFilled.notify();
+	if (thread.joinable()) {
+		thread.join();
+	}
+
+	fclose(file);
+	file = NULL;
+
+	for (int i = 0; i < BLOCK_COUNT; i++) {
+		delete[] blocks[i].data;
+	}
+}
+
+bool CaptureWriter::isOpen() const {
+	return file != NULL;
+}
+
+void CaptureWriter::write(const char* header, int headerSize, const char* payload, int payloadSize, uint64_t now) {
+	if (!started) {
+		started = true;
+		lastTimestamp = now;
+	}
+
+	CaptureRecordHeader record;
+	record.delta = (uint32_t)(now - lastTimestamp);
+	record.length = (uint16_t)(headerSize + payloadSize);
+	int size = sizeof(record) + record.length;
+
+	// Hand over the block once the record doesn't fit anymore
+	if (current && current->size + size > BLOCK_SIZE) {
+		fullBlocks.push(current);
+		blockFilled.notify();
+		current = NULL;
+	}
+
+	if (!current && !freeBlocks.pop(current)) {
+		skippedPackets++;
+		return;
+	}
+
+	char* out = current->data + current->size;
+	memcpy(out, &record, sizeof(record));
+	memcpy(out + sizeof(record), header, headerSize);
+	memcpy(out + sizeof(record) + headerSize, payload, payloadSize);
+	current->size += size;
+
+	lastTimestamp = now;
+	recordedPackets++;
+}
+
+void CaptureWriter::writeLoop() {
+	while (running) {
+		blockFilled.wait(WRITE_WAIT_MS);
+		writeBlocks();
+	}
+
+	writeBlocks();
+	fflush(file);
+}
+
+void CaptureWriter::writeBlocks() {
+	Block* block;
+	while (fullBlocks.pop(block)) {
+		fwrite(block->data, 1, block->size, file);
+		block->size = 0;
+		freeBlocks.push(block);
+	}
+}
+
+CaptureReader::~CaptureReader() {
+	close();
+}
+
+bool CaptureReader::open(const char* path) {
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	size = (size_t)fileSize.QuadPart;
+
+	mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mappingHandle) {
+		close();
+		return false;
+	}
+
+	data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+	int file = ::open(path, O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+
+	struct stat info;
+	fstat(file, &info);
+	size = (size_t)info.st_size;
+
+	void* mapped = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+	::close(file);
+
+	if (mapped != MAP_FAILED) {
+		data = (const char*)mapped;
+		madvise(mapped, size, MADV_SEQUENTIAL);
+	}
+#endif
+
+	CaptureFileHeader header;
+	if (!data || size < sizeof(header)) {
+		close();
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+	if (header.magic != CAPTURE_MAGIC || header.version != CAPTURE_VERSION) {
+		close();
+		return false;
+	}
+
+	rewind();
+	return true;
+}
+
+void CaptureReader::close() {
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle) {
+		CloseHandle(mappingHandle);
+	}
+	if (fileHandle) {
+		CloseHandle(fileHandle);
+	}
+	mappingHandle = NULL;
+	fileHandle = NULL;
+#else
+	if (data) {
+		munmap((void*)data, size);
+	}
+#endif
+
+	data = NULL;
+	size = 0;
+}
+
+bool CaptureReader::next(CaptureRecord& record) {
+	CaptureRecordHeader header;
+	if (offset + sizeof(header) > size) {
+		return false;
+	}
+
+	memcpy(&header, data + offset, sizeof(header));
+
+	// A capture cut off while it was written ends at its last whole record
+	if (offset + sizeof(header) + header.length > size) {
+		return false;
+	}
+
+	timestamp += header.delta;
+
+	record.timestamp = timestamp;
+	record.data = data + offset + sizeof(header);
+	record.length = header.length;
+
+	offset += sizeof(header) + header.length;
+	return true;
+}
+
+void CaptureReader::rewind() {
+	offset = sizeof(CaptureFileHeader);
+	timestamp = 0;
+}
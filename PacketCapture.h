@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+
+#include "SPSCQueue.h"
+
+// Capture file layout
+//	A CaptureFileHeader, then one record per datagram: a CaptureRecordHeader
+//	followed by the datagram exactly as it was received. Records are packed
+//	without padding, values are little endian.
+const uint32_t CAPTURE_MAGIC = 0x43414743;
+const uint32_t CAPTURE_VERSION = 1;
+
+#pragma pack(push, 1)
+struct CaptureFileHeader {
+	uint32_t magic;
+	uint32_t version;
+};
+
+struct CaptureRecordHeader {
+	// Microseconds since the previous record was received
+	uint32_t delta;
+	uint16_t length;
+};
+#pragma pack(pop)
+
+// A datagram read back from a capture
+struct CaptureRecord {
+	// Microseconds since the first record was received
+	uint64_t timestamp;
+
+	// Points into the mapped file, not aligned
+	const char* data;
+	int length;
+};
+
+// Records received datagrams to a file without ever blocking the receive thread
+//	Records are gathered in blocks that a writer thread puts on disk. If the
+//	disk falls behind and no block is free, datagrams are left out of the capture.
+class CaptureWriter {
+public:
+	static const int BLOCK_SIZE = 1024 * 1024;
+	static const int BLOCK_COUNT = 8;
+
+	std::atomic<uint64_t> recordedPackets{ 0 };
+	std::atomic<uint64_t> skippedPackets{ 0 };
+
+	~CaptureWriter();
+
+	bool open(const char* path);
+
+	// Flush what is left, only once the receive thread stopped writing
+	void close();
+
+	bool isOpen() const;
+
+	// Add a datagram received in two parts, receive thread only
+	void write(const char* header, int headerSize, const char* payload, int payloadSize, uint64_t now);
+
+private:
+	struct Block {
+		char* data;
+		int size;
+	};
+
+	FILE* file = NULL;
+
+	Block blocks[BLOCK_COUNT];
+	SPSCQueue<Block*, BLOCK_COUNT> freeBlocks;
+	SPSCQueue<Block*, BLOCK_COUNT> fullBlocks;
+	QueueSignal blockFilled;
+
+	// Block being filled by the receive thread
+	Block* current = NULL;
+
+	bool started = false;
+	uint64_t lastTimestamp = 0;
+
+	std::thread thread;
+	std::atomic<bool> running{ false };
+
+	void writeLoop();
+	void writeBlocks();
+};
+
+// Reads a capture back from a memory mapped file
+class CaptureReader {
+public:
+	~CaptureReader();
+
+	bool open(const char* path);
+	void close();
+
+	// Next datagram, false at the end of the capture
+	bool next(CaptureRecord& record);
+
+	// Start over from the first record
+	void rewind();
+
+private:
+	const char* data = NULL;
+	size_t size = 0;
+	size_t offset = 0;
+	uint64_t timestamp = 0;
+
+#ifdef _WIN32
+	void* fileHandle = NULL;
+	void* mappingHandle = NULL;
+#endif
+};
@@ -0,0 +1,455 @@
+#include "PictureConverter.h"
+
+#include <string.h>
+
+#include <SDL.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <immintrin.h>
+	#define CONVERTER_SSE2
+	#define CONVERTER_AVX2
+
+	// Compiled for AVX2 without the rest of the build assuming it
+	#if defined(__GNUC__)
+		#define AVX2_FUNCTION __attribute__((target("avx2")))
+	#else
+		#define AVX2_FUNCTION
+	#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define CONVERTER_NEON
+#endif
+
+// BT.601 limited range in 6 bit fixed point, small enough for 16 bit lanes
+//	R = 1.164 (Y - 16) + 1.596 (V - 128)
+//	G = 1.164 (Y - 16) - 0.391 (U - 128) - 0.813 (V - 128)
+//	B = 1.164 (Y - 16) + 2.018 (U - 128)
+static const int LUMA_FACTOR = 75;
+static const int RED_V = 102;
+static const int GREEN_U = -25;
+static const int GREEN_V = -52;
+static const int BLUE_U = 129;
+
+// Blend weights are out of 128, so products of a byte stay within 16 bits
+static const int WEIGHT_BITS = 7;
+static const int WEIGHT_ONE = 1 << WEIGHT_BITS;
+
+static inline uint8_t clampByte(int value) {
+	return value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+}
+
+// The vector versions saturate where these would exceed 16 bits, which only
+//	happens for values clamped to 255 either way
+static void blendRowsScalar(const uint8_t* first, const uint8_t* second, int weight, uint8_t* out, int start, int count) {
+	int inverse = WEIGHT_ONE - weight;
+	for (int i = start; i < count; i++) {
+		out[i] = (uint8_t)((first[i] * inverse + second[i] * weight + WEIGHT_ONE / 2) >> WEIGHT_BITS);
+	}
+}
+
+static void convertRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* out, int start, int count) {
+	for (int i = start; i < count; i++) {
+		int luma = (y[i] - 16) * LUMA_FACTOR;
+		int blue = u[i] - 128;
+		int red = v[i] - 128;
+
+		out[i * 4 + 0] = clampByte((luma + RED_V * red + 32) >> 6);
+		out[i * 4 + 1] = clampByte((luma + GREEN_U * blue + GREEN_V * red + 32) >> 6);
+		out[i * 4 + 2] = clampByte((luma + BLUE_U * blue + 32) >> 6);
+		out[i * 4 + 3] = 255;
+	}
+}
+
+#ifdef CONVERTER_SSE2
+static void blendRowsSse2(const uint8_t* first, const uint8_t* second, int weight, uint8_t* out, int count) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i firstWeight = _mm_set1_epi16((short)(WEIGHT_ONE - weight));
+	const __m128i secondWeight = _mm_set1_epi16((short)weight);
+	const __m128i half = _mm_set1_epi16(WEIGHT_ONE / 2);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(first + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(second + i));
+
+		__m128i low = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), firstWeight), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), secondWeight));
+		__m128i high = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), firstWeight), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), secondWeight));
+		low = _mm_srli_epi16(_mm_add_epi16(low, half), WEIGHT_BITS);
+		high = _mm_srli_epi16(_mm_add_epi16(high, half), WEIGHT_BITS);
+
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(low, high));
+	}
+
+	blendRowsScalar(first, second, weight, out, i, count);
+}
+
+// Eight pixels in 16 bit lanes to red, green and blue, still 6 bit fixed point
+static inline void convertSse2(__m128i y, __m128i u, __m128i v, __m128i& red, __m128i& green, __m128i& blue) {
+	const __m128i round = _mm_set1_epi16(32);
+
+	__m128i luma = _mm_mullo_epi16(_mm_sub_epi16(y, _mm_set1_epi16(16)), _mm_set1_epi16(LUMA_FACTOR));
+	__m128i b = _mm_sub_epi16(u, _mm_set1_epi16(128));
+	__m128i r = _mm_sub_epi16(v, _mm_set1_epi16(128));
+
+	red = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(r, _mm_set1_epi16(RED_V))), round), 6);
+	green = _mm_adds_epi16(luma, _mm_mullo_epi16(b, _mm_set1_epi16(GREEN_U)));
+	green = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(green, _mm_mullo_epi16(r, _mm_set1_epi16(GREEN_V))), round), 6);
+	blue = _mm_srai_epi16(_mm_adds_epi16(_mm_adds_epi16(luma, _mm_mullo_epi16(b, _mm_set1_epi16(BLUE_U))), round), 6);
+}
+
+static void convertRowSse2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* out, int count) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alpha = _mm_set1_epi8((char)0xff);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		__m128i y8 = _mm_loadu_si128((const __m128i*)(y + i));
+		__m128i u8 = _mm_loadu_si128((const __m128i*)(u + i));
+		__m128i v8 = _mm_loadu_si128((const __m128i*)(v + i));
+
+		__m128i redLow, greenLow, blueLow, redHigh, greenHigh, blueHigh;
+		convertSse2(_mm_unpacklo_epi8(y8, zero), _mm_unpacklo_epi8(u8, zero), _mm_unpacklo_epi8(v8, zero), redLow, greenLow, blueLow);
+		convertSse2(_mm_unpackhi_epi8(y8, zero), _mm_unpackhi_epi8(u8, zero), _mm_unpackhi_epi8(v8, zero), redHigh, greenHigh, blueHigh);
+
+		__m128i red = _mm_packus_epi16(redLow, redHigh);
+		__m128i green = _mm_packus_epi16(greenLow, greenHigh);
+		__m128i blue = _mm_packus_epi16(blueLow, blueHigh);
+
+		// Interleave to R G B A bytes
+		__m128i redGreenLow = _mm_unpacklo_epi8(red, green);
+		__m128i redGreenHigh = _mm_unpackhi_epi8(red, green);
+		__m128i blueAlphaLow = _mm_unpacklo_epi8(blue, alpha);
+		__m128i blueAlphaHigh = _mm_unpackhi_epi8(blue, alpha);
+
+		__m128i* pixels = (__m128i*)(out + i * 4);
+		_mm_storeu_si128(pixels + 0, _mm_unpacklo_epi16(redGreenLow, blueAlphaLow));
+		_mm_storeu_si128(pixels + 1, _mm_unpackhi_epi16(redGreenLow, blueAlphaLow));
+		_mm_storeu_si128(pixels + 2, _mm_unpacklo_epi16(redGreenHigh, blueAlphaHigh));
+		_mm_storeu_si128(pixels + 3, _mm_unpackhi_epi16(redGreenHigh, blueAlphaHigh));
+	}
+
+	convertRowScalar(y, u, v, out, i, count);
+}
+#endif
+
+#ifdef CONVERTER_AVX2
+AVX2_FUNCTION static void blendRowsAvx2(const uint8_t* first, const uint8_t* second, int weight, uint8_t* out, int count) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i firstWeight = _mm256_set1_epi16((short)(WEIGHT_ONE - weight));
+	const __m256i secondWeight = _mm256_set1_epi16((short)weight);
+	const __m256i half = _mm256_set1_epi16(WEIGHT_ONE / 2);
+
+	int i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(first + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(second + i));
+
+		// Unpacking and packing both work within 128 bit lanes, so they undo each other
+		__m256i low = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(a, zero), firstWeight), _mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), secondWeight));
+		__m256i high = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(a, zero), firstWeight), _mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), secondWeight));
+		low = _mm256_srli_epi16(_mm256_add_epi16(low, half), WEIGHT_BITS);
+		high = _mm256_srli_epi16(_mm256_add_epi16(high, half), WEIGHT_BITS);
+
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_packus_epi16(low, high));
+	}
+
+	blendRowsScalar(first, second, weight, out, i, count);
+}
+
+AVX2_FUNCTION static inline void convertAvx2(__m256i y, __m256i u, __m256i v, __m256i& red, __m256i& green, __m256i& blue) {
+	const __m256i round = _mm256_set1_epi16(32);
+
+	__m256i luma = _mm256_mullo_epi16(_mm256_sub_epi16(y, _mm256_set1_epi16(16)), _mm256_set1_epi16(LUMA_FACTOR));
+	__m256i b = _mm256_sub_epi16(u, _mm256_set1_epi16(128));
+	__m256i r = _mm256_sub_epi16(v, _mm256_set1_epi16(128));
+
+	red = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(r, _mm256_set1_epi16(RED_V))), round), 6);
+	green = _mm256_adds_epi16(luma, _mm256_mullo_epi16(b, _mm256_set1_epi16(GREEN_U)));
+	green = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(green, _mm256_mullo_epi16(r, _mm256_set1_epi16(GREEN_V))), round), 6);
+	blue = _mm256_srai_epi16(_mm256_adds_epi16(_mm256_adds_epi16(luma, _mm256_mullo_epi16(b, _mm256_set1_epi16(BLUE_U))), round), 6);
+}
+
+AVX2_FUNCTION static void convertRowAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* out, int count) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alpha = _mm256_set1_epi8((char)0xff);
+
+	int i = 0;
+	for (; i + 32 <= count; i += 32) {
+		__m256i y8 = _mm256_loadu_si256((const __m256i*)(y + i));
+		__m256i u8 = _mm256_loadu_si256((const __m256i*)(u + i));
+		__m256i v8 = _mm256_loadu_si256((const __m256i*)(v + i));
+
+		__m256i redLow, greenLow, blueLow, redHigh, greenHigh, blueHigh;
+		convertAvx2(_mm256_unpacklo_epi8(y8, zero), _mm256_unpacklo_epi8(u8, zero), _mm256_unpacklo_epi8(v8, zero), redLow, greenLow, blueLow);
+		convertAvx2(_mm256_unpackhi_epi8(y8, zero), _mm256_unpackhi_epi8(u8, zero), _mm256_unpackhi_epi8(v8, zero), redHigh, greenHigh, blueHigh);
+
+		// Pixels 0-15 in the low lane and 16-31 in the high lane
+		__m256i red = _mm256_packus_epi16(redLow, redHigh);
+		__m256i green = _mm256_packus_epi16(greenLow, greenHigh);
+		__m256i blue = _mm256_packus_epi16(blueLow, blueHigh);
+
+		// Pixels 0-7 and 16-23, then 8-15 and 24-31
+		__m256i redGreenLow = _mm256_unpacklo_epi8(red, green);
+		__m256i redGreenHigh = _mm256_unpackhi_epi8(red, green);
+		__m256i blueAlphaLow = _mm256_unpacklo_epi8(blue, alpha);
+		__m256i blueAlphaHigh = _mm256_unpackhi_epi8(blue, alpha);
+
+		// Four pixels from each lane per register, put back in order across lanes
+		__m256i pixels0 = _mm256_unpacklo_epi16(redGreenLow, blueAlphaLow);
+		__m256i pixels4 = _mm256_unpackhi_epi16(redGreenLow, blueAlphaLow);
+		__m256i pixels8 = _mm256_unpacklo_epi16(redGreenHigh, blueAlphaHigh);
+		__m256i pixels12 = _mm256_unpackhi_epi16(redGreenHigh, blueAlphaHigh);
+
+		__m256i* pixels = (__m256i*)(out + i * 4);
+		_mm256_storeu_si256(pixels + 0, _mm256_permute2x128_si256(pixels0, pixels4, 0x20));
+		_mm256_storeu_si256(pixels + 1, _mm256_permute2x128_si256(pixels8, pixels12, 0x20));
+		_mm256_storeu_si256(pixels + 2, _mm256_permute2x128_si256(pixels0, pixels4, 0x31));
+		_mm256_storeu_si256(pixels + 3, _mm256_permute2x128_si256(pixels8, pixels12, 0x31));
+	}
+
+	convertRowScalar(y, u, v, out, i, count);
+}
+#endif
+
+#ifdef CONVERTER_NEON
+static void blendRowsNeon(const uint8_t* first, const uint8_t* second, int weight, uint8_t* out, int count) {
+	const uint8x8_t firstWeight = vdup_n_u8((uint8_t)(WEIGHT_ONE - weight));
+	const uint8x8_t secondWeight = vdup_n_u8((uint8_t)weight);
+
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		uint8x16_t a = vld1q_u8(first + i);
+		uint8x16_t b = vld1q_u8(second + i);
+
+		uint16x8_t low = vmlal_u8(vmull_u8(vget_low_u8(a), firstWeight), vget_low_u8(b), secondWeight);
+		uint16x8_t high = vmlal_u8(vmull_u8(vget_high_u8(a), firstWeight), vget_high_u8(b), secondWeight);
+
+		vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(low, WEIGHT_BITS), vrshrn_n_u16(high, WEIGHT_BITS)));
+	}
+
+	blendRowsScalar(first, second, weight, out, i, count);
+}
+
+static void convertRowNeon(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* out, int count) {
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		int16x8_t luma = vmulq_n_s16(vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y + i))), vdupq_n_s16(16)), LUMA_FACTOR);
+		int16x8_t b = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(u + i))), vdupq_n_s16(128));
+		int16x8_t r = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(v + i))), vdupq_n_s16(128));
+
+		int16x8_t red = vqaddq_s16(luma, vmulq_n_s16(r, RED_V));
+		int16x8_t green = vqaddq_s16(vqaddq_s16(luma, vmulq_n_s16(b, GREEN_U)), vmulq_n_s16(r, GREEN_V));
+		int16x8_t blue = vqaddq_s16(luma, vmulq_n_s16(b, BLUE_U));
+
+		uint8x8x4_t pixels;
+		pixels.val[0] = vqrshrun_n_s16(red, 6);
+		pixels.val[1] = vqrshrun_n_s16(green, 6);
+		pixels.val[2] = vqrshrun_n_s16(blue, 6);
+		pixels.val[3] = vdup_n_u8(255);
+		vst4_u8(out + i * 4, pixels);
+	}
+
+	convertRowScalar(y, u, v, out, i, count);
+}
+#endif
+
+static void blendRows(PictureConverter::InstructionSet set, const uint8_t* first, const uint8_t* second, int weight, uint8_t* out, int count) {
+	switch (set) {
+#ifdef CONVERTER_SSE2
+	case PictureConverter::SSE2:
+		blendRowsSse2(first, second, weight, out, count);
+		return;
+#endif
+#ifdef CONVERTER_AVX2
+	case PictureConverter::AVX2:
+		blendRowsAvx2(first, second, weight, out, count);
+		return;
+#endif
+#ifdef CONVERTER_NEON
+	case PictureConverter::NEON:
+		blendRowsNeon(first, second, weight, out, count);
+		return;
+#endif
+	default:
+		blendRowsScalar(first, second, weight, out, 0, count);
+	}
+}
+
+static void convertRow(PictureConverter::InstructionSet set, const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* out, int count) {
+	switch (set) {
+#ifdef CONVERTER_SSE2
+	case PictureConverter::SSE2:
+		convertRowSse2(y, u, v, out, count);
+		return;
+#endif
+#ifdef CONVERTER_AVX2
+	case PictureConverter::AVX2:
+		convertRowAvx2(y, u, v, out, count);
+		return;
+#endif
+#ifdef CONVERTER_NEON
+	case PictureConverter::NEON:
+		convertRowNeon(y, u, v, out, count);
+		return;
+#endif
+	default:
+		convertRowScalar(y, u, v, out, 0, count);
+	}
+}
+
+// Every output pixel gathers from its own columns, which vectors don't help with
+static void scaleRow(const uint8_t* in, const std::vector<PictureConverter::Sample>& columns, uint8_t* out) {
+	int count = (int)columns.size();
+	for (int i = 0; i < count; i++) {
+		const uint8_t* pixel = in + columns[i].index;
+		int weight = columns[i].weight;
+		out[i] = (uint8_t)((pixel[0] * (WEIGHT_ONE - weight) + pixel[1] * weight + WEIGHT_ONE / 2) >> WEIGHT_BITS);
+	}
+}
+
+// Where each of count outputs samples size inputs, both aligned on their centres
+static void sampleAxis(std::vector<PictureConverter::Sample>& samples, int count, int size) {
+	samples.resize(count);
+	for (int i = 0; i < count; i++) {
+		int64_t position = ((int64_t)(2 * i + 1) * size * 65536) / (2 * count) - 32768;
+		if (position < 0) {
+			position = 0;
+		}
+
+		int index = (int)(position >> 16);
+		int weight = (int)((position & 0xffff) >> (16 - WEIGHT_BITS));
+		if (index >= size - 1) {
+			index = size - 1;
+			weight = 0;
+		}
+
+		samples[i].index = index;
+		samples[i].weight = weight;
+	}
+}
+
+PictureConverter::PictureConverter() {
+	instructionSet = SCALAR;
+
+	const InstructionSet preferred[] = { AVX2, SSE2, NEON };
+	for (InstructionSet set : preferred) {
+		if (supported(set)) {
+			instructionSet = set;
+			break;
+		}
+	}
+}
+
+bool PictureConverter::supported(InstructionSet set) {
+	switch (set) {
+	case SCALAR:
+		return true;
+#ifdef CONVERTER_SSE2
+	case SSE2:
+		return SDL_HasSSE2() == SDL_TRUE;
+#endif
+#ifdef CONVERTER_AVX2
+	case AVX2:
+		return SDL_HasAVX2() == SDL_TRUE;
+#endif
+#ifdef CONVERTER_NEON
+	case NEON:
+		return SDL_HasNEON() == SDL_TRUE;
+#endif
+	default:
+		return false;
+	}
+}
+
+const char* PictureConverter::instructionSetName(InstructionSet set) {
+	switch (set) {
+	case SCALAR: return "scalar";
+	case SSE2: return "sse2";
+	case AVX2: return "avx2";
+	case NEON: return "neon";
+	}
+	return "unknown";
+}
+
+void PictureConverter::prepare(int pictureWidth, int pictureHeight, int width, int height) {
+	if (pictureWidth == this->pictureWidth && pictureHeight == this->pictureHeight && width == this->width && height == this->height) {
+		return;
+	}
+
+	this->pictureWidth = pictureWidth;
+	this->pictureHeight = pictureHeight;
+	this->width = width;
+	this->height = height;
+
+	int chromaWidth = (pictureWidth + 1) / 2;
+	int chromaHeight = (pictureHeight + 1) / 2;
+
+	sampleAxis(lumaColumns, width, pictureWidth);
+	sampleAxis(lumaRows, height, pictureHeight);
+	sampleAxis(chromaColumns, width, chromaWidth);
+	sampleAxis(chromaRows, height, chromaHeight);
+
+	blended[0].resize(pictureWidth + 1);
+	blended[1].resize(chromaWidth + 1);
+	blended[2].resize(chromaWidth + 1);
+	for (int plane = 0; plane < 3; plane++) {
+		scaled[plane].resize(width);
+	}
+}
+
+const uint8_t* PictureConverter::sourceRow(const uint8_t* plane, int pitch, int rows, int columns, const Sample& sample, std::vector<uint8_t>& buffer, bool padded) {
+	const uint8_t* first = plane + (size_t)sample.index * pitch;
+
+	if (sample.weight == 0) {
+		if (!padded) {
+			return first;
+		}
+
+		memcpy(buffer.data(), first, columns);
+	} else {
+		const uint8_t* second = first + (sample.index + 1 < rows ? pitch : 0);
+		blendRows(instructionSet, first, second, sample.weight, buffer.data(), columns);
+	}
+
+	// Column samples read one past the one they start at
+	buffer[columns] = buffer[columns - 1];
+	return buffer.data();
+}
+
+void PictureConverter::convert(const AVFrame* frame, uint8_t* pixels, int pitch, int width, int height) {
+	const uint8_t* const planes[3] = { frame->data[0], frame->data[1], frame->data[2] };
+	const int pitches[3] = { frame->linesize[0], frame->linesize[1], frame->linesize[2] };
+
+	convert(planes, pitches, frame->width, frame->height, pixels, pitch, width, height);
+}
+
+void PictureConverter::convert(const uint8_t* const planes[3], const int pitches[3], int pictureWidth, int pictureHeight,
+	uint8_t* pixels, int pitch, int width, int height) {
+
+	if (pictureWidth < 1 || pictureHeight < 1 || width < 1 || height < 1) {
+		return;
+	}
+
+	prepare(pictureWidth, pictureHeight, width, height);
+
+	int chromaWidth = (pictureWidth + 1) / 2;
+	int chromaHeight = (pictureHeight + 1) / 2;
+
+	// Luma only needs scaling across when the sizes differ, chroma always does
+	bool scaleLuma = pictureWidth != width;
+
+	for (int row = 0; row < height; row++) {
+		const uint8_t* y = sourceRow(planes[0], pitches[0], pictureHeight, pictureWidth, lumaRows[row], blended[0], scaleLuma);
+		const uint8_t* u = sourceRow(planes[1], pitches[1], chromaHeight, chromaWidth, chromaRows[row], blended[1], true);
+		const uint8_t* v = sourceRow(planes[2], pitches[2], chromaHeight, chromaWidth, chromaRows[row], blended[2], true);
+
+		if (scaleLuma) {
+			scaleRow(y, lumaColumns, scaled[0].data());
+			y = scaled[0].data();
+		}
+		scaleRow(u, chromaColumns, scaled[1].data());
+		scaleRow(v, chromaColumns, scaled[2].data());
+
+		convertRow(instructionSet, y, scaled[1].data(), scaled[2].data(), pixels + (size_t)row * pitch, width);
+	}
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+extern "C" {
+	#include "libavutil/frame.h"
+}
+
+// Converts YUV 4:2:0 pictures to RGBA32 at any size, scaling bilinearly on the way
+//	For renderers that can't take IYUV textures, or convert them slowly in generic
+//	code like the software renderer. Rows are blended and converted with the widest
+//	vector instructions the CPU has, every instruction set gives the same pixels.
+class PictureConverter {
+public:
+	enum InstructionSet {
+		SCALAR,
+		SSE2,
+		AVX2,
+		NEON
+	};
+
+	// Where an output row or column samples the picture, the first of two source
+	//	rows or columns and how much of the second to blend in, out of 128
+	struct Sample {
+		int index;
+		int weight;
+	};
+
+	// The best one this build and CPU support, unless changed
+	InstructionSet instructionSet;
+
+	PictureConverter();
+
+	// Whether this build and CPU can use the instruction set
+	static bool supported(InstructionSet set);
+	static const char* instructionSetName(InstructionSet set);
+
+	// Convert the picture into pixels of the given size, BT.601 limited range as SDL's IYUV textures
+	void convert(const AVFrame* frame, uint8_t* pixels, int pitch, int width, int height);
+	void convert(const uint8_t* const planes[3], const int pitches[3], int pictureWidth, int pictureHeight,
+		uint8_t* pixels, int pitch, int width, int height);
+
+private:
+	// Sizes the samples were worked out for
+	int pictureWidth = 0;
+	int pictureHeight = 0;
+	int width = 0;
+	int height = 0;
+
+	std::vector<Sample> lumaColumns;
+	std::vector<Sample> lumaRows;
+	std::vector<Sample> chromaColumns;
+	std::vector<Sample> chromaRows;
+
+	// A source row blended between two, one byte longer to repeat the last pixel
+	std::vector<uint8_t> blended[3];
+
+	// Rows scaled to the output width
+	std::vector<uint8_t> scaled[3];
+
+	void prepare(int pictureWidth, int pictureHeight, int width, int height);
+
+	// Source row at the sample, blended into the buffer unless it can be used as is
+	const uint8_t* sourceRow(const uint8_t* plane, int pitch, int rows, int columns, const Sample& sample, std::vector<uint8_t>& buffer, bool padded);
+};
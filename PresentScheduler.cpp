@@ -0,0 +1,133 @@
+#include "PresentScheduler.h"
+
+#include <math.h>
+
+// How early a present is started when it will block until the display refreshes
+static const uint64_t VSYNC_MARGIN = 2000;
+
+PresentScheduler::PresentScheduler(FrameDecoder& decoder)
+	: decoder(decoder) {
+}
+
+const char* PresentScheduler::policyName(Policy policy) {
+	switch (policy) {
+	case LATENCY: return "latency";
+	case SMOOTH: return "smooth";
+	case FIXED: return "fixed";
+	}
+	return "unknown";
+}
+
+void PresentScheduler::collect() {
+	DecodedFrame* picture;
+	while (decoder.decoded.pop(picture)) {
+		if (backlogCount == BACKLOG_SIZE) {
+			dropOldest();
+		}
+
+		backlog[backlogCount++] = picture;
+	}
+}
+
+bool PresentScheduler::due(uint64_t now, DecodedFrame*& picture) {
+	picture = NULL;
+
+	uint64_t next = lastPresent + interval;
+	if (vsync) {
+		next -= VSYNC_MARGIN;
+	}
+	bool tick = now >= next;
+
+	switch (policy) {
+	case LATENCY:
+
+		// Don't wait for the tick with something new to show
+		if (backlogCount > 0) {
+			picture = takeNewest();
+			return true;
+		}
+		return tick;
+
+	case SMOOTH:
+		if (!tick) {
+			return false;
+		}
+
+		// Fell behind by more than a picture, catch up
+		while (backlogCount > 2) {
+			dropOldest();
+		}
+
+		picture = takeOldest();
+		return true;
+
+	case FIXED:
+		if (!tick) {
+			return false;
+		}
+
+		picture = takeNewest();
+		return true;
+	}
+
+	return false;
+}
+
+void PresentScheduler::presented(uint64_t now, bool newPicture) {
+	lastPresent = now;
+
+	if (!newPicture) {
+		redraws++;
+		return;
+	}
+
+	presentedFrames++;
+
+	if (lastPicturePresent != 0) {
+		uint64_t elapsed = now - lastPicturePresent;
+		presentIntervals.record(elapsed);
+
+		// Against the average so far, which settles on the stream's cadence
+		if (intervalCount > 0) {
+			judder.record((uint64_t)fabs((double)elapsed - intervalMean));
+		}
+
+		intervalCount++;
+		double delta = (double)elapsed - intervalMean;
+		intervalMean += delta / intervalCount;
+		intervalSquares += delta * ((double)elapsed - intervalMean);
+	}
+
+	lastPicturePresent = now;
+}
+
+double PresentScheduler::intervalDeviation() const {
+	return intervalCount > 1 ? sqrt(intervalSquares / (intervalCount - 1)) : 0.0;
+}
+
+void PresentScheduler::dropOldest() {
+	decoder.recycle(takeOldest());
+	supersededFrames++;
+}
+
+DecodedFrame* PresentScheduler::takeOldest() {
+	if (backlogCount == 0) {
+		return NULL;
+	}
+
+	DecodedFrame* picture = backlog[0];
+	backlogCount--;
+	for (int i = 0; i < backlogCount; i++) {
+		backlog[i] = backlog[i + 1];
+	}
+
+	return picture;
+}
+
+DecodedFrame* PresentScheduler::takeNewest() {
+	while (backlogCount > 1) {
+		dropOldest();
+	}
+
+	return takeOldest();
+}
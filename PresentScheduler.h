@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "FrameDecoder.h"
+#include "LatencyStats.h"
+
+// Decides when the render thread presents, and which decoded picture it shows
+//	Presents happen at least once per interval even without new pictures, so the
+//	overlay keeps updating. Pictures that are passed over go back to the decoder.
+class PresentScheduler {
+public:
+	enum Policy {
+		LATENCY,	// Present a new picture as soon as it is decoded, the newest one wins
+		SMOOTH,		// One picture per interval, in order, dropping only a backlog beyond two
+		FIXED		// The newest picture once per interval
+	};
+
+	Policy policy = LATENCY;
+
+	// Time between presents, the display refresh or a fixed rate, in microseconds
+	uint64_t interval = 16667;
+
+	// Presents block until the display refreshes, so they are started a little early
+	bool vsync = false;
+
+	// Presents with a new picture, presents that only redrew the overlay, and pictures never shown
+	std::atomic<uint64_t> presentedFrames{ 0 };
+	std::atomic<uint64_t> redraws{ 0 };
+	std::atomic<uint64_t> supersededFrames{ 0 };
+
+	// Time between presents of new pictures, and how far each strays from the average
+	LatencyHistogram presentIntervals;
+	LatencyHistogram judder;
+
+	PresentScheduler(FrameDecoder& decoder);
+
+	// Take the pictures the decoder has finished, render thread only
+	void collect();
+
+	// Whether to present now, with the picture to show or NULL to redraw the last one
+	bool due(uint64_t now, DecodedFrame*& picture);
+
+	// A present finished at now
+	void presented(uint64_t now, bool newPicture);
+
+	// Standard deviation of the time between presents of new pictures, in microseconds
+	double intervalDeviation() const;
+
+	static const char* policyName(Policy policy);
+
+private:
+	static const int BACKLOG_SIZE = 4;
+
+	FrameDecoder& decoder;
+
+	// Decoded pictures waiting to be shown, oldest first
+	DecodedFrame* backlog[BACKLOG_SIZE];
+	int backlogCount = 0;
+
+	uint64_t lastPresent = 0;
+	uint64_t lastPicturePresent = 0;
+
+	// Running mean and sum of squared deviations of the intervals
+	uint64_t intervalCount = 0;
+	double intervalMean = 0.0;
+	double intervalSquares = 0.0;
+
+	// Give the oldest waiting picture back unseen
+	void dropOldest();
+	DecodedFrame* takeOldest();
+	DecodedFrame* takeNewest();
+};
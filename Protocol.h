@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Wire format of the video stream sent by the game server
+
+const int PACKET_SIZE = 1400;
+
+// Packet definition
+struct UDPRecvHeader {
+	uint32_t nframe;
+	uint32_t nfrag;
+
+	uint32_t nfrags;
+	uint32_t framesize;
+};
+
+struct UDPRecvGameInfo {
+	float currentTime;
+	bool prestart;
+	bool won;
+	bool lost;
+};
+
+// Forward error correction
+//	A parity fragment has FEC_PARITY_FLAG set in nfrag. The rest of nfrag then holds the
+//	group it protects in the low 16 bits and the group size in bits 16 to 30. Its payload
+//	is the XOR of the payloads of fragments group * size up to (group + 1) * size, the
+//	short last fragment counted as if zero padded to PACKET_SIZE, or to the fragment size
+//	in v2. Data fragments are unchanged, so a stream without parity fragments is sent
+//	exactly as before.
+const uint32_t FEC_PARITY_FLAG = 0x80000000;
+
+inline bool isParityFragment(const UDPRecvHeader& header) {
+	return (header.nfrag & FEC_PARITY_FLAG) != 0;
+}
+
+inline uint32_t parityGroup(const UDPRecvHeader& header) {
+	return header.nfrag & 0xFFFF;
+}
+
+inline uint32_t parityGroupSize(const UDPRecvHeader& header) {
+	return (header.nfrag & ~FEC_PARITY_FLAG) >> 16;
+}
+
+inline uint32_t parityFragmentIndex(uint32_t group, uint32_t groupSize) {
+	return FEC_PARITY_FLAG | (groupSize << 16) | group;
+}
+
+struct UDPRecvPacket {
+	UDPRecvHeader header;
+	UDPRecvGameInfo gameinfo;
+	char packet[PACKET_SIZE] = {0};
+};
+
+// Bytes in front of the payload of every datagram
+const int UDP_RECV_HEADER_SIZE = offsetof(UDPRecvPacket, packet);
+
+// Version 2
+//	Datagrams start with a compact header and carry no game state, that is sent in
+//	datagrams of its own whenever it changes. Payloads are sized to the path MTU and
+//	not padded, the last fragment of a frame only holds what is left of it. The header
+//	may carry a CRC32C of itself and the payload. v1 datagrams are always exactly
+//	sizeof(UDPRecvPacket) long and v2 ones never are, which tells the two apart.
+const uint8_t PROTOCOL_V2 = 0xA2;
+
+// Flags of a v2 header
+const uint8_t V2_FLAG_PARITY = 0x01;	// Parity fragment, nfrag holds the group in its low byte and the group size in its high byte
+const uint8_t V2_FLAG_CHECKSUM = 0x02;	// The checksum field is set
+const uint8_t V2_FLAG_STATE = 0x04;	// Payload is the UDPRecvGameInfo of frames from nframe on, maybe followed by a UDPRecvInputEcho
+
+struct UDPRecvHeaderV2 {
+	uint8_t version;
+	uint8_t flags;
+
+	// Lets several streams share a port
+	uint16_t stream;
+
+	uint32_t nframe;
+	uint16_t nfrag;
+	uint16_t nfrags;
+
+	// Frame size in the low 24 bits, payload of every fragment but the last in units of 8 bytes in the high 8
+	uint32_t sizes;
+
+	// CRC32C of the header, this field taken as 0, followed by the payload
+	//	In the header rather than after the payload, so a payload received straight
+	//	into its place in a frame never runs into the next one
+	uint32_t checksum;
+};
+
+const int UDP_RECV_HEADER_V2_SIZE = sizeof(UDPRecvHeaderV2);
+
+// IPv4 and UDP headers in front of every datagram
+const int IP_UDP_OVERHEAD = 28;
+
+// Smallest MTU every IPv4 path has to carry
+const int MIN_MTU = 576;
+
+inline uint32_t packFragmentSizes(uint32_t framesize, uint32_t fragmentSize) {
+	return (framesize & 0xFFFFFF) | (fragmentSize / 8) << 24;
+}
+
+// Bytes in front of the payload of a datagram of the given length, whichever version it is
+inline int datagramHeaderSize(int length) {
+	return length == (int)sizeof(UDPRecvPacket) ? UDP_RECV_HEADER_SIZE : UDP_RECV_HEADER_V2_SIZE;
+}
+
+// Largest v2 fragment payload that fits the MTU, a multiple of 8 and never more than PACKET_SIZE
+inline int fragmentSizeForMtu(int mtu) {
+	if (mtu < MIN_MTU) {
+		mtu = MIN_MTU;
+	}
+
+	int size = (mtu - IP_UDP_OVERHEAD - UDP_RECV_HEADER_V2_SIZE) / 8 * 8;
+	return size < PACKET_SIZE ? size : PACKET_SIZE;
+}
+
+// Retransmission request, sent to the server on the input back-channel
+//	The magic value can't be mistaken for the keycodes a UDPInputPacket starts with.
+//	Only the first count entries of nfrag are sent.
+const uint32_t NACK_MAGIC = 0x4B43414E;
+const int MAX_NACK_FRAGMENTS = 64;
+
+struct UDPNackPacket {
+	uint32_t magic;
+	uint32_t nframe;
+	uint32_t count;
+	uint32_t nfrag[MAX_NACK_FRAGMENTS];
+};
+
+// Keyframe request, sent to the server on the input back-channel
+//	The client has nothing to decode the next frames against, at its start or after
+//	a frame was lost, and asks for the next frame to be a keyframe. nframe is the
+//	newest frame the client has seen. Like NACK_MAGIC the magic value is no keycode.
+const uint32_t KEYFRAME_MAGIC = 0x4659454B;
+
+struct UDPKeyframeRequest {
+	uint32_t magic;
+	uint32_t nframe;
+};
+
+// Input changes, sent to the server on the input back-channel instead of UDPInputPacket
+//	Every key change gets the next sequence number and the client time it happened
+//	at. A datagram carries the changes not yet repeated often enough, oldest first, so
+//	a change survives the loss of all but one of the datagrams it went out in. One
+//	without changes tells the server the client is alive and which change is newest.
+//	Only the first count entries of events are sent. Like NACK_MAGIC the magic value
+//	is no keycode.
+const uint32_t INPUT_MAGIC = 0x54504E49;
+const int MAX_INPUT_EVENTS = 16;
+
+struct UDPInputEvent {
+	uint32_t seq;
+
+	// Client clock in microseconds, wraps around
+	uint32_t time;
+
+	int32_t keycode;
+	uint32_t down;
+};
+
+struct UDPInputEventPacket {
+	uint32_t magic;
+
+	// Newest sequence number given out, 0 before the first change
+	uint32_t newest;
+
+	uint32_t count;
+	UDPInputEvent events[MAX_INPUT_EVENTS];
+};
+
+// Sent after the UDPRecvGameInfo in v2 state datagrams by servers taking input changes
+//	Newest input change the server had applied when it rendered the frames from nframe
+//	on, so the client can tell how long its input took to show
+struct UDPRecvInputEcho {
+	uint32_t seq;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+
+// Bounded lock-free queue for exactly one producer and one consumer thread
+template <typename T, uint32_t Capacity>
+class SPSCQueue {
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+	// Producer side, fails if the queue is full
+	bool push(const T& item) {
+		uint32_t tail = tailIndex.load(std::memory_order_relaxed);
+		if (tail - headIndex.load(std::memory_order_acquire) == Capacity) {
+			return false;
+		}
+
+		items[tail & (Capacity - 1)] = item;
+		tailIndex.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, fails if the queue is empty
+	bool pop(T& item) {
+		uint32_t head = headIndex.load(std::memory_order_relaxed);
+		if (head == tailIndex.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		item = items[head & (Capacity - 1)];
+		headIndex.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const {
+		return headIndex.load(std::memory_order_acquire) == tailIndex.load(std::memory_order_acquire);
+	}
+
+private:
+	// Keep both ends on their own cache line so producer and consumer don't contend
+	alignas(64) std::atomic<uint32_t> headIndex{ 0 };
+	alignas(64) std::atomic<uint32_t> tailIndex{ 0 };
+	alignas(64) T items[Capacity];
+};
+
+// Lets the consumer of a queue sleep until the producer pushed something
+//	The queue itself stays lock-free, only the wake-up takes a lock.
+class QueueSignal {
+public:
+	// Called on every notify instead of waking the consumer, for consumers run on a pool
+	//	Set before the producer starts.
+	std::function<void()> onNotify;
+
+	void notify() {
+		if (onNotify) {
+			onNotify();
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending = true;
+		}
+		condition.notify_one();
+	}
+
+	// Returns false if nothing was signalled within the timeout
+	bool wait(int timeoutMs) {
+		std::unique_lock<std::mutex> lock(mutex);
+		bool signalled = condition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return pending; });
+		pending = false;
+		return signalled;
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool pending = false;
+};
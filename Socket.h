@@ -0,0 +1,44 @@
+#pragma once
+
+// Just enough to use the same socket code with Winsock and BSD sockets
+#ifdef _WIN32
+#include "winsock.h"
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+
+#define INVALID_SOCKET (-1)
+#endif
+
+// Start up the socket library, safe to call more than once
+inline bool initSockets() {
+#ifdef _WIN32
+	WSADATA wsaData;
+	return WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+#else
+	return true;
+#endif
+}
+
+// Error code of the last failed socket call
+inline int socketError() {
+#ifdef _WIN32
+	return WSAGetLastError();
+#else
+	return errno;
+#endif
+}
+
+inline void closeSocket(SOCKET socket) {
+#ifdef _WIN32
+	closesocket(socket);
+#else
+	close(socket);
+#endif
+}
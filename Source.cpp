@@ -1,9 +1,12 @@
-#include "winsock.h"
+#include "Socket.h"
 #include <stdio.h>
+#include <string.h>
 #include <string>
+#include <atomic>
+#include <chrono>
 #include <iostream>
-#include <map>
 #include <thread>
+#include <vector>
 
 // For decoding
 extern "C" {
@@ -17,64 +20,135 @@ extern "C" {
 #include "external/imgui/imgui.h"
 #include "external/imgui_sdl.h"
 
-const int PACKET_SIZE = 1400;
-
-// Packet definition
-struct UDPRecvHeader {
-	uint32_t nframe;
-	uint32_t nfrag;
-
-	uint32_t nfrags;
-	uint32_t framesize;
-};
-
-struct UDPRecvGameInfo {
-	float currentTime;
-	bool prestart;
-	bool won;
-	bool lost;
-};
-
-struct UDPRecvPacket {
-	UDPRecvHeader header;
-	UDPRecvGameInfo gameinfo;
-	char packet[PACKET_SIZE] = {0};
-};
-
-// Reassembled frames
-std::map<int, char*> frameMap;
-std::map<int, int> fragsReceived;
-std::map<int, int> frameSize;
-
-UDPRecvGameInfo latestGameInfo;
+#include "Protocol.h"
+#include "FrameReassembler.h"
+#include "FrameReceiver.h"
+#include "Transport.h"
+#include "FrameDecoder.h"
+#include "TexturePool.h"
+#include "PresentScheduler.h"
+#include "PictureConverter.h"
+#include "LoopbackServer.h"
+#include "LatencyStats.h"
+#include "PacketCapture.h"
+#include "StreamSession.h"
+#include "WorkerPool.h"
+#include "InputChannel.h"
+#include "Clock.h"
+
+// Every stream shown, from its socket to its pictures
+//	The first one is the game being played, it gets the input and the game overlay.
+//	Further streams of a mosaic are only watched.
+std::vector<StreamSession*> sessions;
+StreamSession* session;
+
+// Streams shown side by side, arriving on consecutive ports and decoded on a shared pool
+const int MAX_STREAMS = 16;
+int streamCount = 1;
+WorkerPool decodePool;
+int poolThreadCount = 0;
+
+// How the receive thread takes datagrams from the socket
+TransportConfig transportConfig;
+
+// How long a frame may wait for missing fragments before it is dropped
+int jitterLatencyMs = 30;
+
+// Ask the server to resend lost fragments, off as the game server doesn't understand it yet
+bool requestRetransmits = false;
+
+// Ask the server for a keyframe when there is nothing to decode against, off for the same reason
+//	unless the stand-in server runs. Without a keyframe on its way, frames are decoded
+//	against whatever the codec still has.
+bool requestKeyframes = false;
+bool keyframeRequestsOff = false;
+
+// Warm decoders up before the stream arrives, off to measure a cold start
+bool prewarmDecoders = true;
+
+// Stream taken from servers speaking protocol v2
+uint16_t streamId = 0;
+
+// Show latency and loss next to the game window
+bool showStats = false;
+const char* statsCsvPath = NULL;
 
 // Static frame information
 const int FRAME_WIDTH = 1280;
 const int FRAME_HEIGHT = 720;
 const AVPixelFormat FRAME_FORMAT = AV_PIX_FMT_YUV420P;
 
-// Codec
-const AVCodecID CODEC_ID = AV_CODEC_ID_MPEG4;
-AVCodec* codec;
-AVCodecContext* codecContext;
+// Codec, set from the command line
+AVCodecID codecId = AV_CODEC_ID_MPEG4;
 
-// Receive Socket
-u_long UDP_RECEIVE_ADDRESS = INADDR_ANY;
-u_short UDP_RECEIVE_PORT = 8888;
+// Decode frames while their fragments are still arriving, H.264 only
+bool progressiveDecode = false;
 
-sockaddr_in UDPRecvAddress;
-SOCKET UDPRecvSocket;
+// Codec threading, set from the command line
+//	Frame threading adds a frame of delay per thread, slice threading does not, so
+//	it is only used when asked for. Codecs without slice threads, like MPEG-4 part 2,
+//	then decode on one thread.
+int decodeThreadCount = 0;
+int decodeThreadType = FF_THREAD_SLICE;
 
-byte UDPRecvBuffer[PACKET_SIZE + sizeof(UDPRecvHeader)];
-int UDP_RECEIVE_ADDRESS_LENGTH = sizeof(UDPRecvAddress);
+// Receive Socket, further streams arrive on the ports after it
+u_long UDP_RECEIVE_ADDRESS = INADDR_ANY;
+u_short UDP_RECEIVE_PORT = 8888;
 
 // SDL
 SDL_Texture* sdlTexture;
+int textureWidth = FRAME_WIDTH;
+int textureHeight = FRAME_HEIGHT;
+Uint32 rendererFlags = SDL_RENDERER_ACCELERATED;
+
+// Textures the decoder writes into directly, 0 to copy every picture into sdlTexture
+TexturePool texturePool;
+int directTextureCount = TexturePool::MAX_TEXTURES;
+
+// When each stream presents and which picture, set from the command line
+//	A present rate of 0 follows the display's refresh rate
+PresentScheduler::Policy presentPolicy = PresentScheduler::LATENCY;
+int presentRate = 0;
+
+// Last picture presented, drawn again when the overlay changes without a new one
+SDL_Texture* shownTexture = NULL;
+SDL_Rect shownSource;
+
+// Size of the window, the picture is fitted into it keeping its shape
+int windowWidth = FRAME_WIDTH;
+int windowHeight = FRAME_HEIGHT;
+bool resizableWindow = false;
+
+// Where pictures become RGB, the renderer by default and here for renderers that
+//	take IYUV textures slowly or not at all. Converted pictures are already scaled.
+enum ConvertMode {
+	CONVERT_AUTO,
+	CONVERT_RENDERER,
+	CONVERT_CPU
+};
+ConvertMode convertMode = CONVERT_AUTO;
+bool cpuConversion = false;
+PictureConverter pictureConverter;
+SDL_Texture* rgbaTexture = NULL;
+int rgbaWidth = 0;
+int rgbaHeight = 0;
+
+// Time both ways of converting pictures, then exit
+bool conversionBenchmark = false;
 SDL_Window* sdlWindow;
 SDL_Renderer* sdlRenderer;
 
 ImGuiContext* imGuiContext;
 
+// Keep the overlay in a layer that is redrawn only when it changes, and how often it was
+bool cacheOverlay = true;
+uint64_t overlayRedraws = 0;
+uint64_t overlayReuses = 0;
+
+// Triangles the overlay keeps rasterized, solid and textured, 0 for the defaults
+int solidTriangleCache = 0;
+int texturedTriangleCache = 0;
+
 //
 struct UDPInputPacket {
 	SDL_Keycode down[8];
@@ -89,50 +163,125 @@ SOCKET UDPSendSocket;
 const char* UDP_SEND_ADDRESS = "127.0.0.1";
 const int UDP_SEND_PORT = 8880;
 
+// Send key changes as they happen on the input back-channel, instead of a UDPInputPacket every input tick
+bool useInputChannel = false;
+InputChannel* inputChannel = NULL;
+
+// Key presses per second made up to measure input to photon latency without a player, 0 for none
+int syntheticInputRate = 0;
+
+// Times a second key events are taken from SDL and sent, on a thread of their own
+//	Without the input channel this is also how often a UDPInputPacket goes out.
+int inputRate = 1000;
+std::atomic<bool> inputRunning{ false };
+std::thread inputThread;
+
 // Should the client stop at the end of this frame
 bool quit;
 
-// Initialise decoder
-void initDecoder() {
+// Stand-in game server on loopback, for testing without the real one
+bool runLoopbackServer = false;
+LoopbackConfig loopbackConfig;
+LoopbackServer* loopbackServer;
 
-	// Note: av_codec_register all is no longer necessary and deprecated in ffmpeg >4.0
+// Stand-ins for the streams of a mosaic after the first
+std::vector<LoopbackServer*> mosaicServers;
 
-	// Get codec
-	codec = avcodec_find_decoder(CODEC_ID);
-	if (!codec) {
-		printf("Codec not found.. %s\n", stderr);
-		exit(EXIT_FAILURE);
+// Record received datagrams to a file, or feed them from one instead of the socket
+const char* recordPath = NULL;
+const char* replayPath = NULL;
+bool replayRealTime = true;
+CaptureReader replayReader;
+
+// Run headless against the stand-in server for this many seconds and report, 0 to run normally
+int benchmarkSeconds = 0;
+
+// Initialise a session per stream, sockets must be up
+void initSessions() {
+	if (streamCount > 1) {
+		decodePool.start(poolThreadCount);
+		printf("Decoding %d streams on %d threads\n", streamCount, decodePool.threadCount());
 	}
 
-	// Get codec context
-	codecContext = avcodec_alloc_context3(codec);
-	codecContext->width = FRAME_WIDTH;
-	codecContext->height = FRAME_HEIGHT;
+	for (int i = 0; i < streamCount; i++) {
+		SessionConfig config;
+		config.replaying = replayPath != NULL;
+		config.address = UDP_RECEIVE_ADDRESS;
+		config.port = UDP_RECEIVE_PORT + i;
+		config.streamId = (uint16_t)(streamId + i);
+		config.transport = transportConfig;
+		config.jitterLatencyMs = jitterLatencyMs;
+		config.codecId = codecId;
+		config.width = FRAME_WIDTH;
+		config.height = FRAME_HEIGHT;
+		config.decodeThreadCount = decodeThreadCount;
+		config.decodeThreadType = decodeThreadType;
+		config.progressiveDecode = progressiveDecode;
+		config.prewarmDecoder = prewarmDecoders;
+
+		// The pool spreads the streams over the cores, each codec keeps to the worker running it
+		if (streamCount > 1) {
+			config.pool = &decodePool;
+			config.decodeThreadCount = 1;
+		} else if (directTextureCount > 0) {
+			config.textures = &texturePool;
+		}
 
-	// Open codec
-	int ret = avcodec_open2(codecContext, codec, NULL);
-	if (ret < 0) {
-		printf("could not open codec.. %s\n", stderr);
-		exit(EXIT_FAILURE);
+		StreamSession* stream = new StreamSession(i, config);
+		stream->presentScheduler->policy = presentPolicy;
+		sessions.push_back(stream);
 	}
+
+	session = sessions[0];
+}
+
+// Whether pictures are better converted here than by the renderer
+bool convertOnCpu() {
+	if (convertMode != CONVERT_AUTO) {
+		return convertMode == CONVERT_CPU;
+	}
+
+	SDL_RendererInfo info;
+	if (SDL_GetRendererInfo(sdlRenderer, &info) != 0) {
+		return false;
+	}
+
+	// Converts IYUV textures in generic code
+	if (strcmp(info.name, "software") == 0) {
+		return true;
+	}
+
+	for (Uint32 i = 0; i < info.num_texture_formats; i++) {
+		if (info.texture_formats[i] == SDL_PIXELFORMAT_IYUV) {
+			return false;
+		}
+	}
+
+	return true;
 }
 
 // Initialise SDL renderer
 void initRenderer() {
 
+	// Benchmarks need no window on screen, unless a driver was picked explicitly
+	if (benchmarkSeconds > 0) {
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+	}
+
 	// Init sdl library
 	SDL_Init(SDL_INIT_EVERYTHING);
 
 
 	//Create window
-	sdlWindow = SDL_CreateWindow("CGA Client", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, FRAME_WIDTH, FRAME_HEIGHT, SDL_WINDOW_SHOWN);
+	Uint32 windowFlags = SDL_WINDOW_SHOWN | (resizableWindow ? SDL_WINDOW_RESIZABLE : 0);
+	sdlWindow = SDL_CreateWindow("CGA Client", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, windowWidth, windowHeight, windowFlags);
 	if (sdlWindow == NULL) {
 		printf("Window could not be created! SDL Error: %s\n", SDL_GetError());
 		exit(EXIT_FAILURE);
 	}
 
 	// Create renderer for window
-	sdlRenderer = SDL_CreateRenderer(sdlWindow, -1, SDL_RENDERER_ACCELERATED);
+	sdlRenderer = SDL_CreateRenderer(sdlWindow, -1, rendererFlags);
 	if (sdlRenderer == NULL) {
 		printf("Renderer could not be created! SDL Error: %s\n", SDL_GetError());
 		exit(EXIT_FAILURE);
@@ -140,47 +289,38 @@ void initRenderer() {
 
 	// Init texture to white screen
 	SDL_SetRenderDrawColor(sdlRenderer, 0xFF, 0xFF, 0xFF, 0xFF);
-	sdlTexture = SDL_CreateTexture(sdlRenderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, FRAME_WIDTH, FRAME_HEIGHT);
-}
 
-// Initialise frame receiver socket
-void initReceiverSocket() {
+	cpuConversion = convertOnCpu();
+	if (cpuConversion) {
+		printf("Converting pictures with %s\n", PictureConverter::instructionSetName(pictureConverter.instructionSet));
+	} else {
 
-	// Initialise winsock
-	WSADATA wsaData;
-	int ret = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (ret != 0) {
-		printf("WSA init failed: %d\n", WSAGetLastError());
-		exit(EXIT_FAILURE);
-	}
+		// The renderer scales the picture to the window, smoothly where it can
+		SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "linear");
+		sdlTexture = SDL_CreateTexture(sdlRenderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, FRAME_WIDTH, FRAME_HEIGHT);
 
-	// Initialize the socket
-	UDPRecvSocket = socket(PF_INET, SOCK_DGRAM, 0);
-	if (UDPRecvSocket < 0) {
-		printf("Socket init failed: %d\n", WSAGetLastError());
-		exit(EXIT_FAILURE);
+		if (directTextureCount > 0) {
+			texturePool.create(sdlRenderer, directTextureCount, FRAME_WIDTH, FRAME_HEIGHT);
+		}
 	}
 
-	// Configure address
-	UDPRecvAddress.sin_family = AF_INET;
-	UDPRecvAddress.sin_addr.s_addr = UDP_RECEIVE_ADDRESS;
-	UDPRecvAddress.sin_port = htons(UDP_RECEIVE_PORT);
-
-	// Bind socket
-	ret = bind(UDPRecvSocket, (const sockaddr*)&UDPRecvAddress, sizeof(UDPRecvAddress));
-	if (ret != 0) {
-		printf("Socket bind failed: %d\n", WSAGetLastError());
-		exit(EXIT_FAILURE);
+	// Present at the display's pace unless told otherwise
+	SDL_DisplayMode mode;
+	int rate = presentRate;
+	if (rate <= 0 && SDL_GetWindowDisplayMode(sdlWindow, &mode) == 0) {
+		rate = mode.refresh_rate;
+	}
+	for (StreamSession* stream : sessions) {
+		stream->presentScheduler->interval = 1000000 / (rate > 0 ? rate : 60);
+		stream->presentScheduler->vsync = (rendererFlags & SDL_RENDERER_PRESENTVSYNC) != 0;
 	}
 }
 
 // Initialise input server socket
 void initServerSocket() {
 	// Initialise winsock
-	WSADATA wsaData;
-	int ret = WSAStartup(MAKEWORD(2, 2), &wsaData);
-	if (ret != 0) {
-		printf("WSA init failed: %d\n", WSAGetLastError());
+	if (!initSockets()) {
+		printf("WSA init failed: %d\n", socketError());
 		exit(EXIT_FAILURE);
 	}
 
@@ -192,7 +332,7 @@ void initServerSocket() {
 	// Initialize the socket
 	UDPSendSocket = socket(PF_INET, SOCK_DGRAM, 0);
 	if (UDPSendSocket < 0) {
-		printf("Socket init failed: %d\n", WSAGetLastError());
+		printf("Socket init failed: %d\n", socketError());
 		exit(EXIT_FAILURE);
 	}
 
@@ -206,13 +346,21 @@ void initGUI() {
 	imGuiContext = ImGui::CreateContext();
 	ImGui::SetCurrentContext(imGuiContext);
 
-	ImGuiSDL::Initialize(sdlRenderer, FRAME_WIDTH, FRAME_HEIGHT);
+	int width, height;
+	SDL_GetRendererOutputSize(sdlRenderer, &width, &height);
+	ImGuiSDL::Initialize(sdlRenderer, width, height);
+	ImGuiSDL::SetTriangleCacheCapacity(solidTriangleCache, texturedTriangleCache);
 }
 
 
 // Close SDL renderer
 void closeRenderer() {
 
+	texturePool.destroy();
+	if (rgbaTexture) {
+		SDL_DestroyTexture(rgbaTexture);
+		rgbaTexture = NULL;
+	}
 	SDL_DestroyTexture(sdlTexture);
 	SDL_DestroyRenderer(sdlRenderer);
 	SDL_DestroyWindow(sdlWindow);
@@ -225,50 +373,120 @@ void closeRenderer() {
 }
 
 
-// Decode a frame
-// Param frameIndex; the index in the frameMap of the frame to render
-AVFrame* decodeFrame(int frameIndex) {
-
-	// Allocate packet
-	AVPacket* packet = av_packet_alloc();
-	if (!packet) {
-		printf("Packet alloc failed..\n");
-		exit(EXIT_FAILURE);
-	}
-
-	// Fill packet with frame data
-	packet->data = (uint8_t*)frameMap[frameIndex];
-	packet->size = frameSize[frameIndex];
+static double percentOf(uint64_t part, uint64_t whole) {
+	return whole > 0 ? 100.0 * part / whole : 0.0;
+}
 
-	// Allocate frame
-	AVFrame* frame = av_frame_alloc();
-	if (!frame) {
-		printf("Frame alloc failed..\n");
-		exit(EXIT_FAILURE);
+// Latency and loss figures, next to the game window
+void renderStats() {
+	ImGui::SetNextWindowPos(ImVec2(370, 60), ImGuiCond_FirstUseEver);
+	ImGui::SetNextWindowSize(ImVec2(320, streamCount > 1 ? 415 + 17 * streamCount : 375), ImGuiCond_FirstUseEver);
+	ImGui::Begin("stats", NULL, NULL);
+
+	ImGui::Text("%.1f fps", session->latencyStats.fps);
+
+	const JitterBuffer& jitterBuffer = session->receiver->jitterBuffer;
+	uint64_t delivered = jitterBuffer.deliveredFrames;
+	uint64_t dropped = jitterBuffer.droppedFrames;
+	ImGui::Text("Frames dropped: %llu (%.2f%%)", (unsigned long long)dropped, percentOf(dropped, delivered + dropped));
+
+	uint64_t received = session->receiver->packetsReceived;
+	uint64_t lost = session->reassembler.lostFragments;
+	uint64_t recovered = session->reassembler.recoveredFragments;
+	ImGui::Text("Fragments lost: %llu (%.2f%%)", (unsigned long long)lost, percentOf(lost, received + lost));
+	ImGui::Text("Fragments recovered: %llu", (unsigned long long)recovered);
+
+	uint64_t bytes = session->receiver->receivedBytes;
+	ImGui::Text("Protocol v%d: %.1f%% goodput, %llu corrupt", session->receiver->protocolVersion.load(),
+		percentOf(session->receiver->frameBytes, bytes), (unsigned long long)session->receiver->corruptPackets);
+
+	if (inputChannel) {
+		ImGui::Text("Input to photon: %.2f ms, p99 %.2f ms, %llu coalesced",
+			inputChannel->inputToPhoton.percentile(0.5) / 1000.0, inputChannel->inputToPhoton.percentile(0.99) / 1000.0,
+			(unsigned long long)inputChannel->changesCoalesced);
 	}
 
-	frame->width = FRAME_WIDTH;
-	frame->height = FRAME_HEIGHT;
-	frame->format = AV_PIX_FMT_YUV420P;
-
-	// Send packet to decoder
-	int ret = avcodec_send_packet(codecContext, packet);
-	if (ret < 0) {
-		fprintf(stderr, "Error sending a packet for decoding: %d\n", ret);
-		exit(EXIT_FAILURE);
+	uint64_t direct = texturePool.directFrames;
+	uint64_t copied = texturePool.copiedFrames;
+	ImGui::Text("Decoded into textures: %.1f%%", percentOf(direct, direct + copied));
+	ImGui::Text("Overlay reused: %.1f%%", percentOf(overlayReuses, overlayRedraws + overlayReuses));
+
+	ImGuiSDL::RenderStats overlay;
+	ImGuiSDL::GetRenderStats(overlay);
+	ImGui::Text("Overlay calls: %d for %d primitives, %d state changes", overlay.DrawCalls, overlay.Primitives, overlay.StateChanges);
+
+	ImGuiSDL::TriangleCacheStats solid, textured;
+	ImGuiSDL::GetTriangleCacheStats(solid, textured);
+	ImGui::Text("Triangle hits: %.1f%% solid, %.1f%% textured",
+		percentOf(solid.Hits, solid.Hits + solid.Misses), percentOf(textured.Hits, textured.Hits + textured.Misses));
+	ImGui::Text("Evicted: %llu of %llu solid, %llu of %llu textured",
+		(unsigned long long)solid.Evictions, (unsigned long long)solid.Capacity,
+		(unsigned long long)textured.Evictions, (unsigned long long)textured.Capacity);
+
+	ImGui::Text("Present %s: %.2f ms apart", PresentScheduler::policyName(session->presentScheduler->policy),
+		session->presentScheduler->presentIntervals.percentile(0.5) / 1000.0);
+	ImGui::Text("Deviation %.2f ms, judder p99 %.2f ms",
+		session->presentScheduler->intervalDeviation() / 1000.0, session->presentScheduler->judder.percentile(0.99) / 1000.0);
+	ImGui::Text("Superseded: %llu, redraws: %llu",
+		(unsigned long long)session->presentScheduler->supersededFrames, (unsigned long long)session->presentScheduler->redraws);
+	ImGui::Text("First frame: %.1f ms, %llu discarded, %llu concealed, %llu keyframes asked",
+		session->timeToFirstFrame() / 1000.0, (unsigned long long)session->decoder->discardedFrames,
+		(unsigned long long)session->decoder->concealedFrames, (unsigned long long)session->decoder->keyframeRequester.requestsSent);
+
+	ImGui::Separator();
+	ImGui::Columns(4, "stages");
+	ImGui::Text("stage");
+	ImGui::NextColumn();
+	ImGui::Text("p50 ms");
+	ImGui::NextColumn();
+	ImGui::Text("p99 ms");
+	ImGui::NextColumn();
+	ImGui::Text("max ms");
+	ImGui::NextColumn();
+
+	for (int i = 0; i < LatencyStats::STAGE_COUNT; i++) {
+		const LatencyHistogram& stage = session->latencyStats.stages[i];
+		ImGui::Text("%s", LatencyStats::stageNames[i]);
+		ImGui::NextColumn();
+		ImGui::Text("%.2f", stage.percentile(0.5) / 1000.0);
+		ImGui::NextColumn();
+		ImGui::Text("%.2f", stage.percentile(0.99) / 1000.0);
+		ImGui::NextColumn();
+		ImGui::Text("%.2f", stage.maximum() / 1000.0);
+		ImGui::NextColumn();
 	}
 
-	// Get frame from decoder
-	ret = avcodec_receive_frame(codecContext, frame);
-	if (ret == AVERROR(EAGAIN)) {
-		printf("Error during decoding: partial frame\n");
-	} else if (ret == AVERROR_EOF) {
-		printf("Error during decoding: Error during decoding\n");
-	} else if (ret < 0) {
-		fprintf(stderr, "Unknown error during decoding\n");
+	// The figures above are of the first stream, each one gets a row here
+	if (streamCount > 1) {
+		ImGui::Columns(1);
+		ImGui::Separator();
+		ImGui::Text("Pool: %d threads, %.1f%% of tasks stolen", decodePool.threadCount(),
+			percentOf(decodePool.tasksStolen, decodePool.tasksRun));
+
+		ImGui::Columns(4, "streams");
+		ImGui::Text("stream");
+		ImGui::NextColumn();
+		ImGui::Text("fps");
+		ImGui::NextColumn();
+		ImGui::Text("p50 ms");
+		ImGui::NextColumn();
+		ImGui::Text("dropped");
+		ImGui::NextColumn();
+
+		for (StreamSession* stream : sessions) {
+			ImGui::Text("%d", stream->index);
+			ImGui::NextColumn();
+			ImGui::Text("%.1f", stream->latencyStats.fps);
+			ImGui::NextColumn();
+			ImGui::Text("%.2f", stream->latencyStats.stages[LatencyStats::TOTAL].percentile(0.5) / 1000.0);
+			ImGui::NextColumn();
+			ImGui::Text("%llu", (unsigned long long)stream->receiver->jitterBuffer.droppedFrames);
+			ImGui::NextColumn();
+		}
 	}
 
-	return frame;
+	ImGui::Columns(1);
+	ImGui::End();
 }
 
 // ImGUI render
@@ -303,112 +521,300 @@ void renderGUI(UDPRecvGameInfo gameInfo) {
 
 	ImGui::End();
 
+	if (showStats) {
+		renderStats();
+	}
+
 	ImGui::Render();
-	ImGuiSDL::Render(ImGui::GetDrawData());
+
+	if (!cacheOverlay) {
+		ImGuiSDL::Render(ImGui::GetDrawData());
+	} else if (ImGuiSDL::RenderCached(ImGui::GetDrawData())) {
+		overlayRedraws++;
+	} else {
+		overlayReuses++;
+	}
+}
+
+// Largest rectangle of the picture's shape that fits the given area, centred
+SDL_Rect fitInto(const SDL_Rect& bounds, int width, int height) {
+	SDL_Rect area = bounds;
+	if (width <= 0 || height <= 0) {
+		return area;
+	}
+
+	if ((int64_t)bounds.w * height > (int64_t)bounds.h * width) {
+		area.w = (int)((int64_t)bounds.h * width / height);
+		area.x = bounds.x + (bounds.w - area.w) / 2;
+	} else {
+		area.h = (int)((int64_t)bounds.w * height / width);
+		area.y = bounds.y + (bounds.h - area.h) / 2;
+	}
+
+	return area;
+}
+
+// Largest rectangle of the picture's shape that fits the window, centred
+SDL_Rect fitPicture(int width, int height) {
+	SDL_Rect window = { 0, 0, 0, 0 };
+	SDL_GetRendererOutputSize(sdlRenderer, &window.w, &window.h);
+
+	return fitInto(window, width, height);
+}
+
+// Convert a decoded picture to RGBA at the size it is shown at
+void convertFrame(AVFrame* frame) {
+	SDL_Rect area = fitPicture(frame->width, frame->height);
+
+	if (!rgbaTexture || area.w != rgbaWidth || area.h != rgbaHeight) {
+		if (rgbaTexture) {
+			SDL_DestroyTexture(rgbaTexture);
+			shownTexture = NULL;
+		}
+
+		rgbaTexture = SDL_CreateTexture(sdlRenderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, area.w, area.h);
+		rgbaWidth = area.w;
+		rgbaHeight = area.h;
+		if (!rgbaTexture) {
+			printf("Texture to convert into could not be created: %s\n", SDL_GetError());
+			return;
+		}
+	}
+
+	void* pixels;
+	int pitch;
+	if (SDL_LockTexture(rgbaTexture, NULL, &pixels, &pitch) != 0) {
+		return;
+	}
+
+	pictureConverter.convert(frame, (uint8_t*)pixels, pitch, area.w, area.h);
+	SDL_UnlockTexture(rgbaTexture);
+
+	shownTexture = rgbaTexture;
+	shownSource = { 0, 0, area.w, area.h };
 }
 
-// Render the frame from the given index in the frame map
-void renderFrame(int frameIndex) {
+// Upload a decoded picture, it is shown from then on
+void uploadFrame(AVFrame* frame) {
+
+	if (cpuConversion) {
+		convertFrame(frame);
+		return;
+	}
+
+	// Decoded straight into a texture, which is larger than the picture
+	shownSource = { 0, 0, frame->width, frame->height };
+	shownTexture = texturePool.present(frame);
+
+	if (!shownTexture) {
+
+		// The stream doesn't have to match the window, the texture does have to match the stream
+		if (frame->width != textureWidth || frame->height != textureHeight) {
+			SDL_DestroyTexture(sdlTexture);
+			sdlTexture = SDL_CreateTexture(sdlRenderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, frame->width, frame->height);
+			textureWidth = frame->width;
+			textureHeight = frame->height;
+		}
+
+		SDL_UpdateYUVTexture(
+			sdlTexture,
+			NULL,	// Update entire image
+			frame->data[0],
+			frame->linesize[0],
+			frame->data[1],
+			frame->linesize[1],
+			frame->data[2],
+			frame->linesize[2]
+			);
+		shownTexture = sdlTexture;
+	}
+}
 
-	// Get decoded frame
-	AVFrame* frame = decodeFrame(frameIndex);
+// Present the given decoded frame, or redraw the last one with a fresh overlay if NULL
+void renderFrame(DecodedFrame* decoded) {
 
-	SDL_UpdateYUVTexture(
-		sdlTexture,
-		NULL,	// Update entire image
-		frame->data[0],
-		frame->linesize[0],
-		frame->data[1],
-		frame->linesize[1],
-		frame->data[2],
-		frame->linesize[2]
-		);
+	FrameTimings timings;
+	if (decoded) {
+		timings = decoded->timings;
+		timings.uploadStart = nowMicroseconds();
+		uploadFrame(decoded->frame);
+		timings.uploadDone = nowMicroseconds();
+		session->latestGameInfo = decoded->gameinfo;
+	}
 
 	// Clear screen
 	SDL_RenderClear(sdlRenderer);
 
-	// Render texture to screen
-	SDL_RenderCopy(sdlRenderer, sdlTexture, NULL, NULL);
+	// Render texture to screen, fitted to the window as it is now
+	if (shownTexture) {
+		SDL_Rect destination = fitPicture(shownSource.w, shownSource.h);
+		SDL_RenderCopy(sdlRenderer, shownTexture, &shownSource, &destination);
+	}
 
-	renderGUI(latestGameInfo);
+	renderGUI(session->latestGameInfo);
 
 	// Update screen
 	SDL_RenderPresent(sdlRenderer);
+	uint64_t presented = nowMicroseconds();
+	session->presentScheduler->presented(presented, decoded != NULL);
+
+	if (decoded) {
+		timings.presented = presented;
+		session->latencyStats.record(decoded->nframe, timings);
+		if (!session->firstPresented) {
+			session->firstPresented = presented;
+		}
 
-	// Destroy raw frame data
-	frameSize.erase(frameIndex);
-	fragsReceived.erase(frameIndex);
-	frameMap.erase(frameIndex);
-}
+		// Changes the server applied for the first time in this frame are on screen now
+		if (inputChannel) {
+			inputChannel->presented(session->receiver->inputEcho(decoded->nframe), presented);
+		}
 
-// Wait until the next packet arrives
-//	Blocks execution
-UDPRecvPacket nextPacket() {
+		// Hand picture back to the decoder, its texture can be decoded into again once the codec lets go too
+		session->decoder->recycle(decoded);
+		texturePool.relock();
+	}
+}
 
-	// Receive next udp packet
-	int ret = recvfrom(
-		UDPRecvSocket,
-		(char*)UDPRecvBuffer,
-		sizeof(UDPRecvPacket),
-		0,
-		(sockaddr*)&UDPRecvAddress,
-		&UDP_RECEIVE_ADDRESS_LENGTH
-	);
+// Upload a stream's picture into its own texture
+void uploadTile(StreamSession* stream, AVFrame* frame) {
+	if (!stream->texture || frame->width != stream->textureWidth || frame->height != stream->textureHeight) {
+		if (stream->texture) {
+			SDL_DestroyTexture(stream->texture);
+		}
 
-	// Check for error
-	if (ret < 0) {
-		printf("Receive failure: %d\n", WSAGetLastError());
-		exit(EXIT_FAILURE);
+		stream->texture = SDL_CreateTexture(sdlRenderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, frame->width, frame->height);
+		stream->textureWidth = frame->width;
+		stream->textureHeight = frame->height;
+		if (!stream->texture) {
+			printf("Texture of stream %d could not be created: %s\n", stream->index, SDL_GetError());
+			return;
+		}
 	}
 
-	// Interpret as packet struct
-	return *(reinterpret_cast<UDPRecvPacket*>(UDPRecvBuffer));
+	SDL_UpdateYUVTexture(stream->texture, NULL, frame->data[0], frame->linesize[0], frame->data[1], frame->linesize[1],
+		frame->data[2], frame->linesize[2]);
 }
 
-// Add the given packet to the corresponding frame
-// If frame is now complete, render it
-void processPacket(UDPRecvPacket packet) {
+// Present every stream in its tile of a grid filling the window, whenever one of them is due
+//	Streams that aren't due are drawn again from their textures. Returns whether anything was presented.
+bool renderMosaic() {
+	DecodedFrame* pictures[MAX_STREAMS];
+	bool due[MAX_STREAMS];
+	bool anyDue = false;
+
+	for (StreamSession* stream : sessions) {
+		stream->presentScheduler->collect();
+		due[stream->index] = stream->presentScheduler->due(nowMicroseconds(), pictures[stream->index]);
+		anyDue |= due[stream->index];
+	}
+
+	if (!anyDue) {
+		return false;
+	}
 
-	latestGameInfo = packet.gameinfo;
+	int outputWidth, outputHeight;
+	SDL_GetRendererOutputSize(sdlRenderer, &outputWidth, &outputHeight);
 
-	int currentFrame = packet.header.nframe;
-	int fragmentCount = packet.header.nfrags;
+	// As close to square as the count allows
+	int columns = 1;
+	while (columns * columns < streamCount) {
+		columns++;
+	}
+	int rows = (streamCount + columns - 1) / columns;
 
-	// Add to map if we haven't started this frame yet.
-	if (!frameMap.count(currentFrame)) {
-		char* frame = (char*)malloc(fragmentCount * PACKET_SIZE);
+	SDL_RenderClear(sdlRenderer);
 
-		frameMap.emplace(currentFrame, frame);
-		frameSize.emplace(currentFrame, packet.header.framesize);
-		fragsReceived.emplace(currentFrame, 0);
+	for (StreamSession* stream : sessions) {
+		DecodedFrame* decoded = pictures[stream->index];
+		if (due[stream->index] && decoded) {
+			decoded->timings.uploadStart = nowMicroseconds();
+			uploadTile(stream, decoded->frame);
+			decoded->timings.uploadDone = nowMicroseconds();
+			stream->latestGameInfo = decoded->gameinfo;
+		}
 
-		//printf("Start new frame: %d\n", currentFrame);
+		if (stream->texture) {
+			int column = stream->index % columns;
+			int row = stream->index / columns;
+			SDL_Rect tile = {
+				column * outputWidth / columns,
+				row * outputHeight / rows,
+				(column + 1) * outputWidth / columns - column * outputWidth / columns,
+				(row + 1) * outputHeight / rows - row * outputHeight / rows
+			};
+
+			SDL_Rect destination = fitInto(tile, stream->textureWidth, stream->textureHeight);
+			SDL_RenderCopy(sdlRenderer, stream->texture, NULL, &destination);
+		}
 	}
 
-	// Size of this fragment
-	int fragsize = PACKET_SIZE;
-	if (packet.header.nfrag == packet.header.nfrags - 1) {
+	renderGUI(session->latestGameInfo);
+
+	SDL_RenderPresent(sdlRenderer);
+	uint64_t presented = nowMicroseconds();
+
+	for (StreamSession* stream : sessions) {
+		if (!due[stream->index]) {
+			continue;
+		}
+
+		DecodedFrame* decoded = pictures[stream->index];
+		stream->presentScheduler->presented(presented, decoded != NULL);
 
-		// Last fragment is smaller
-		int fragsize = packet.header.framesize - (PACKET_SIZE * (packet.header.nfrags - 1));
+		if (decoded) {
+			decoded->timings.presented = presented;
+			stream->latencyStats.record(decoded->nframe, decoded->timings);
+			if (!stream->firstPresented) {
+				stream->firstPresented = presented;
+			}
+			stream->decoder->recycle(decoded);
+		}
 	}
 
-	// Save packet at its spot in the frame
-	int loc = packet.header.nfrag * PACKET_SIZE;
-	memcpy_s(&frameMap[packet.header.nframe][loc], PACKET_SIZE, packet.packet, fragsize);
-	fragsReceived[packet.header.nframe]++;
+	return true;
+}
+
+// When a key event happened, in microseconds on our clock
+uint64_t keyEventTime(const SDL_KeyboardEvent& key, uint64_t now) {
+	Uint32 ticks = SDL_GetTicks();
+	uint64_t age = ticks > key.timestamp ? (uint64_t)(ticks - key.timestamp) * 1000 : 0;
 
-	// Frame has been fully assembled
-	if (fragsReceived[packet.header.nframe] == packet.header.nfrags) {
+	return age < now ? now - age : now;
+}
+
+// Handle window events, on the render thread, which SDL wants to pump them
+//	Key events are left in SDL's queue for the input thread.
+void processEvents() {
+	SDL_PumpEvents();
+
+	SDL_Event e;
+	while (SDL_PeepEvents(&e, 1, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_KEYDOWN - 1) > 0
+		|| SDL_PeepEvents(&e, 1, SDL_GETEVENT, SDL_KEYUP + 1, SDL_LASTEVENT) > 0) {
 
-		// Export frame
-		renderFrame(currentFrame);
+		// User requests quit
+		if (e.type == SDL_QUIT) {
+			quit = true;
+		}
+
+		// The overlay follows the window's size, pictures are fitted to it as they are presented
+		if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+			int width, height;
+			SDL_GetRendererOutputSize(sdlRenderer, &width, &height);
+			ImGui::GetIO().DisplaySize = ImVec2((float)width, (float)height);
+		}
+
+		// The overlay's layer lost what was drawn into it
+		if (e.type == SDL_RENDER_TARGETS_RESET || e.type == SDL_RENDER_DEVICE_RESET) {
+			ImGuiSDL::Invalidate();
+		}
 	}
 }
 
-// Poll input from sdl
-// If input is available, send the keycodes to the game server
-void processInput() {
+// Take key events from SDL's queue and send the keycodes to the game server
+//	With the input channel every change is handed to it with the time it happened,
+//	and it decides what goes out
+void sampleInput(uint64_t now) {
 
 	UDPInputPacket packet;
 	bool inputAvailable = false;
@@ -416,16 +822,16 @@ void processInput() {
 	SDL_Event e;
 	int cDown = 0;
 	int cUp = 0;
-	while (SDL_PollEvent(&e) != 0) {
+	while (SDL_PeepEvents(&e, 1, SDL_GETEVENT, SDL_KEYDOWN, SDL_KEYUP) > 0) {
 
 		if (cDown > 8 || cUp > 8) {
 			printf("Too many concurrent user inputs, some lost");
 			break;
 		}
 
-		// User requests quit
-		if (e.type == SDL_QUIT) {
-			quit = true;
+		if (inputChannel) {
+			inputChannel->keyChanged(e.key.keysym.sym, e.type == SDL_KEYDOWN, keyEventTime(e.key, now));
+			continue;
 		}
 
 		// Other input
@@ -449,6 +855,11 @@ void processInput() {
 		}
 	}
 
+	if (inputChannel) {
+		inputChannel->poll(nowMicroseconds());
+		return;
+	}
+
 	packet.empty = !inputAvailable;
 
 	// always send, so we know dt
@@ -462,36 +873,674 @@ void processInput() {
 	);
 
 	if (ret < 0) {
-		printf("UDP packet send failed: %d\n", WSAGetLastError());
+		printf("UDP packet send failed: %d\n", socketError());
+	}
+}
+
+// Press and release the space bar syntheticInputRate times a second, through SDL like a player would
+void synthesizeInput(uint64_t now) {
+	static uint64_t next = 0;
+	static bool down = false;
+	if (now < next) {
+		return;
+	}
+
+	SDL_Event e = SDL_Event();
+	e.type = down ? SDL_KEYUP : SDL_KEYDOWN;
+	e.key.state = down ? SDL_RELEASED : SDL_PRESSED;
+	e.key.keysym.sym = SDLK_SPACE;
+	e.key.keysym.scancode = SDL_SCANCODE_SPACE;
+	SDL_PushEvent(&e);
+
+	down = !down;
+	next = now + 500000 / syntheticInputRate;
+}
+
+// Sample input inputRate times a second, however long rendering and presenting take
+void inputLoop() {
+	std::chrono::steady_clock::duration interval = std::chrono::microseconds(1000000 / inputRate);
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+
+	while (inputRunning) {
+		if (syntheticInputRate > 0) {
+			synthesizeInput(nowMicroseconds());
+		}
+
+		sampleInput(nowMicroseconds());
+
+		// Ticks missed while descheduled are dropped, not caught up on
+		next += interval;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (next < now) {
+			next = now;
+		}
+		std::this_thread::sleep_until(next);
 	}
 }
 
+// How long a finished replay keeps running without new frames
+const uint64_t REPLAY_IDLE_TIMEOUT = 1000000;
+
 // Main render loop
 void renderLoop() {
 
 	quit = false;
+
+	uint64_t benchmarkEnd = nowMicroseconds() + (uint64_t)benchmarkSeconds * 1000000;
+	uint64_t lastRendered = nowMicroseconds();
 	
 	while (!quit) {
 
-		processInput();
+		processEvents();
+
+		if (benchmarkSeconds > 0 && nowMicroseconds() >= benchmarkEnd) {
+			quit = true;
+		}
+
+		// Present when the scheduler says so, with the picture it picked from what the decode thread produced
+		DecodedFrame* decoded = NULL;
+		bool rendered;
+		if (streamCount > 1) {
+			rendered = renderMosaic();
+		} else {
+			session->presentScheduler->collect();
+
+			rendered = session->presentScheduler->due(nowMicroseconds(), decoded);
+			if (rendered) {
+				renderFrame(decoded);
+			}
+		}
+
+		if (decoded) {
+			lastRendered = nowMicroseconds();
+		}
+
+		// A finished replay has nothing more to show once frames stop coming
+		if (replayPath && session->receiver->replayFinished && nowMicroseconds() - lastRendered > REPLAY_IDLE_TIMEOUT) {
+			quit = true;
+		}
+
+		// Nothing to present, don't spin
+		if (!rendered) {
+			SDL_Delay(1);
+		}
+	}
+}
+
+// Read options from the command line
+//	--codec <mpeg4|h264>				codec the stream is encoded with
+//	--progressive					decode each frame while its fragments arrive, h264 only
+//	--decode-threads <n>				codec threads, 0 for one per core
+//	--decode-thread-type <frame|slice|auto>		how the codec splits work over threads, slice by default
+//							frame and auto add a frame of delay per codec thread
+//	--direct-textures <n>				textures the codec decodes pictures it won't refer to into, up to 3, 0 to copy every frame
+//	--present <latency|smooth|fixed>		when pictures are presented, smooth waits for vsync
+//	--present-rate <fps>				presents per second, the display refresh rate by default
+//	--no-overlay-cache				draw the overlay from scratch on every present
+//	--triangle-cache <solid>,<textured>		overlay triangles kept rasterized, 0 for the default
+//	--window <width>x<height>			size of the window, the picture is fitted into it
+//	--resizable					let the window be resized
+//	--convert <auto|renderer|cpu>			where pictures become RGB, auto converts here if the renderer is slow at it
+//	--simd <scalar|sse2|avx2|neon>			instructions converting here uses, the best available by default
+//	--convert-bench					time converting in the renderer against converting here, then exit
+//	--jitter-latency <ms>				how long to wait for a frame's missing fragments
+//	--nack						request resends of lost fragments on the input channel
+//	--keyframe-requests				ask for a keyframe on the input channel when frames can't be decoded, on with --loopback
+//	--no-keyframe-requests				never ask for one, show frames decoded without a reference instead
+//	--cold-decoder					open the decoder without warming it up
+//	--input-channel					send key changes as they happen, with redundancy, instead of every input tick
+//	--synthetic-input <hz>				press a key this often to measure input to photon latency
+//	--input-rate <hz>				how often key events are taken and sent, 1000 by default
+//	--loopback					run a stand-in game server in this process
+//	--loopback-size <width>x<height>		resolution it streams at
+//	--loopback-fps <n>				frame rate it streams at
+//	--loopback-loss <percent>			share of datagrams it drops
+//	--loopback-reorder <percent>			share of datagrams it swaps with the next one
+//	--loopback-stream <path>			elementary stream it replays instead of encoding
+//	--fec-group <n>					fragments per parity fragment it sends, 0 for none
+//	--loopback-protocol <1|2>			wire protocol version it sends
+//	--loopback-mtu <bytes>				path MTU it sizes v2 fragments to
+//	--loopback-crc					checksum every v2 datagram with a CRC32C
+//	--stream-id <n>					v2 stream to take, and the one the stand-in server sends
+//	--mosaic <n>					show n streams side by side, arriving on the ports from 8888 on
+//	--pool-threads <n>				threads decoding the streams of a mosaic, 0 for one per core
+//	--stats						show latency and loss next to the game window
+//	--stats-csv <path>				write the latency of every presented frame to a file
+//	--bench <seconds>				run headless against the stand-in server, then report
+//	--transport <blocking|epoll|io_uring>		how the receive thread waits for datagrams
+//	--busy-poll <us>				poll the network device this long before sleeping
+//	--gro						let the kernel coalesce datagrams, epoll only
+//	--record <path>					write every received datagram to a capture file
+//	--replay <path>					feed a capture file instead of receiving from the network
+//	--replay-fast					feed it as fast as the decoder keeps up rather than in real time
+void parseArguments(int argc, char* args[]) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = args[i];
+		bool hasValue = i + 1 < argc;
+
+		if (arg == "--codec" && hasValue) {
+			std::string codec = args[++i];
+			if (codec == "mpeg4") {
+				codecId = AV_CODEC_ID_MPEG4;
+			} else if (codec == "h264") {
+				codecId = AV_CODEC_ID_H264;
+			} else {
+				printf("Unknown codec: %s\n", codec.c_str());
+			}
+		} else if (arg == "--progressive") {
+			progressiveDecode = true;
+		} else if (arg == "--direct-textures" && hasValue) {
+			directTextureCount = atoi(args[++i]);
+		} else if (arg == "--present" && hasValue) {
+			std::string policy = args[++i];
+			if (policy == "latency") {
+				presentPolicy = PresentScheduler::LATENCY;
+			} else if (policy == "smooth") {
+				presentPolicy = PresentScheduler::SMOOTH;
+			} else if (policy == "fixed") {
+				presentPolicy = PresentScheduler::FIXED;
+			} else {
+				printf("Unknown present policy: %s\n", policy.c_str());
+			}
+		} else if (arg == "--present-rate" && hasValue) {
+			presentRate = atoi(args[++i]);
+		} else if (arg == "--no-overlay-cache") {
+			cacheOverlay = false;
+		} else if (arg == "--triangle-cache" && hasValue) {
+			std::string sizes = args[++i];
+			solidTriangleCache = atoi(sizes.c_str());
+			texturedTriangleCache = sizes.find(',') != std::string::npos ? atoi(sizes.substr(sizes.find(',') + 1).c_str()) : 0;
+		} else if (arg == "--window" && hasValue) {
+			std::string size = args[++i];
+			windowWidth = atoi(size.c_str());
+			windowHeight = atoi(size.substr(size.find('x') + 1).c_str());
+		} else if (arg == "--resizable") {
+			resizableWindow = true;
+		} else if (arg == "--convert" && hasValue) {
+			std::string mode = args[++i];
+			if (mode == "auto") {
+				convertMode = CONVERT_AUTO;
+			} else if (mode == "renderer") {
+				convertMode = CONVERT_RENDERER;
+			} else if (mode == "cpu") {
+				convertMode = CONVERT_CPU;
+			} else {
+				printf("Unknown conversion: %s\n", mode.c_str());
+			}
+		} else if (arg == "--simd" && hasValue) {
+			std::string name = args[++i];
+			bool found = false;
+			for (int set = PictureConverter::SCALAR; set <= PictureConverter::NEON; set++) {
+				if (name == PictureConverter::instructionSetName((PictureConverter::InstructionSet)set)) {
+					found = true;
+					if (PictureConverter::supported((PictureConverter::InstructionSet)set)) {
+						pictureConverter.instructionSet = (PictureConverter::InstructionSet)set;
+					} else {
+						printf("%s is not available on this CPU or in this build\n", name.c_str());
+					}
+				}
+			}
+			if (!found) {
+				printf("Unknown instruction set: %s\n", name.c_str());
+			}
+		} else if (arg == "--convert-bench") {
+			conversionBenchmark = true;
+		} else if (arg == "--decode-threads" && hasValue) {
+			decodeThreadCount = atoi(args[++i]);
+		} else if (arg == "--decode-thread-type" && hasValue) {
+			std::string type = args[++i];
+			if (type == "frame") {
+				decodeThreadType = FF_THREAD_FRAME;
+			} else if (type == "slice") {
+				decodeThreadType = FF_THREAD_SLICE;
+			} else if (type == "auto") {
+				decodeThreadType = FF_THREAD_FRAME | FF_THREAD_SLICE;
+			} else {
+				printf("Unknown decode thread type: %s\n", type.c_str());
+			}
+		} else if (arg == "--jitter-latency" && hasValue) {
+			jitterLatencyMs = atoi(args[++i]);
+		} else if (arg == "--nack") {
+			requestRetransmits = true;
+		} else if (arg == "--keyframe-requests") {
+			requestKeyframes = true;
+		} else if (arg == "--no-keyframe-requests") {
+			keyframeRequestsOff = true;
+		} else if (arg == "--cold-decoder") {
+			prewarmDecoders = false;
+		} else if (arg == "--input-channel") {
+			useInputChannel = true;
+		} else if (arg == "--synthetic-input" && hasValue) {
+			syntheticInputRate = atoi(args[++i]);
+		} else if (arg == "--input-rate" && hasValue) {
+			inputRate = atoi(args[++i]);
+		} else if (arg == "--loopback") {
+			runLoopbackServer = true;
+		} else if (arg == "--loopback-size" && hasValue) {
+			std::string size = args[++i];
+			loopbackConfig.width = atoi(size.c_str());
+			loopbackConfig.height = atoi(size.substr(size.find('x') + 1).c_str());
+		} else if (arg == "--loopback-fps" && hasValue) {
+			loopbackConfig.fps = atoi(args[++i]);
+		} else if (arg == "--loopback-loss" && hasValue) {
+			loopbackConfig.lossRate = atof(args[++i]) / 100.0;
+		} else if (arg == "--loopback-reorder" && hasValue) {
+			loopbackConfig.reorderRate = atof(args[++i]) / 100.0;
+		} else if (arg == "--loopback-stream" && hasValue) {
+			loopbackConfig.streamPath = args[++i];
+		} else if (arg == "--fec-group" && hasValue) {
+			loopbackConfig.fecGroupSize = atoi(args[++i]);
+		} else if (arg == "--loopback-protocol" && hasValue) {
+			loopbackConfig.protocol = atoi(args[++i]);
+		} else if (arg == "--loopback-mtu" && hasValue) {
+			loopbackConfig.mtu = atoi(args[++i]);
+		} else if (arg == "--loopback-crc") {
+			loopbackConfig.checksum = true;
+		} else if (arg == "--stream-id" && hasValue) {
+			streamId = (uint16_t)atoi(args[++i]);
+			loopbackConfig.streamId = streamId;
+		} else if (arg == "--mosaic" && hasValue) {
+			streamCount = atoi(args[++i]);
+		} else if (arg == "--pool-threads" && hasValue) {
+			poolThreadCount = atoi(args[++i]);
+		} else if (arg == "--stats") {
+			showStats = true;
+		} else if (arg == "--stats-csv" && hasValue) {
+			statsCsvPath = args[++i];
+		} else if (arg == "--bench" && hasValue) {
+			benchmarkSeconds = atoi(args[++i]);
+		} else if (arg == "--transport" && hasValue) {
+			std::string type = args[++i];
+			if (type == "blocking") {
+				transportConfig.type = TRANSPORT_BLOCKING;
+			} else if (type == "epoll") {
+				transportConfig.type = TRANSPORT_EPOLL;
+			} else if (type == "io_uring") {
+				transportConfig.type = TRANSPORT_IO_URING;
+			} else {
+				printf("Unknown transport: %s\n", type.c_str());
+			}
+		} else if (arg == "--busy-poll" && hasValue) {
+			transportConfig.busyPollMicroseconds = atoi(args[++i]);
+		} else if (arg == "--gro") {
+			transportConfig.gro = true;
+		} else if (arg == "--record" && hasValue) {
+			recordPath = args[++i];
+		} else if (arg == "--replay" && hasValue) {
+			replayPath = args[++i];
+		} else if (arg == "--replay-fast") {
+			replayRealTime = false;
+		} else {
+			printf("Unknown argument: %s\n", args[i]);
+		}
+	}
+
+	// The stand-in server answers them, the game server doesn't yet
+	if (runLoopbackServer) {
+		requestKeyframes = true;
+	}
+	if (keyframeRequestsOff) {
+		requestKeyframes = false;
+	}
+
+	if (inputRate < 1 || inputRate > 1000000) {
+		printf("Input is sampled 1 to 1000000 times a second\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (streamCount < 1 || streamCount > MAX_STREAMS) {
+		printf("A mosaic shows 1 to %d streams\n", MAX_STREAMS);
+		exit(EXIT_FAILURE);
+	}
+
+	// A capture holds one stream, and pool tasks can't wait for the rest of a frame
+	if (streamCount > 1 && (recordPath || replayPath)) {
+		printf("Captures hold a single stream, showing one\n");
+		streamCount = 1;
+	}
+	if (streamCount > 1 && progressiveDecode) {
+		printf("Streams of a mosaic are decoded whole frames at a time\n");
+		progressiveDecode = false;
+	}
+
+	// MPEG-4 part 2 frames can't be handed to the decoder in pieces
+	if (progressiveDecode && codecId != AV_CODEC_ID_H264) {
+		printf("Progressive decoding needs --codec h264, decoding whole frames\n");
+		progressiveDecode = false;
+	}
+}
+
+// Time showing pictures through an IYUV texture against converting them here, in a software renderer
+void benchmarkConversion() {
+	const int ITERATIONS = 50;
+
+	struct Case {
+		int pictureWidth, pictureHeight;
+		int width, height;
+	};
+	const Case cases[] = {
+		{ 1280, 720, 1280, 720 },
+		{ 1280, 720, 1920, 1080 },
+		{ 1920, 1080, 1280, 720 }
+	};
+
+	printf("%-26s %-10s %10s\n", "picture -> output", "path", "ms");
+
+	for (const Case& size : cases) {
+		AVFrame* frame = av_frame_alloc();
+		frame->format = AV_PIX_FMT_YUV420P;
+		frame->width = size.pictureWidth;
+		frame->height = size.pictureHeight;
+		if (av_frame_get_buffer(frame, 0) < 0) {
+			printf("Picture could not be allocated\n");
+			exit(EXIT_FAILURE);
+		}
+
+		// Gradients, so neither path gets to skip work
+		for (int plane = 0; plane < 3; plane++) {
+			int rows = plane == 0 ? frame->height : (frame->height + 1) / 2;
+			int columns = plane == 0 ? frame->width : (frame->width + 1) / 2;
+			for (int y = 0; y < rows; y++) {
+				for (int x = 0; x < columns; x++) {
+					frame->data[plane][y * frame->linesize[plane] + x] = (uint8_t)(x * 3 + y * 5 + plane * 80);
+				}
+			}
+		}
+
+		SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, size.width, size.height, 32, SDL_PIXELFORMAT_RGBA32);
+		SDL_Renderer* renderer = surface ? SDL_CreateSoftwareRenderer(surface) : NULL;
+		if (!renderer) {
+			printf("Software renderer could not be created: %s\n", SDL_GetError());
+			exit(EXIT_FAILURE);
+		}
+
+		char label[32];
+		snprintf(label, sizeof(label), "%dx%d -> %dx%d", size.pictureWidth, size.pictureHeight, size.width, size.height);
+
+		// As before, converted on upload and stretched when copied
+		SDL_Texture* yuvTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, size.pictureWidth, size.pictureHeight);
+		uint64_t start = 0;
+		for (int i = 0; i <= ITERATIONS; i++) {
+
+			// The first one warms up
+			if (i == 1) {
+				start = nowMicroseconds();
+			}
+
+			SDL_UpdateYUVTexture(yuvTexture, NULL, frame->data[0], frame->linesize[0], frame->data[1], frame->linesize[1], frame->data[2], frame->linesize[2]);
+			SDL_RenderCopy(renderer, yuvTexture, NULL, NULL);
+			SDL_RenderFlush(renderer);
+		}
+		printf("%-26s %-10s %10.2f\n", label, "renderer", (nowMicroseconds() - start) / 1000.0 / ITERATIONS);
+		SDL_DestroyTexture(yuvTexture);
+
+		// Converted and scaled here, then copied as is
+		SDL_Texture* converted = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, size.width, size.height);
+		for (int set = PictureConverter::SCALAR; set <= PictureConverter::NEON; set++) {
+			PictureConverter converter;
+			converter.instructionSet = (PictureConverter::InstructionSet)set;
+			if (!PictureConverter::supported(converter.instructionSet)) {
+				continue;
+			}
+
+			for (int i = 0; i <= ITERATIONS; i++) {
+				if (i == 1) {
+					start = nowMicroseconds();
+				}
+
+				void* pixels;
+				int pitch;
+				if (SDL_LockTexture(converted, NULL, &pixels, &pitch) == 0) {
+					converter.convert(frame, (uint8_t*)pixels, pitch, size.width, size.height);
+					SDL_UnlockTexture(converted);
+				}
+				SDL_RenderCopy(renderer, converted, NULL, NULL);
+				SDL_RenderFlush(renderer);
+			}
+			printf("%-26s %-10s %10.2f\n", label, PictureConverter::instructionSetName(converter.instructionSet),
+				(nowMicroseconds() - start) / 1000.0 / ITERATIONS);
+		}
+		SDL_DestroyTexture(converted);
+
+		SDL_DestroyRenderer(renderer);
+		SDL_FreeSurface(surface);
+		av_frame_free(&frame);
+	}
+}
+
+// Summary of a benchmark run
+void printBenchmarkReport(double seconds) {
+	const JitterBuffer& jitterBuffer = session->receiver->jitterBuffer;
+	uint64_t delivered = jitterBuffer.deliveredFrames;
+	uint64_t dropped = jitterBuffer.droppedFrames;
+	uint64_t presented = session->latencyStats.stages[LatencyStats::TOTAL].count();
+	uint64_t received = session->receiver->packetsReceived;
+	uint64_t lost = session->reassembler.lostFragments;
+
+	printf("\nBenchmark: %dx%d at %d fps for %.1f s, %.1f%% loss, %.1f%% reorder, %s\n",
+		loopbackConfig.width, loopbackConfig.height, loopbackConfig.fps, seconds,
+		loopbackConfig.lossRate * 100.0, loopbackConfig.reorderRate * 100.0,
+		loopbackConfig.streamPath ? loopbackConfig.streamPath : "encoded");
+	printf("Frames sent: %llu, presented: %llu, %.1f fps\n",
+		(unsigned long long)loopbackServer->framesSent, (unsigned long long)presented, presented / seconds);
+	printf("Frames dropped: %llu (%.2f%%), decoder dropped: %llu\n",
+		(unsigned long long)dropped, percentOf(dropped, delivered + dropped), (unsigned long long)session->decoder->droppedFrames);
+	printf("Fragments lost: %llu (%.2f%%), recovered: %llu\n",
+		(unsigned long long)lost, percentOf(lost, received + lost), (unsigned long long)session->reassembler.recoveredFragments);
+	printf("Protocol: v%d, %.1f%% goodput, %llu corrupt\n", session->receiver->protocolVersion.load(),
+		percentOf(session->receiver->frameBytes, session->receiver->receivedBytes), (unsigned long long)session->receiver->corruptPackets);
+
+	if (inputChannel) {
+		printf("Input: %llu changes in %llu datagrams, %llu coalesced, %llu lost, to photon p50 %.2f ms, p99 %.2f ms\n",
+			(unsigned long long)inputChannel->changesSent, (unsigned long long)inputChannel->packetsSent,
+			(unsigned long long)inputChannel->changesCoalesced, (unsigned long long)loopbackServer->inputGaps,
+			inputChannel->inputToPhoton.percentile(0.5) / 1000.0, inputChannel->inputToPhoton.percentile(0.99) / 1000.0);
+	}
+
+	const FrameDecoder& decoder = *session->decoder;
+	printf("Start: first frame %.1f ms, first keyframe %.1f ms, warm-up %.1f ms\n", session->timeToFirstFrame() / 1000.0,
+		session->timeToFirstKeyframe() / 1000.0, decoder.prewarmMicroseconds / 1000.0);
+	printf("References lost: %llu, recovered in p50 %.2f ms, p99 %.2f ms, %llu frames discarded, %llu concealed, %llu keyframes asked\n",
+		(unsigned long long)decoder.referenceLosses, decoder.recoveryTimes.percentile(0.5) / 1000.0,
+		decoder.recoveryTimes.percentile(0.99) / 1000.0, (unsigned long long)decoder.discardedFrames,
+		(unsigned long long)decoder.concealedFrames, (unsigned long long)decoder.keyframeRequester.requestsSent);
+	if (decoder.copiedFrames > 0) {
+		printf("Frame threads: %llu frames copied out of reassembly\n", (unsigned long long)decoder.copiedFrames);
+	}
+
+	printf("Convert: %s\n", cpuConversion ? PictureConverter::instructionSetName(pictureConverter.instructionSet) : "renderer");
+	printf("Present %s: %.2f ms apart, deviation %.2f ms, judder p99 %.2f ms, %llu superseded\n",
+		PresentScheduler::policyName(session->presentScheduler->policy), session->presentScheduler->presentIntervals.percentile(0.5) / 1000.0,
+		session->presentScheduler->intervalDeviation() / 1000.0, session->presentScheduler->judder.percentile(0.99) / 1000.0,
+		(unsigned long long)session->presentScheduler->supersededFrames);
+
+	uint64_t calls = session->receiver->receiveCalls;
+	if (session->transport) {
+		printf("Receive: %s, %.1f datagrams per call, %.0f ns CPU per datagram, %llu placed, %llu copied\n",
+			session->transport->name(), calls > 0 ? (double)received / calls : 0.0,
+			received > 0 ? session->receiver->cpuMicroseconds * 1000.0 / received : 0.0,
+			(unsigned long long)session->receiver->placedPayloads, (unsigned long long)session->receiver->copiedPayloads);
+	}
+
+	printf("%-10s %10s %10s %10s\n", "stage", "p50 ms", "p99 ms", "max ms");
+	for (int i = 0; i < LatencyStats::STAGE_COUNT; i++) {
+		const LatencyHistogram& stage = session->latencyStats.stages[i];
+		printf("%-10s %10.2f %10.2f %10.2f\n", LatencyStats::stageNames[i],
+			stage.percentile(0.5) / 1000.0, stage.percentile(0.99) / 1000.0, stage.maximum() / 1000.0);
+	}
 
-		UDPRecvPacket packet = nextPacket();
+	if (streamCount == 1) {
+		return;
+	}
 
-		// Save packet, render if frame complete
-		processPacket(packet);
+	// Every stream of the mosaic, the figures above are of the first
+	uint64_t mosaicPresented = 0;
+	printf("\n%-10s %10s %10s %10s %10s %10s\n", "stream", "presented", "fps", "p50 ms", "p99 ms", "dropped");
+	for (StreamSession* stream : sessions) {
+		const LatencyHistogram& total = stream->latencyStats.stages[LatencyStats::TOTAL];
+		mosaicPresented += total.count();
+		printf("%-10d %10llu %10.1f %10.2f %10.2f %10llu\n", stream->index, (unsigned long long)total.count(), total.count() / seconds,
+			total.percentile(0.5) / 1000.0, total.percentile(0.99) / 1000.0, (unsigned long long)stream->receiver->jitterBuffer.droppedFrames);
 	}
+	printf("Mosaic: %d streams, %.1f fps together, %d pool threads, %llu tasks, %.1f%% stolen\n",
+		streamCount, mosaicPresented / seconds, decodePool.threadCount(), (unsigned long long)decodePool.tasksRun,
+		percentOf(decodePool.tasksStolen, decodePool.tasksRun));
 }
 
 int main(int argc, char* args[]) {
 
-	initDecoder();
+	parseArguments(argc, args);
+
+	if (conversionBenchmark) {
+		benchmarkConversion();
+		return EXIT_SUCCESS;
+	}
+
+	// Benchmarks stream from the stand-in server and render in software
+	if (benchmarkSeconds > 0) {
+		runLoopbackServer = true;
+		rendererFlags = SDL_RENDERER_SOFTWARE;
+	} else if (presentPolicy == PresentScheduler::SMOOTH) {
+		rendererFlags |= SDL_RENDERER_PRESENTVSYNC;
+	}
+
+	initServerSocket();
+	initSessions();
 	initRenderer();
 	initGUI();
-	initReceiverSocket();
-	initServerSocket();
+
+	if (statsCsvPath && !session->latencyStats.openCsv(statsCsvPath)) {
+		printf("Could not open %s for writing\n", statsCsvPath);
+		exit(EXIT_FAILURE);
+	}
+
+	// Resends and keyframes of each stream are asked for on the port before the previous stream's
+	for (StreamSession* stream : sessions) {
+		sockaddr_in address = UDPSendAddress;
+		address.sin_port = htons(UDP_SEND_PORT - stream->index);
+		if (requestRetransmits) {
+			stream->receiver->nackScheduler.enable(UDPSendSocket, address);
+		}
+		if (requestKeyframes) {
+			stream->decoder->keyframeRequester.enable(UDPSendSocket, address);
+		}
+	}
+	if (useInputChannel) {
+		inputChannel = new InputChannel(UDPSendSocket, UDPSendAddress);
+	}
+	if (recordPath && !session->receiver->capture.open(recordPath)) {
+		printf("Could not open %s for writing\n", recordPath);
+		exit(EXIT_FAILURE);
+	}
+
+	// Receive on a separate thread, so rendering never waits on the network
+	if (replayPath) {
+		if (!replayReader.open(replayPath)) {
+			printf("Could not read capture %s\n", replayPath);
+			exit(EXIT_FAILURE);
+		}
+		session->start(&replayReader, replayRealTime);
+	} else {
+		for (StreamSession* stream : sessions) {
+			stream->start(NULL, false);
+		}
+	}
+
+	if (runLoopbackServer) {
+		loopbackConfig.port = UDP_RECEIVE_PORT;
+		loopbackConfig.codecId = codecId;
+		loopbackServer = new LoopbackServer(loopbackConfig);
+		loopbackServer->start();
+
+		// Streams of their own, taking resends on the ports the sessions ask on
+		for (int i = 1; i < streamCount; i++) {
+			LoopbackConfig config = loopbackConfig;
+			config.port = UDP_RECEIVE_PORT + i;
+			config.feedbackPort = UDP_SEND_PORT - i;
+			config.streamId = (uint16_t)(streamId + i);
+
+			LoopbackServer* server = new LoopbackServer(config);
+			server->start();
+			mosaicServers.push_back(server);
+		}
+	}
 
 	// Show video stream from game server
+	uint64_t started = nowMicroseconds();
+	inputRunning = true;
+	inputThread = std::thread(inputLoop);
 	renderLoop();
+	double elapsed = (nowMicroseconds() - started) / 1000000.0;
+
+	inputRunning = false;
+	inputThread.join();
+
+	if (loopbackServer) {
+		loopbackServer->stop();
+	}
+	for (LoopbackServer* server : mosaicServers) {
+		server->stop();
+	}
+
+	// The pool may still be decoding for a session, it can only stop after all of them
+	for (StreamSession* stream : sessions) {
+		stream->stop();
+	}
+	decodePool.stop();
+
+	if (session->receiver->capture.isOpen()) {
+		session->receiver->capture.close();
+		printf("Packets recorded: %llu, skipped: %llu\n",
+			(unsigned long long)session->receiver->capture.recordedPackets, (unsigned long long)session->receiver->capture.skippedPackets);
+	}
+
+	if (loopbackServer) {
+		if (benchmarkSeconds > 0) {
+			printBenchmarkReport(elapsed);
+		}
+
+		printf("Loopback packets lost: %llu, resent: %llu\n",
+			(unsigned long long)loopbackServer->packetsLost, (unsigned long long)loopbackServer->fragmentsResent);
+		if (requestKeyframes) {
+			printf("Loopback keyframe requests: %llu, keyframes forced: %llu\n",
+				(unsigned long long)loopbackServer->keyframeRequests, (unsigned long long)loopbackServer->keyframesForced);
+		}
+		if (inputChannel) {
+			printf("Loopback input datagrams: %llu, changes applied: %llu, lost: %llu\n",
+				(unsigned long long)loopbackServer->inputPackets, (unsigned long long)loopbackServer->inputEvents,
+				(unsigned long long)loopbackServer->inputGaps);
+		}
+		delete loopbackServer;
+	}
+	for (LoopbackServer* server : mosaicServers) {
+		delete server;
+	}
+
+	JitterBuffer& jitterBuffer = session->receiver->jitterBuffer;
+	printf("Frames late: %llu, dropped: %llu, reordered: %llu, abandoned while streaming: %llu\n",
+		(unsigned long long)jitterBuffer.lateFrames, (unsigned long long)jitterBuffer.droppedFrames, (unsigned long long)jitterBuffer.reorderedFrames,
+		(unsigned long long)jitterBuffer.abandonedFrames);
+	printf("Fragments recovered from parity: %llu\n", (unsigned long long)session->reassembler.recoveredFragments);
+	printf("NACKs sent: %llu, fragments requested: %llu\n",
+		(unsigned long long)session->receiver->nackScheduler.nacksSent, (unsigned long long)session->receiver->nackScheduler.fragmentsRequested);
+
+	const LatencyHistogram& total = session->latencyStats.stages[LatencyStats::TOTAL];
+	printf("Latency p50: %.2f ms, p99: %.2f ms, max: %.2f ms\n",
+		total.percentile(0.5) / 1000.0, total.percentile(0.99) / 1000.0, total.maximum() / 1000.0);
+	printf("Time to first frame: %.1f ms, frames discarded: %llu, concealed: %llu, keyframes requested: %llu\n",
+		session->timeToFirstFrame() / 1000.0, (unsigned long long)session->decoder->discardedFrames,
+		(unsigned long long)session->decoder->concealedFrames, (unsigned long long)session->decoder->keyframeRequester.requestsSent);
+	if (inputChannel) {
+		printf("Input to photon p50: %.2f ms, p99: %.2f ms over %llu changes\n",
+			inputChannel->inputToPhoton.percentile(0.5) / 1000.0, inputChannel->inputToPhoton.percentile(0.99) / 1000.0,
+			(unsigned long long)inputChannel->inputToPhoton.count());
+	}
+	session->latencyStats.closeCsv();
+
+	delete inputChannel;
+	for (StreamSession* stream : sessions) {
+		delete stream;
+	}
 
 	closeRenderer();
 	
@@ -0,0 +1,123 @@
+#include "StreamSession.h"
+#include "Clock.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+StreamSession::StreamSession(int index, const SessionConfig& config)
+	: index(index), config(config) {
+
+	decoder = new FrameDecoder(reassembler, completed, completedSignal);
+	decoder->textures = config.textures;
+	decoder->prewarm = config.prewarmDecoder;
+	decoder->open(config.codecId, config.width, config.height, config.decodeThreadCount, config.decodeThreadType,
+		config.progressiveDecode && !config.pool);
+
+	presentScheduler = new PresentScheduler(*decoder);
+
+	if (!config.replaying) {
+		openSocket();
+	}
+
+	receiver = new FrameReceiver(transport, reassembler, completed, completedSignal);
+	receiver->jitterBuffer.latencyTarget = (uint64_t)config.jitterLatencyMs * 1000;
+	receiver->jitterBuffer.progressive = config.progressiveDecode && !config.pool;
+	receiver->streamId = config.streamId;
+}
+
+StreamSession::~StreamSession() {
+	stop();
+
+	delete receiver;
+	delete transport;
+	delete presentScheduler;
+	delete decoder;
+
+	if (texture) {
+		SDL_DestroyTexture(texture);
+	}
+	if (socket != INVALID_SOCKET) {
+		closeSocket(socket);
+	}
+}
+
+void StreamSession::openSocket() {
+	socket = ::socket(PF_INET, SOCK_DGRAM, 0);
+	if (socket < 0) {
+		printf("Socket init failed: %d\n", socketError());
+		exit(EXIT_FAILURE);
+	}
+
+	sockaddr_in address;
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = config.address;
+	address.sin_port = htons(config.port);
+
+	if (bind(socket, (const sockaddr*)&address, sizeof(address)) != 0) {
+		printf("Socket bind failed: %d\n", socketError());
+		exit(EXIT_FAILURE);
+	}
+
+	transport = Transport::create(socket, config.transport);
+	if (!transport) {
+		printf("Transport %s is not available in this build\n", Transport::typeName(config.transport.type));
+		exit(EXIT_FAILURE);
+	}
+	printf("Receiving with %s on port %d\n", transport->name(), config.port);
+}
+
+void StreamSession::start(CaptureReader* replay, bool replayRealTime) {
+	startTime = nowMicroseconds();
+
+	if (config.pool) {
+		decoding = true;
+		completedSignal.onNotify = [this] { scheduleDecode(); };
+	} else {
+		decoder->start();
+	}
+
+	if (replay) {
+		receiver->startReplay(replay, replayRealTime);
+	} else {
+		receiver->start();
+	}
+}
+
+void StreamSession::stop() {
+	receiver->stop();
+
+	// Let a decode task that is still queued or running finish with the session intact
+	decoding = false;
+	while (decodeScheduled) {
+		std::this_thread::yield();
+	}
+
+	decoder->stop();
+}
+
+uint64_t StreamSession::timeToFirstFrame() const {
+	return firstPresented ? firstPresented - startTime : 0;
+}
+
+uint64_t StreamSession::timeToFirstKeyframe() const {
+	uint64_t keyframe = decoder->firstKeyframe;
+	return keyframe ? keyframe - startTime : 0;
+}
+
+void StreamSession::scheduleDecode() {
+	if (!decoding || decodeScheduled.exchange(true)) {
+		return;
+	}
+
+	config.pool->submit([this] { decodeTask(); }, index);
+}
+
+void StreamSession::decodeTask() {
+	do {
+		decoder->decodeAvailable();
+		decodeTasks++;
+		decodeScheduled = false;
+
+		// A frame completed after the queue was drained, but before the flag was cleared
+	} while (decoding && !completed.empty() && !decodeScheduled.exchange(true));
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+
+#include <SDL.h>
+
+#include "Socket.h"
+#include "Protocol.h"
+#include "FrameReassembler.h"
+#include "FrameReceiver.h"
+#include "FrameDecoder.h"
+#include "PresentScheduler.h"
+#include "LatencyStats.h"
+#include "PacketCapture.h"
+#include "TexturePool.h"
+#include "Transport.h"
+#include "WorkerPool.h"
+
+// Settings of one stream
+struct SessionConfig {
+	// Frames are fed from a capture, no socket is opened
+	bool replaying = false;
+
+	// Where the stream arrives, and the stream taken from v2 senders there
+	u_long address = INADDR_ANY;
+	int port = 8888;
+	uint16_t streamId = 0;
+
+	TransportConfig transport;
+
+	// How long a frame may wait for its missing fragments
+	int jitterLatencyMs = 30;
+
+	AVCodecID codecId = AV_CODEC_ID_MPEG4;
+	int width = 1280;
+	int height = 720;
+
+	// Codec threading, 0 threads for one per core
+	int decodeThreadCount = 0;
+	int decodeThreadType = FF_THREAD_SLICE;
+
+	// Decode frames while their fragments are still arriving, H.264 on a decode thread only
+	bool progressiveDecode = false;
+
+	// Warm the codec up with a picture of the stream's size before the stream arrives
+	bool prewarmDecoder = true;
+
+	// Textures the codec decodes into, NULL to copy every picture
+	TexturePool* textures = NULL;
+
+	// Decode as tasks of this pool instead of on a thread of the session's own
+	WorkerPool* pool = NULL;
+};
+
+// Everything one stream needs on its way from the socket to the screen
+//	Frames are received and reassembled on a thread of the session's own, and decoded
+//	on another or as tasks of a shared pool. The render thread takes the pictures from
+//	the present scheduler and keeps the rest of the session's render state.
+class StreamSession {
+public:
+	const int index;
+	const SessionConfig config;
+
+	FrameReassembler reassembler;
+	CompletedFrameQueue completed;
+	QueueSignal completedSignal;
+
+	// NULL when replaying a capture
+	Transport* transport = NULL;
+
+	FrameReceiver* receiver;
+	FrameDecoder* decoder;
+	PresentScheduler* presentScheduler;
+
+	// Where time goes between the first fragment and the screen
+	LatencyStats latencyStats;
+
+	// Render thread only, the game state of the last picture presented
+	UDPRecvGameInfo latestGameInfo = UDPRecvGameInfo();
+
+	// Texture the stream is shown from in a mosaic, render thread only
+	SDL_Texture* texture = NULL;
+	int textureWidth = 0;
+	int textureHeight = 0;
+
+	// Decode tasks run on the pool
+	std::atomic<uint64_t> decodeTasks{ 0 };
+
+	// When the session started and when it presented its first picture, 0 until then
+	//	Frames without a reference are discarded, so the first picture shown is a clean one.
+	uint64_t startTime = 0;
+	uint64_t firstPresented = 0;
+
+	// Binds the socket unless replaying, sockets must be initialised
+	StreamSession(int index, const SessionConfig& config);
+	~StreamSession();
+
+	// Start receiving from the socket, or from the capture if one is given
+	void start(CaptureReader* replay, bool replayRealTime);
+	void stop();
+
+	// From starting to the first picture presented, 0 until there was one
+	uint64_t timeToFirstFrame() const;
+
+	// From starting to the first keyframe going to the codec, 0 until there was one
+	uint64_t timeToFirstKeyframe() const;
+
+private:
+	SOCKET socket = INVALID_SOCKET;
+
+	// Bind the socket and set up the transport
+	void openSocket();
+
+	// At most one decode task is queued or running, so frames are decoded in order
+	std::atomic<bool> decodeScheduled{ false };
+	std::atomic<bool> decoding{ false };
+
+	// Called by the receive thread for every frame it completes
+	void scheduleDecode();
+	void decodeTask();
+};
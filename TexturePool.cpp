@@ -0,0 +1,228 @@
+#include "TexturePool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern "C" {
+	#include "libavutil/cpu.h"
+}
+
+// Texture size for pictures of the given size
+//	Whole chroma rows of 64 byte multiples, and room below the picture for the
+//	codec's own alignment and the rows its motion compensation reads past the end.
+static int paddedWidth(int width) {
+	return (width + 127) & ~127;
+}
+
+static int paddedHeight(int height) {
+	return (((height + 31) & ~31) + 4 + 63) & ~63;
+}
+
+TexturePool::TexturePool() {
+	for (int i = 0; i < MAX_TEXTURES; i++) {
+		entries[i].state.store(EMPTY);
+		entries[i].texture = NULL;
+		entries[i].width = 0;
+		entries[i].height = 0;
+		entries[i].locked = false;
+		entries[i].size = 0;
+		memset(entries[i].planes, 0, sizeof(entries[i].planes));
+		memset(entries[i].pitches, 0, sizeof(entries[i].pitches));
+	}
+}
+
+bool TexturePool::create(SDL_Renderer* renderer, int count, int width, int height) {
+	this->renderer = renderer;
+	frameWidth = width;
+	frameHeight = height;
+
+	if (count > MAX_TEXTURES) {
+		count = MAX_TEXTURES;
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (!prepare(entries[i])) {
+			printf("Texture to decode into could not be created: %s\n", SDL_GetError());
+			destroy();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void TexturePool::destroy() {
+	for (int i = 0; i < MAX_TEXTURES; i++) {
+		if (entries[i].texture) {
+			SDL_DestroyTexture(entries[i].texture);
+		}
+
+		entries[i].state.store(EMPTY);
+		entries[i].texture = NULL;
+		entries[i].locked = false;
+	}
+
+	displayed = NULL;
+}
+
+// Create the entry's texture at the current size if needed and lock it for the codec
+bool TexturePool::prepare(Entry& entry) {
+	int width = paddedWidth(frameWidth);
+	int height = paddedHeight(frameHeight);
+
+	if (!entry.texture || entry.width != width || entry.height != height) {
+		if (entry.texture) {
+			SDL_DestroyTexture(entry.texture);
+		}
+
+		entry.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_IYUV, SDL_TEXTUREACCESS_STREAMING, width, height);
+		entry.width = width;
+		entry.height = height;
+		entry.locked = false;
+		if (!entry.texture) {
+			return false;
+		}
+	}
+
+	if (!entry.locked) {
+		void* pixels;
+		int pitch;
+		if (SDL_LockTexture(entry.texture, NULL, &pixels, &pitch) != 0) {
+			return false;
+		}
+
+		entry.locked = true;
+		entry.planes[0] = (uint8_t*)pixels;
+		entry.planes[1] = entry.planes[0] + pitch * height;
+		entry.planes[2] = entry.planes[1] + (pitch / 2) * (height / 2);
+		entry.pitches[0] = pitch;
+		entry.pitches[1] = pitch / 2;
+		entry.pitches[2] = pitch / 2;
+		entry.size = pitch * height + 2 * (pitch / 2) * (height / 2);
+	}
+
+	entry.state.store(AVAILABLE, std::memory_order_release);
+	return true;
+}
+
+bool TexturePool::attach(AVCodecContext* context, AVFrame* frame) {
+	if (frame->format != AV_PIX_FMT_YUV420P) {
+		return false;
+	}
+
+	// What the codec needs around the picture, as its own buffers would provide
+	int width = frame->width;
+	int height = frame->height;
+	int linesizeAlign[AV_NUM_DATA_POINTERS];
+	avcodec_align_dimensions2(context, &width, &height, linesizeAlign);
+	size_t pointerAlign = av_cpu_max_align();
+
+	for (int i = 0; i < MAX_TEXTURES; i++) {
+		Entry& entry = entries[i];
+
+		int expected = AVAILABLE;
+		if (entry.state.load(std::memory_order_relaxed) != AVAILABLE
+			|| !entry.state.compare_exchange_strong(expected, DECODING, std::memory_order_acquire)) {
+			continue;
+		}
+
+		// Chroma rows below the picture take the codec's overreads
+		bool fits = entry.pitches[0] >= width && entry.height >= height + 2;
+		for (int plane = 0; plane < 3; plane++) {
+			fits &= entry.pitches[plane] % linesizeAlign[plane] == 0 && (uintptr_t)entry.planes[plane] % pointerAlign == 0;
+		}
+
+		if (fits) {
+			frame->buf[0] = av_buffer_create(entry.planes[0], entry.size, releaseBuffer, &entry, 0);
+		}
+
+		if (!fits || !frame->buf[0]) {
+			entry.state.store(AVAILABLE, std::memory_order_release);
+			return false;
+		}
+
+		for (int plane = 0; plane < 3; plane++) {
+			frame->data[plane] = entry.planes[plane];
+			frame->linesize[plane] = entry.pitches[plane];
+		}
+		frame->extended_data = frame->data;
+
+		return true;
+	}
+
+	return false;
+}
+
+void TexturePool::releaseBuffer(void* opaque, uint8_t* data) {
+	Entry* entry = (Entry*)opaque;
+	entry->state.store(RELEASED, std::memory_order_release);
+}
+
+SDL_Texture* TexturePool::present(const AVFrame* frame) {
+
+	// Build for the stream's new size once the textures are free
+	if (renderer && (frame->width != frameWidth || frame->height != frameHeight)) {
+		frameWidth = frame->width;
+		frameHeight = frame->height;
+	}
+
+	for (int i = 0; i < MAX_TEXTURES; i++) {
+		Entry& entry = entries[i];
+		if (entry.texture && entry.locked && entry.planes[0] == frame->data[0]) {
+
+			// The codec may still read it, with frame threads, and the pixels go away on unlocking
+			if (av_buffer_get_ref_count(frame->buf[0]) > 1) {
+				break;
+			}
+
+			// Uploads the picture, nothing reads the pixels after this
+			SDL_UnlockTexture(entry.texture);
+			entry.locked = false;
+			displayed = &entry;
+			directFrames++;
+
+			return entry.texture;
+		}
+	}
+
+	copiedFrames++;
+	return NULL;
+}
+
+void TexturePool::relock() {
+	if (!renderer) {
+		return;
+	}
+
+	int width = paddedWidth(frameWidth);
+	int height = paddedHeight(frameHeight);
+
+	for (int i = 0; i < MAX_TEXTURES; i++) {
+		Entry& entry = entries[i];
+		if (!entry.texture) {
+			continue;
+		}
+
+		int state = entry.state.load(std::memory_order_acquire);
+		bool resized = entry.width != width || entry.height != height;
+
+		// In use, ready to use, or on screen and redrawn until the next picture replaces it
+		if (state == DECODING || (state == AVAILABLE && !resized) || &entry == displayed) {
+			continue;
+		}
+
+		// The codec may have taken it in the meantime
+		if (!entry.state.compare_exchange_strong(state, EMPTY, std::memory_order_acquire)) {
+			continue;
+		}
+
+		// Leave it out for good rather than retry every frame
+		if (!prepare(entry)) {
+			printf("Texture to decode into could not be locked: %s\n", SDL_GetError());
+			SDL_DestroyTexture(entry.texture);
+			entry.texture = NULL;
+			entry.locked = false;
+		}
+	}
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+extern "C" {
+	#include "libavcodec/avcodec.h"
+	#include "libavutil/frame.h"
+}
+
+#include <SDL.h>
+
+// Streaming textures the decoder writes pictures into, so they don't have to be copied
+//	A texture is locked while the codec may take it, and only pictures the codec won't
+//	refer to again get one. References stay in the codec's own buffers, as the pixels of
+//	a locked texture are only to be written and are gone once it is unlocked. Presenting
+//	a picture unlocks its texture, which uploads it, once the codec has let go of it.
+//	Pictures that don't get a texture, or that the codec still holds, are copied as before.
+class TexturePool {
+public:
+	static const int MAX_TEXTURES = 3;
+
+	// Pictures presented straight from the texture they were decoded into, and ones that were copied
+	std::atomic<uint64_t> directFrames{ 0 };
+	std::atomic<uint64_t> copiedFrames{ 0 };
+
+	TexturePool();
+
+	TexturePool(const TexturePool&) = delete;
+	TexturePool& operator=(const TexturePool&) = delete;
+
+	// Create and lock count textures for pictures of the given size, render thread only
+	//	Returns false if the renderer can't be decoded into, the pool then stays empty.
+	bool create(SDL_Renderer* renderer, int count, int width, int height);
+	void destroy();
+
+	// Point the frame at a free texture, from get_buffer2 on any codec thread
+	//	Only for pictures get_buffer2 was asked for without AV_GET_BUFFER_FLAG_REF. Returns
+	//	false if none is free, or the picture doesn't fit one or its pixels aren't aligned.
+	bool attach(AVCodecContext* context, AVFrame* frame);
+
+	// Texture the picture was decoded into, unlocked and ready to draw, NULL if it has to be copied
+	//	The frame's must be the only reference left. Render thread only.
+	SDL_Texture* present(const AVFrame* frame);
+
+	// Lock textures the codec and screen are done with again, once the picture is recycled
+	//	Textures are recreated here when the stream changes size. Render thread only.
+	void relock();
+
+private:
+	enum State {
+		EMPTY,		// No usable texture, only the render thread touches it
+		AVAILABLE,	// Locked, the codec may take it
+		DECODING,	// Holds a picture the codec or renderer still refers to
+		RELEASED	// Codec and renderer are done with it, waiting to be locked again
+	};
+
+	struct Entry {
+		std::atomic<int> state;
+		SDL_Texture* texture;
+		int width;
+		int height;
+
+		// Locked pixels, IYUV planes one after the other
+		bool locked;
+		uint8_t* planes[3];
+		int pitches[3];
+		int size;
+	};
+
+	SDL_Renderer* renderer = NULL;
+	Entry entries[MAX_TEXTURES];
+
+	// Size of the pictures the textures are made for
+	int frameWidth = 0;
+	int frameHeight = 0;
+
+	// Unlocked and on screen
+	Entry* displayed = NULL;
+
+	bool prepare(Entry& entry);
+
+	// Called by libavcodec once it holds no more references to a picture
+	static void releaseBuffer(void* opaque, uint8_t* data);
+};
@@ -0,0 +1,65 @@
+#include "Transport.h"
+#include "BlockingTransport.h"
+#include "EpollTransport.h"
+#include "IoUringTransport.h"
+
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+Transport* Transport::create(SOCKET socket, const TransportConfig& config) {
+	switch (config.type) {
+	case TRANSPORT_BLOCKING:
+		return new BlockingTransport(socket, config);
+#ifdef __linux__
+	case TRANSPORT_EPOLL:
+		return new EpollTransport(socket, config);
+#ifdef USE_LIBURING
+	case TRANSPORT_IO_URING:
+		return new IoUringTransport(socket, config);
+#endif
+#endif
+	default:
+		return NULL;
+	}
+}
+
+const char* Transport::typeName(TransportType type) {
+	switch (type) {
+	case TRANSPORT_BLOCKING:
+		return "blocking";
+	case TRANSPORT_EPOLL:
+		return "epoll";
+	case TRANSPORT_IO_URING:
+		return "io_uring";
+	default:
+		return "unknown";
+	}
+}
+
+void Transport::configureSocket(SOCKET socket, const TransportConfig& config, bool blocking) {
+	int bufferSize = config.receiveBufferSize;
+	setsockopt(socket, SOL_SOCKET, SO_RCVBUF, (const char*)&bufferSize, sizeof(bufferSize));
+
+	// Wake up periodically so the receive thread can stop and check deadlines
+	if (blocking) {
+#ifdef _WIN32
+		DWORD timeout = config.timeoutMs;
+#else
+		timeval timeout = { config.timeoutMs / 1000, (config.timeoutMs % 1000) * 1000 };
+#endif
+		setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+	}
+
+#ifdef __linux__
+	// Raising it above net.core.busy_read needs CAP_NET_ADMIN
+	if (config.busyPollMicroseconds > 0) {
+		int busyPoll = config.busyPollMicroseconds;
+		if (setsockopt(socket, SOL_SOCKET, SO_BUSY_POLL, &busyPoll, sizeof(busyPoll)) != 0) {
+			printf("Busy polling not enabled: %d\n", socketError());
+		}
+	}
+#endif
+}
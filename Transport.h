@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Socket.h"
+#include "Protocol.h"
+
+// How datagrams are taken from the receive socket
+enum TransportType {
+	TRANSPORT_BLOCKING,	// Blocking batched receive, recvmmsg on Linux, recvfrom elsewhere
+	TRANSPORT_EPOLL,	// Non-blocking batched receive woken by epoll, Linux only
+	TRANSPORT_IO_URING	// Multishot receive into a registered buffer ring, Linux with liburing only
+};
+
+struct TransportConfig {
+	TransportType type = TRANSPORT_BLOCKING;
+
+	// Longest a receive call waits for the first datagram
+	int timeoutMs = 10;
+
+	// Kernel receive buffer, large enough to absorb a burst of keyframes while the thread is descheduled
+	int receiveBufferSize = 4 * 1024 * 1024;
+
+	// Poll the device queue for this long before sleeping, 0 leaves it off, Linux only
+	int busyPollMicroseconds = 0;
+
+	// Let the kernel coalesce datagrams into one receive, Linux epoll only
+	bool gro = false;
+};
+
+// Source of received datagrams for the receive thread
+class Transport {
+public:
+	virtual ~Transport() {}
+
+	virtual const char* name() const = 0;
+
+	// Whether payloads land where the caller asks, otherwise the transport picks the place
+	virtual bool placesPayloads() const = 0;
+
+	// Wait up to the timeout for a datagram, then take whatever else is queued, up to count
+	//	The first headerSize bytes of each datagram are written to packets. The rest goes
+	//	to where payloads points if the transport places payloads, cut short at the room
+	//	lengths holds for it. Otherwise payloads is pointed at where it is. Either way it
+	//	stays valid until the next call. Datagram lengths are returned in lengths.
+	//	Returns the count, 0 on timeout.
+	virtual int receive(UDPRecvPacket* packets, int headerSize, char** payloads, int* lengths, int count) = 0;
+
+	// Backend for the given configuration on the bound socket, NULL if it isn't available here
+	static Transport* create(SOCKET socket, const TransportConfig& config);
+
+	static const char* typeName(TransportType type);
+
+protected:
+	// Buffer size and busy polling, plus the receive timeout if the socket stays blocking
+	static void configureSocket(SOCKET socket, const TransportConfig& config, bool blocking);
+};
@@ -0,0 +1,110 @@
+#include "WorkerPool.h"
+
+WorkerPool::~WorkerPool() {
+	stop();
+}
+
+void WorkerPool::start(int threadCount) {
+	if (threadCount <= 0) {
+		threadCount = (int)std::thread::hardware_concurrency();
+	}
+	if (threadCount <= 0) {
+		threadCount = 1;
+	}
+
+	workerCount = threadCount;
+	workers = new Worker[workerCount];
+
+	running = true;
+	for (int i = 0; i < workerCount; i++) {
+		workers[i].thread = std::thread(&WorkerPool::workerLoop, this, i);
+	}
+}
+
+void WorkerPool::stop() {
+	if (!workers) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		running = false;
+	}
+	idle.notify_all();
+
+	for (int i = 0; i < workerCount; i++) {
+		if (workers[i].thread.joinable()) {
+			workers[i].thread.join();
+		}
+	}
+
+	delete[] workers;
+	workers = NULL;
+	workerCount = 0;
+}
+
+int WorkerPool::threadCount() const {
+	return workerCount;
+}
+
+void WorkerPool::submit(const Task& task, int hint) {
+	Worker& worker = workers[(unsigned)hint % workerCount];
+	{
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(task);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(idleMutex);
+		pending++;
+	}
+	idle.notify_one();
+}
+
+bool WorkerPool::take(int index, Task& task) {
+	{
+		Worker& own = workers[index];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			pending--;
+			return true;
+		}
+	}
+
+	for (int i = 1; i < workerCount; i++) {
+		Worker& victim = workers[(index + i) % workerCount];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			pending--;
+			tasksStolen++;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WorkerPool::workerLoop(int index) {
+	Task task;
+
+	while (true) {
+		if (take(index, task)) {
+			task();
+			task = nullptr;
+			tasksRun++;
+			continue;
+		}
+
+		// Drained, nothing is left to finish
+		if (!running) {
+			break;
+		}
+
+		std::unique_lock<std::mutex> lock(idleMutex);
+		idle.wait_for(lock, std::chrono::milliseconds(IDLE_WAIT_MS), [this] { return pending > 0 || !running; });
+	}
+}
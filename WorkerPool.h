@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <stdint.h>
+
+// Runs short tasks on a fixed set of threads, idle threads steal from busy ones
+//	Every worker has a deque of its own. Submitted tasks go to the worker the caller
+//	hints at, so the work of one stream tends to stay on one core with its codec's
+//	state in cache. Workers take their own newest task first and otherwise steal the
+//	oldest task of another worker. Tasks must not block.
+class WorkerPool {
+public:
+	typedef std::function<void()> Task;
+
+	// Tasks run, and how many of them were stolen from another worker
+	std::atomic<uint64_t> tasksRun{ 0 };
+	std::atomic<uint64_t> tasksStolen{ 0 };
+
+	~WorkerPool();
+
+	// Start the workers, 0 for one per core
+	void start(int threadCount);
+
+	// Finish the tasks already submitted and stop the workers
+	void stop();
+
+	int threadCount() const;
+
+	// Any thread, hint picks the worker whose deque the task goes to
+	void submit(const Task& task, int hint);
+
+private:
+	// Longest a worker sleeps before it looks for work to steal again
+	static const int IDLE_WAIT_MS = 10;
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::thread thread;
+	};
+
+	Worker* workers = NULL;
+	int workerCount = 0;
+
+	std::atomic<bool> running{ false };
+
+	// Tasks submitted and not yet taken, idle workers sleep while there are none
+	std::atomic<int> pending{ 0 };
+	std::mutex idleMutex;
+	std::condition_variable idle;
+
+	void workerLoop(int index);
+
+	// Own newest task, or the oldest one of the next worker that has any
+	bool take(int index, Task& task);
+};
@@ -4,109 +4,325 @@
 
 #include "imgui/imgui.h"
 
-#include <map>
-#include <list>
 #include <cmath>
+#include <cstring>
 #include <array>
 #include <vector>
 #include <memory>
 #include <iostream>
 #include <algorithm>
-#include <functional>
-#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMGUI_SDL_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMGUI_SDL_NEON
+#endif
 
 namespace
 {
 	struct Device* CurrentDevice = nullptr;
 
-	namespace TupleHash
+	// Cheap 64 bit hash, good enough to tell cache keys and draw data apart.
+	uint64_t HashBytes(uint64_t seed, const void* data, std::size_t size)
 	{
-		template <typename T> struct Hash
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+		uint64_t hash = seed ^ (size * 0x9E3779B97F4A7C15ull);
+
+		for (; size >= sizeof(uint64_t); bytes += sizeof(uint64_t), size -= sizeof(uint64_t))
 		{
-			std::size_t operator()(const T& value) const
-			{
-				return std::hash<T>()(value);
-			}
-		};
+			uint64_t word;
+			std::memcpy(&word, bytes, sizeof(word));
+			hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+			hash ^= hash >> 32;
+		}
+
+		for (; size > 0; bytes++, size--)
+		{
+			hash = (hash ^ *bytes) * 0x100000001B3ull;
+		}
+
+		return hash;
+	}
+
+	// A triangle rasterized once, and drawn by copying its texture from then on.
+	struct CachedTriangle
+	{
+		SDL_Texture* Texture = nullptr;
+		int Width = 0, Height = 0;
+	};
+
+	// Keeps the textures of recently drawn triangles, keyed on integers that describe a triangle fully.
+	// The entries live in one array that a CLOCK hand sweeps to pick what to evict: entries hit since the hand last passed them
+	// are spared once. They're found through an open addressing table of indices kept at most half full, so a lookup hashes
+	// the key once and mostly looks at a single slot.
+	template <std::size_t KeySize> class TriangleCache
+	{
+	public:
+		using Key = std::array<int32_t, KeySize>;
+
+		uint64_t Hits = 0, Misses = 0, Evictions = 0;
+
+		explicit TriangleCache(std::size_t capacity) { SetCapacity(capacity); }
+		~TriangleCache() { Clear(); }
+
+		TriangleCache(const TriangleCache&) = delete;
+		TriangleCache& operator=(const TriangleCache&) = delete;
+
+		std::size_t Size() const { return Count; }
+		std::size_t Capacity() const { return Entries.size(); }
+
+		static uint64_t Hash(const Key& key) { return HashBytes(0, key.data(), sizeof(Key)); }
+
+		// Drops everything cached and makes room for the given number of triangles.
+		void SetCapacity(std::size_t capacity)
+		{
+			Clear();
+			if (capacity < 1) capacity = 1;
 
-		template <typename T> void CombineHash(std::size_t& seed, const T& value)
+			std::size_t slots = 4;
+			while (slots < capacity * 2) slots *= 2;
+
+			Entries.assign(capacity, Entry());
+			Slots.assign(slots, EmptySlot);
+			Mask = slots - 1;
+		}
+
+		void Clear()
 		{
-			seed ^= TupleHash::Hash<T>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+			for (std::size_t i = 0; i < Count; i++) SDL_DestroyTexture(Entries[i].Triangle.Texture);
+			std::fill(Slots.begin(), Slots.end(), EmptySlot);
+			Count = 0;
+			Hand = 0;
 		}
 
-		template <typename Tuple, std::size_t Index = std::tuple_size<Tuple>::value - 1> struct Hasher
+		// The cached triangle for the key, or null if it has to be rasterized.
+		const CachedTriangle* Find(const Key& key, uint64_t hash)
 		{
-			static void Hash(std::size_t& seed, const Tuple& tuple)
+			for (std::size_t slot = hash & Mask; Slots[slot] != EmptySlot; slot = (slot + 1) & Mask)
 			{
-				Hasher<Tuple, Index - 1>::Hash(seed, tuple);
-				CombineHash(seed, std::get<Index>(tuple));
+				Entry& entry = Entries[Slots[slot]];
+				if (entry.Hash == hash && entry.Id == key)
+				{
+					entry.Referenced = true;
+					Hits++;
+					return &entry.Triangle;
+				}
 			}
+
+			Misses++;
+			return nullptr;
+		}
+
+		// Takes over the triangle's texture. The key must not be cached yet.
+		void Insert(const Key& key, uint64_t hash, const CachedTriangle& triangle)
+		{
+			const uint32_t index = Count < Entries.size() ? static_cast<uint32_t>(Count++) : Evict();
+
+			Entry& entry = Entries[index];
+			entry.Id = key;
+			entry.Hash = hash;
+			entry.Triangle = triangle;
+			entry.Referenced = false;
+
+			std::size_t slot = hash & Mask;
+			while (Slots[slot] != EmptySlot) slot = (slot + 1) & Mask;
+			Slots[slot] = index;
+		}
+	private:
+		static constexpr uint32_t EmptySlot = 0xffffffff;
+
+		struct Entry
+		{
+			Key Id;
+			uint64_t Hash = 0;
+			CachedTriangle Triangle;
+			bool Referenced = false;
 		};
 
-		template <typename Tuple> struct Hasher<Tuple, 0>
+		std::vector<Entry> Entries;
+		std::vector<uint32_t> Slots;
+		std::size_t Mask = 0, Count = 0, Hand = 0;
+
+		// Frees the first entry the hand comes across that wasn't hit since it last came by, and returns its index.
+		uint32_t Evict()
 		{
-			static void Hash(std::size_t& seed, const Tuple& tuple)
+			while (Entries[Hand].Referenced)
 			{
-				CombineHash(seed, std::get<0>(tuple));
+				Entries[Hand].Referenced = false;
+				Hand = (Hand + 1) % Entries.size();
 			}
-		};
 
-		template <typename... T> struct Hash<std::tuple<T...>>
+			const uint32_t index = static_cast<uint32_t>(Hand);
+			Hand = (Hand + 1) % Entries.size();
+
+			SDL_DestroyTexture(Entries[index].Triangle.Texture);
+			Unlink(index, Entries[index].Hash);
+			Evictions++;
+
+			return index;
+		}
+
+		// Takes the entry out of the table. Later entries of its run move back into the hole, unless that would put them
+		// before the slot they hash to, so lookups keep finding them without tombstones.
+		void Unlink(uint32_t index, uint64_t hash)
 		{
-			std::size_t operator()(const std::tuple<T...>& value) const
+			std::size_t hole = hash & Mask;
+			while (Slots[hole] != index) hole = (hole + 1) & Mask;
+
+			for (std::size_t slot = (hole + 1) & Mask; Slots[slot] != EmptySlot; slot = (slot + 1) & Mask)
 			{
-				std::size_t seed = 0;
-				Hasher<std::tuple<T...>>::Hash(seed, value);
-				return seed;
+				const std::size_t home = Entries[Slots[slot]].Hash & Mask;
+				if (((slot - home) & Mask) >= ((slot - hole) & Mask))
+				{
+					Slots[hole] = Slots[slot];
+					hole = slot;
+				}
 			}
-		};
-	}
 
-	template <typename Key, typename Value, std::size_t Size> class LRUCache
+			Slots[hole] = EmptySlot;
+		}
+	};
+
+	template <std::size_t KeySize> constexpr uint32_t TriangleCache<KeySize>::EmptySlot;
+
+	// Collects what Render draws into runs that share all renderer state, so each run takes a single call or a single state change.
+	// A rectangle joins an earlier run of its kind if nothing queued after that run overlaps it, so whatever ends up on top stays the same.
+	class Batcher
 	{
 	public:
-		bool Contains(const Key& key) const
+		// Primitives queued, what they would have taken one call each, and the calls and state changes they took instead.
+		int Primitives = 0, DrawCalls = 0, StateChanges = 0;
+
+		explicit Batcher(SDL_Renderer* renderer) : Renderer(renderer) { }
+
+		void Fill(const SDL_Rect& destination, uint32_t color)
 		{
-			return Container.find(key) != Container.end();
+			Queue(nullptr, color, SDL_Rect{ }, destination, SDL_FLIP_NONE);
 		}
 
-		const Value& At(const Key& key)
+		// The color mod only applies to the color channels, as with the renderer's own.
+		void Copy(SDL_Texture* texture, uint32_t colorMod, const SDL_Rect& source, const SDL_Rect& destination, SDL_RendererFlip flip)
 		{
-			assert(Contains(key));
-
-			const auto location = Container.find(key);
-			Order.splice(Order.begin(), Order, location->second);
-			return location->second->second;
+			Queue(texture, colorMod | 0xff000000, source, destination, flip);
 		}
 
-		void Insert(const Key& key, Value value)
+		// Draws everything queued. Call this before anything else changes what's on the render target or how it's clipped.
+		void Flush()
 		{
-			const auto existingLocation = Container.find(key);
-			if (existingLocation != Container.end())
+			if (Items.empty()) return;
+
+			// Orders the items by run, keeping their order within each.
+			Offsets.assign(Runs.size() + 1, 0);
+			for (const Item& item : Items) Offsets[item.Run + 1]++;
+			for (std::size_t run = 0; run < Runs.size(); run++) Offsets[run + 1] += Offsets[run];
+
+			Sorted.resize(Items.size());
+			for (const Item& item : Items) Sorted[Offsets[item.Run]++] = item;
+
+			std::size_t begin = 0;
+			for (const Run& run : Runs)
 			{
-				Order.erase(existingLocation->second);
-				Container.erase(existingLocation);
-			}
+				const std::size_t end = begin + run.Count;
+
+				if (!run.Texture)
+				{
+					SDL_SetRenderDrawColor(Renderer, run.Color & 0xff, (run.Color >> 8) & 0xff, (run.Color >> 16) & 0xff, run.Color >> 24);
+					StateChanges++;
+
+					Rects.clear();
+					for (std::size_t i = begin; i < end; i++) Rects.push_back(Sorted[i].Destination);
 
-			Order.push_front(std::make_pair(key, std::move(value)));
-			Container.insert(std::make_pair(key, Order.begin()));
+					SDL_RenderFillRects(Renderer, Rects.data(), static_cast<int>(Rects.size()));
+					DrawCalls++;
+				}
+				else
+				{
+					const Uint8 r = run.Color & 0xff, g = (run.Color >> 8) & 0xff, b = (run.Color >> 16) & 0xff;
+					Uint8 currentR, currentG, currentB;
+					SDL_GetTextureColorMod(run.Texture, &currentR, &currentG, &currentB);
+					if (currentR != r || currentG != g || currentB != b)
+					{
+						SDL_SetTextureColorMod(run.Texture, r, g, b);
+						StateChanges++;
+					}
+
+					for (std::size_t i = begin; i < end; i++)
+					{
+						const Item& item = Sorted[i];
+						if (item.Flip == SDL_FLIP_NONE)
+						{
+							SDL_RenderCopy(Renderer, run.Texture, &item.Source, &item.Destination);
+						}
+						else
+						{
+							SDL_RenderCopyEx(Renderer, run.Texture, &item.Source, &item.Destination, 0.0, nullptr, item.Flip);
+						}
+						DrawCalls++;
+					}
+				}
+
+				begin = end;
+			}
 
-			Clean();
+			Items.clear();
+			Runs.clear();
 		}
 	private:
-		void Clean()
+		// How many runs back a rectangle looks for one to join.
+		static constexpr std::size_t Lookback = 16;
+
+		struct Item
+		{
+			SDL_Rect Source, Destination;
+			SDL_RendererFlip Flip;
+			std::size_t Run;
+		};
+
+		struct Run
+		{
+			SDL_Texture* Texture;
+			uint32_t Color;
+			SDL_Rect Bounds;
+			std::size_t Count;
+		};
+
+		SDL_Renderer* Renderer;
+		std::vector<Item> Items, Sorted;
+		std::vector<Run> Runs;
+		std::vector<std::size_t> Offsets;
+		std::vector<SDL_Rect> Rects;
+
+		void Queue(SDL_Texture* texture, uint32_t color, const SDL_Rect& source, const SDL_Rect& destination, SDL_RendererFlip flip)
 		{
-			while (Container.size() > Size)
+			Primitives++;
+
+			std::size_t target = Runs.size();
+			for (std::size_t run = Runs.size(); run > 0 && Runs.size() - run < Lookback; run--)
 			{
-				auto last = Order.end();
-				last--;
-				Container.erase(last->first);
-				Order.pop_back();
+				const Run& candidate = Runs[run - 1];
+				if (candidate.Texture == texture && candidate.Color == color)
+				{
+					target = run - 1;
+					break;
+				}
+
+				if (SDL_HasIntersection(&candidate.Bounds, &destination)) break;
+			}
+
+			if (target == Runs.size())
+			{
+				Runs.push_back(Run{ texture, color, destination, 0 });
+			}
+			else
+			{
+				SDL_UnionRect(&Runs[target].Bounds, &destination, &Runs[target].Bounds);
 			}
-		}
 
-		std::list<std::pair<Key, Value>> Order;
-		std::unordered_map<Key, decltype(Order.begin()), TupleHash::Hash<Key>> Container;
+			Runs[target].Count++;
+			Items.push_back(Item{ source, destination, flip, target });
+		}
 	};
 
 	struct Color
@@ -148,62 +364,51 @@ namespace
 			int X, Y, Width, Height;
 		} Clip;
 
-		struct TriangleCacheItem
-		{
-			SDL_Texture* Texture = nullptr;
-			int Width = 0, Height = 0;
-
-			~TriangleCacheItem() { if (Texture) SDL_DestroyTexture(Texture); }
-		};
-
-		// You can tweak these to values that you find that work the best.
+		// Defaults, SetTriangleCacheCapacity sizes the caches for a particular overlay.
 		static constexpr std::size_t UniformColorTriangleCacheSize = 512;
 		static constexpr std::size_t GenericTriangleCacheSize = 64;
 
-		// Uniform color is identified by its color and the coordinates of the edges.
-		using UniformColorTriangleKey = std::tuple<uint32_t, int, int, int, int, int, int>;
+		// Uniform color is identified by its color and the coordinates of the corners, relative to the bounding box.
+		TriangleCache<7> UniformColorTriangleCache{ UniformColorTriangleCacheSize };
 		// The generic triangle cache unfortunately has to be basically a full representation of the triangle.
-		// This includes the (offset) vertex positions, texture coordinates and vertex colors.
-		using GenericTriangleVertexKey = std::tuple<int, int, double, double, uint32_t>;
-		using GenericTriangleKey = std::tuple<GenericTriangleVertexKey, GenericTriangleVertexKey, GenericTriangleVertexKey>;
+		// For each vertex that is the offset position, the texture coordinates quantized to 1/65536, and the color.
+		TriangleCache<15> GenericTriangleCache{ GenericTriangleCacheSize };
 
-		LRUCache<UniformColorTriangleKey, std::unique_ptr<TriangleCacheItem>, UniformColorTriangleCacheSize> UniformColorTriangleCache;
-		LRUCache<GenericTriangleKey, std::unique_ptr<TriangleCacheItem>, GenericTriangleCacheSize> GenericTriangleCache;
+		// Scratch pixels triangles are rasterized into before they are uploaded.
+		std::vector<uint32_t> Pixels;
 
-		Device(SDL_Renderer* renderer) : Renderer(renderer) { }
+		// The whole overlay as last drawn by RenderCached, and the draw data it was drawn from.
+		SDL_Texture* Layer = nullptr;
+		int LayerWidth = 0, LayerHeight = 0;
+		uint64_t LayerHash = 0;
+
+		// Everything Render draws goes through here.
+		Batcher Batch;
+
+		Device(SDL_Renderer* renderer) : Renderer(renderer), Batch(renderer) { }
+
+		~Device() { if (Layer) SDL_DestroyTexture(Layer); }
 
 		void SetClipRect(const ClipRect& rect)
 		{
+			Batch.Flush();
 			Clip = rect;
 			const SDL_Rect clip = { rect.X, rect.Y, rect.Width, rect.Height };
 			SDL_RenderSetClipRect(Renderer, &clip);
 		}
 
-		void EnableClip() { SetClipRect(Clip); }
 		void DisableClip() { SDL_RenderSetClipRect(Renderer, nullptr); }
 
-		void SetAt(int x, int y, const Color& color)
+		// Uploads the given pixels into a new texture, which is filled once and only ever copied from.
+		SDL_Texture* MakeTexture(int width, int height, const uint32_t* pixels, int pitch)
 		{
-			color.UseAsDrawColor(Renderer);
-			SDL_RenderDrawPoint(Renderer, x, y);
-		}
+			SDL_Texture* texture = SDL_CreateTexture(Renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC, width, height);
+			if (!texture) return nullptr;
 
-		SDL_Texture* MakeTexture(int width, int height)
-		{
-			SDL_Texture* texture = SDL_CreateTexture(Renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, width, height);
 			SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+			SDL_UpdateTexture(texture, nullptr, pixels, pitch * static_cast<int>(sizeof(uint32_t)));
 			return texture;
 		}
-
-		void UseAsRenderTarget(SDL_Texture* texture)
-		{
-			SDL_SetRenderTarget(Renderer, texture);
-			if (texture)
-			{
-				SDL_SetRenderDrawColor(Renderer, 0, 0, 0, 0);
-				SDL_RenderClear(Renderer);
-			}
-		}
 	};
 
 	struct Texture
@@ -211,12 +416,60 @@ namespace
 		SDL_Surface* Surface;
 		SDL_Texture* Source;
 
+		// Copies of the texture with the color mod applied, for the few colors text comes in. Others use the color mod.
+		static constexpr std::size_t MaxTints = 8;
+		std::vector<std::pair<uint32_t, SDL_Texture*>> Tints;
+
 		~Texture()
 		{
+			for (const auto& tint : Tints) SDL_DestroyTexture(tint.second);
 			SDL_FreeSurface(Surface);
 			SDL_DestroyTexture(Source);
 		}
 
+		// The texture to copy from with the given color mod, and the color mod that's left to apply.
+		SDL_Texture* Tinted(uint32_t& colorMod)
+		{
+			colorMod &= 0x00ffffff;
+			if (colorMod == 0x00ffffff) return Source;
+
+			for (const auto& tint : Tints)
+			{
+				if (tint.first == colorMod)
+				{
+					colorMod = 0x00ffffff;
+					return tint.second;
+				}
+			}
+
+			if (Tints.size() == MaxTints) return Source;
+
+			std::vector<uint32_t>& pixels = CurrentDevice->Pixels;
+			pixels.resize(static_cast<std::size_t>(Surface->w) * Surface->h);
+
+			const uint32_t r = colorMod & 0xff, g = (colorMod >> 8) & 0xff, b = (colorMod >> 16) & 0xff;
+			for (int y = 0; y < Surface->h; y++)
+			{
+				const uint32_t* row = reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(Surface->pixels) + y * Surface->pitch);
+				uint32_t* tinted = pixels.data() + static_cast<std::size_t>(y) * Surface->w;
+				for (int x = 0; x < Surface->w; x++)
+				{
+					const uint32_t pixel = row[x];
+					tinted[x] = (pixel & 0xff000000)
+						| (((pixel >> 16) & 0xff) * b / 255) << 16
+						| (((pixel >> 8) & 0xff) * g / 255) << 8
+						| ((pixel & 0xff) * r / 255);
+				}
+			}
+
+			SDL_Texture* texture = CurrentDevice->MakeTexture(Surface->w, Surface->h, pixels.data(), Surface->w);
+			if (!texture) return Source;
+
+			Tints.emplace_back(colorMod, texture);
+			colorMod = 0x00ffffff;
+			return texture;
+		}
+
 		Color Sample(float u, float v) const
 		{
 			const int x = static_cast<int>(std::round(u * (Surface->w - 1) + 0.5f));
@@ -234,12 +487,12 @@ namespace
 	public:
 		InterpolatedFactorEquation(const T& value0, const T& value1, const T& value2, const ImVec2& v0, const ImVec2& v1, const ImVec2& v2)
 			: Value0(value0), Value1(value1), Value2(value2), V0(v0), V1(v1), V2(v2),
-			Divisor((V1.y - V2.y) * (V0.x - V2.x) + (V2.x - V1.x) * (V0.y - V2.y)) { }
+			InverseDivisor(1.0f / ((V1.y - V2.y) * (V0.x - V2.x) + (V2.x - V1.x) * (V0.y - V2.y))) { }
 
 		T Evaluate(float x, float y) const
 		{
-			const float w1 = ((V1.y - V2.y) * (x - V2.x) + (V2.x - V1.x) * (y - V2.y)) / Divisor;
-			const float w2 = ((V2.y - V0.y) * (x - V2.x) + (V0.x - V2.x) * (y - V2.y)) / Divisor;
+			const float w1 = ((V1.y - V2.y) * (x - V2.x) + (V2.x - V1.x) * (y - V2.y)) * InverseDivisor;
+			const float w2 = ((V2.y - V0.y) * (x - V2.x) + (V0.x - V2.x) * (y - V2.y)) * InverseDivisor;
 			const float w3 = 1.0f - w1 - w2;
 
 			return static_cast<T>((Value0 * w1) + (Value1 * w2) + (Value2 * w3));
@@ -253,9 +506,108 @@ namespace
 		const ImVec2& V1;
 		const ImVec2& V2;
 
-		const float Divisor;
+		const float InverseDivisor;
+	};
+
+	// The color functions the rasterizer is specialized for. A uniform color is the same for every pixel,
+	// so whole groups of pixels can be filled at once.
+	struct UniformColorFunction
+	{
+		static constexpr bool IsUniform = true;
+
+		const uint32_t Packed;
+
+		explicit UniformColorFunction(const Color& color) : Packed(color.ToInt()) { }
+
+		uint32_t Uniform() const { return Packed; }
+		uint32_t operator()(float, float) const { return Packed; }
+	};
+
+	struct TexturedColorFunction
+	{
+		static constexpr bool IsUniform = false;
+
+		const Texture* Source;
+		const InterpolatedFactorEquation<float> TextureU;
+		const InterpolatedFactorEquation<float> TextureV;
+		const InterpolatedFactorEquation<Color> Shade;
+
+		TexturedColorFunction(const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const Texture* texture)
+			: Source(texture),
+			TextureU(v1.uv.x, v2.uv.x, v3.uv.x, v1.pos, v2.pos, v3.pos),
+			TextureV(v1.uv.y, v2.uv.y, v3.uv.y, v1.pos, v2.pos, v3.pos),
+			Shade(Color(v1.col), Color(v2.col), Color(v3.col), v1.pos, v2.pos, v3.pos) { }
+
+		uint32_t Uniform() const { return 0; }
+
+		uint32_t operator()(float x, float y) const
+		{
+			const Color sampled = Source->Sample(TextureU.Evaluate(x, y), TextureV.Evaluate(x, y));
+			return (sampled * Shade.Evaluate(x, y)).ToInt();
+		}
 	};
 
+	// Edge function values of four neighbouring pixels, evaluated side by side.
+#if defined(IMGUI_SDL_SSE2)
+	using Quad = __m128i;
+
+	inline Quad QuadSplat(int value) { return _mm_set1_epi32(value); }
+	inline Quad QuadRamp(int value, int step) { return _mm_set_epi32(value - 3 * step, value - 2 * step, value - step, value); }
+	inline Quad QuadSub(Quad a, Quad b) { return _mm_sub_epi32(a, b); }
+
+	inline Quad QuadInside(Quad edge1, Quad edge2, Quad edge3)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		return _mm_and_si128(_mm_and_si128(_mm_cmpgt_epi32(edge1, zero), _mm_cmpgt_epi32(edge2, zero)), _mm_cmpgt_epi32(edge3, zero));
+	}
+
+	inline int QuadBits(Quad inside) { return _mm_movemask_ps(_mm_castsi128_ps(inside)); }
+	inline void QuadStore(uint32_t* destination, Quad inside, Quad color) { _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_and_si128(inside, color)); }
+#elif defined(IMGUI_SDL_NEON)
+	using Quad = int32x4_t;
+
+	inline Quad QuadSplat(int value) { return vdupq_n_s32(value); }
+	inline Quad QuadRamp(int value, int step)
+	{
+		const int32_t lanes[4] = { value, value - step, value - 2 * step, value - 3 * step };
+		return vld1q_s32(lanes);
+	}
+	inline Quad QuadSub(Quad a, Quad b) { return vsubq_s32(a, b); }
+
+	inline Quad QuadInside(Quad edge1, Quad edge2, Quad edge3)
+	{
+		const int32x4_t zero = vdupq_n_s32(0);
+		return vreinterpretq_s32_u32(vandq_u32(vandq_u32(vcgtq_s32(edge1, zero), vcgtq_s32(edge2, zero)), vcgtq_s32(edge3, zero)));
+	}
+
+	inline int QuadBits(Quad inside)
+	{
+		return (vgetq_lane_s32(inside, 0) & 1) | (vgetq_lane_s32(inside, 1) & 2) | (vgetq_lane_s32(inside, 2) & 4) | (vgetq_lane_s32(inside, 3) & 8);
+	}
+
+	inline void QuadStore(uint32_t* destination, Quad inside, Quad color) { vst1q_u32(destination, vreinterpretq_u32_s32(vandq_s32(inside, color))); }
+#else
+	struct Quad { int32_t Lanes[4]; };
+
+	inline Quad QuadSplat(int value) { return Quad{ { value, value, value, value } }; }
+	inline Quad QuadRamp(int value, int step) { return Quad{ { value, value - step, value - 2 * step, value - 3 * step } }; }
+	inline Quad QuadSub(Quad a, Quad b) { return Quad{ { a.Lanes[0] - b.Lanes[0], a.Lanes[1] - b.Lanes[1], a.Lanes[2] - b.Lanes[2], a.Lanes[3] - b.Lanes[3] } }; }
+
+	inline Quad QuadInside(Quad edge1, Quad edge2, Quad edge3)
+	{
+		Quad inside;
+		for (int i = 0; i < 4; i++) inside.Lanes[i] = (edge1.Lanes[i] > 0 && edge2.Lanes[i] > 0 && edge3.Lanes[i] > 0) ? -1 : 0;
+		return inside;
+	}
+
+	inline int QuadBits(Quad inside) { return (inside.Lanes[0] & 1) | (inside.Lanes[1] & 2) | (inside.Lanes[2] & 4) | (inside.Lanes[3] & 8); }
+
+	inline void QuadStore(uint32_t* destination, Quad inside, Quad color)
+	{
+		for (int i = 0; i < 4; i++) destination[i] = static_cast<uint32_t>(inside.Lanes[i] & color.Lanes[i]);
+	}
+#endif
+
 	struct Rect
 	{
 		float MinX, MinY, MaxX, MaxY;
@@ -314,7 +666,7 @@ namespace
 		}
 	};
 
-	void DrawTriangleWithColorFunction(const FixedPointTriangleRenderInfo& renderInfo, const std::function<Color(float x, float y)>& colorFunction, Device::TriangleCacheItem* cacheItem)
+	template <typename ColorFunction> void DrawTriangleWithColorFunction(const FixedPointTriangleRenderInfo& renderInfo, const ColorFunction& colorFunction, CachedTriangle* cacheItem)
 	{
 		// Implementation source: https://web.archive.org/web/20171128164608/http://forum.devmaster.net/t/advanced-rasterization/6145.
 		// This is a fixed point implementation that rounds to top-left.
@@ -351,26 +703,47 @@ namespace
 		int edgeStart2 = c2 + deltaX23 * (renderInfo.MinY << 4) - deltaY23 * (renderInfo.MinX << 4);
 		int edgeStart3 = c3 + deltaX31 * (renderInfo.MinY << 4) - deltaY31 * (renderInfo.MinX << 4);
 
-		SDL_Texture* cache = CurrentDevice->MakeTexture(width, height);
-		CurrentDevice->DisableClip();
-		CurrentDevice->UseAsRenderTarget(cache);
+		// Rows are padded to whole groups of four pixels. The padding lies right of the bounding box, so outside the triangle.
+		const int pitch = (width + 3) & ~3;
+		std::vector<uint32_t>& pixels = CurrentDevice->Pixels;
+		pixels.assign(static_cast<std::size_t>(pitch) * height, 0);
+
+		const Quad step1 = QuadSplat(fixedDeltaY12 * 4);
+		const Quad step2 = QuadSplat(fixedDeltaY23 * 4);
+		const Quad step3 = QuadSplat(fixedDeltaY31 * 4);
+		const Quad uniformColor = QuadSplat(static_cast<int>(colorFunction.Uniform()));
 
-		for (int y = renderInfo.MinY; y < renderInfo.MaxY; y++)
+		for (int y = 0; y < height; y++)
 		{
-			int edge1 = edgeStart1;
-			int edge2 = edgeStart2;
-			int edge3 = edgeStart3;
+			uint32_t* row = pixels.data() + static_cast<std::size_t>(y) * pitch;
 
-			for (int x = renderInfo.MinX; x < renderInfo.MaxX; x++)
+			Quad edge1 = QuadRamp(edgeStart1, fixedDeltaY12);
+			Quad edge2 = QuadRamp(edgeStart2, fixedDeltaY23);
+			Quad edge3 = QuadRamp(edgeStart3, fixedDeltaY31);
+
+			for (int x = 0; x < width; x += 4)
 			{
-				if (edge1 > 0 && edge2 > 0 && edge3 > 0)
+				const Quad inside = QuadInside(edge1, edge2, edge3);
+
+				if (ColorFunction::IsUniform)
 				{
-					CurrentDevice->SetAt(x - renderInfo.MinX, y - renderInfo.MinY, colorFunction(x + 0.5f, y + 0.5f));
+					QuadStore(row + x, inside, uniformColor);
+				}
+				else
+				{
+					const int bits = QuadBits(inside);
+					for (int lane = 0; bits >> lane; lane++)
+					{
+						if (bits & (1 << lane))
+						{
+							row[x + lane] = colorFunction(renderInfo.MinX + x + lane + 0.5f, renderInfo.MinY + y + 0.5f);
+						}
+					}
 				}
 
-				edge1 -= fixedDeltaY12;
-				edge2 -= fixedDeltaY23;
-				edge3 -= fixedDeltaY31;
+				edge1 = QuadSub(edge1, step1);
+				edge2 = QuadSub(edge2, step2);
+				edge3 = QuadSub(edge3, step3);
 			}
 
 			edgeStart1 += fixedDeltaX12;
@@ -378,18 +751,23 @@ namespace
 			edgeStart3 += fixedDeltaX31;
 		}
 
-		CurrentDevice->UseAsRenderTarget(nullptr);
-		CurrentDevice->EnableClip();
-
+		SDL_Texture* cache = CurrentDevice->MakeTexture(width, height, pixels.data(), pitch);
 		cacheItem->Texture = cache;
 		cacheItem->Width = width;
 		cacheItem->Height = height;
 	}
 
-	void DrawCachedTriangle(const Device::TriangleCacheItem& triangle, const FixedPointTriangleRenderInfo& renderInfo)
+	// Texture coordinates in steps far finer than any texel, so triangles that sample alike share a key.
+	int32_t QuantizeTextureCoordinate(float value)
 	{
+		return static_cast<int32_t>(std::lround(value * 65536.0f));
+	}
+
+	void DrawCachedTriangle(const CachedTriangle& triangle, const FixedPointTriangleRenderInfo& renderInfo)
+	{
+		const SDL_Rect source = { 0, 0, triangle.Width, triangle.Height };
 		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, triangle.Width, triangle.Height };
-		SDL_RenderCopy(CurrentDevice->Renderer, triangle.Texture, nullptr, &destination);
+		CurrentDevice->Batch.Copy(triangle.Texture, 0xffffff, source, destination, SDL_FLIP_NONE);
 	}
 
 	void DrawTriangle(const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3, const Texture* texture)
@@ -399,40 +777,33 @@ namespace
 
 		// First we check if there is a cached version of this triangle already waiting for us. If so, we can just do a super fast texture copy.
 
-		const auto key = std::make_tuple(
-			std::make_tuple(static_cast<int>(std::round(v1.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v1.pos.y)) - renderInfo.MinY, v1.uv.x, v1.uv.y, v1.col),
-			std::make_tuple(static_cast<int>(std::round(v2.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v2.pos.y)) - renderInfo.MinY, v2.uv.x, v2.uv.y, v2.col),
-			std::make_tuple(static_cast<int>(std::round(v3.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v3.pos.y)) - renderInfo.MinY, v3.uv.x, v3.uv.y, v3.col));
+		const TriangleCache<15>::Key key = {
+			static_cast<int32_t>(std::round(v1.pos.x)) - renderInfo.MinX, static_cast<int32_t>(std::round(v1.pos.y)) - renderInfo.MinY,
+			QuantizeTextureCoordinate(v1.uv.x), QuantizeTextureCoordinate(v1.uv.y), static_cast<int32_t>(v1.col),
+			static_cast<int32_t>(std::round(v2.pos.x)) - renderInfo.MinX, static_cast<int32_t>(std::round(v2.pos.y)) - renderInfo.MinY,
+			QuantizeTextureCoordinate(v2.uv.x), QuantizeTextureCoordinate(v2.uv.y), static_cast<int32_t>(v2.col),
+			static_cast<int32_t>(std::round(v3.pos.x)) - renderInfo.MinX, static_cast<int32_t>(std::round(v3.pos.y)) - renderInfo.MinY,
+			QuantizeTextureCoordinate(v3.uv.x), QuantizeTextureCoordinate(v3.uv.y), static_cast<int32_t>(v3.col)
+		};
 
-		if (CurrentDevice->GenericTriangleCache.Contains(key))
+		auto& cache = CurrentDevice->GenericTriangleCache;
+		const uint64_t hash = cache.Hash(key);
+		if (const CachedTriangle* cached = cache.Find(key, hash))
 		{
-			const auto& cached = CurrentDevice->GenericTriangleCache.At(key);
 			DrawCachedTriangle(*cached, renderInfo);
-
 			return;
 		}
 
-		const InterpolatedFactorEquation<float> textureU(v1.uv.x, v2.uv.x, v3.uv.x, v1.pos, v2.pos, v3.pos);
-		const InterpolatedFactorEquation<float> textureV(v1.uv.y, v2.uv.y, v3.uv.y, v1.pos, v2.pos, v3.pos);
-
-		const InterpolatedFactorEquation<Color> shadeColor(Color(v1.col), Color(v2.col), Color(v3.col), v1.pos, v2.pos, v3.pos);
-
-		auto cached = std::make_unique<Device::TriangleCacheItem>();
-		DrawTriangleWithColorFunction(renderInfo, [&](float x, float y) {
-			const float u = textureU.Evaluate(x, y);
-			const float v = textureV.Evaluate(x, y);
-			const Color sampled = texture->Sample(u, v);
-			const Color shade = shadeColor.Evaluate(x, y);
-
-			return sampled * shade;
-		}, cached.get());
+		CachedTriangle triangle;
+		DrawTriangleWithColorFunction(renderInfo, TexturedColorFunction(v1, v2, v3, texture), &triangle);
 
-		if (!cached->Texture) return;
+		if (!triangle.Texture) return;
 
-		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, cached->Width, cached->Height };
-		SDL_RenderCopy(CurrentDevice->Renderer, cached->Texture, nullptr, &destination);
+		// Making room evicts a texture that may still be queued.
+		if (cache.Size() == cache.Capacity()) CurrentDevice->Batch.Flush();
 
-		CurrentDevice->GenericTriangleCache.Insert(key, std::move(cached));
+		DrawCachedTriangle(triangle, renderInfo);
+		cache.Insert(key, hash, triangle);
 	}
 
 	void DrawUniformColorTriangle(const ImDrawVert& v1, const ImDrawVert& v2, const ImDrawVert& v3)
@@ -442,30 +813,34 @@ namespace
 		// The naming inconsistency in the parameters is intentional. The fixed point algorithm wants the vertices in a counter clockwise order.
 		const auto& renderInfo = FixedPointTriangleRenderInfo::CalculateFixedPointTriangleInfo(v3.pos, v2.pos, v1.pos);
 
-		const auto key =std::make_tuple(v1.col,
-			static_cast<int>(std::round(v1.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v1.pos.y)) - renderInfo.MinY,
-			static_cast<int>(std::round(v2.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v2.pos.y)) - renderInfo.MinY,
-			static_cast<int>(std::round(v3.pos.x)) - renderInfo.MinX, static_cast<int>(std::round(v3.pos.y)) - renderInfo.MinY);
-		if (CurrentDevice->UniformColorTriangleCache.Contains(key))
+		const TriangleCache<7>::Key key = {
+			static_cast<int32_t>(v1.col),
+			static_cast<int32_t>(std::round(v1.pos.x)) - renderInfo.MinX, static_cast<int32_t>(std::round(v1.pos.y)) - renderInfo.MinY,
+			static_cast<int32_t>(std::round(v2.pos.x)) - renderInfo.MinX, static_cast<int32_t>(std::round(v2.pos.y)) - renderInfo.MinY,
+			static_cast<int32_t>(std::round(v3.pos.x)) - renderInfo.MinX, static_cast<int32_t>(std::round(v3.pos.y)) - renderInfo.MinY
+		};
+
+		auto& cache = CurrentDevice->UniformColorTriangleCache;
+		const uint64_t hash = cache.Hash(key);
+		if (const CachedTriangle* cached = cache.Find(key, hash))
 		{
-			const auto& cached = CurrentDevice->UniformColorTriangleCache.At(key);
 			DrawCachedTriangle(*cached, renderInfo);
-
 			return;
 		}
 
-		auto cached = std::make_unique<Device::TriangleCacheItem>();
-		DrawTriangleWithColorFunction(renderInfo, [&color](float, float) { return color; }, cached.get());
+		CachedTriangle triangle;
+		DrawTriangleWithColorFunction(renderInfo, UniformColorFunction(color), &triangle);
 
-		if (!cached->Texture) return;
+		if (!triangle.Texture) return;
 
-		const SDL_Rect destination = { renderInfo.MinX, renderInfo.MinY, cached->Width, cached->Height };
-		SDL_RenderCopy(CurrentDevice->Renderer, cached->Texture, nullptr, &destination);
+		// Making room evicts a texture that may still be queued.
+		if (cache.Size() == cache.Capacity()) CurrentDevice->Batch.Flush();
 
-		CurrentDevice->UniformColorTriangleCache.Insert(key, std::move(cached));
+		DrawCachedTriangle(triangle, renderInfo);
+		cache.Insert(key, hash, triangle);
 	}
 
-	void DrawRectangle(const Rect& bounding, SDL_Texture* texture, int textureWidth, int textureHeight, const Color& color, bool doHorizontalFlip, bool doVerticalFlip)
+	void DrawRectangle(const Rect& bounding, SDL_Texture* texture, int textureWidth, int textureHeight, uint32_t color, bool doHorizontalFlip, bool doVerticalFlip)
 	{
 		// We are safe to assume uniform color here, because the caller checks it and and uses the triangle renderer to render those.
 
@@ -479,8 +854,7 @@ namespace
 		// If the area isn't textured, we can just draw a rectangle with the correct color.
 		if (bounding.UsesOnlyColor())
 		{
-			color.UseAsDrawColor(CurrentDevice->Renderer);
-			SDL_RenderFillRect(CurrentDevice->Renderer, &destination);
+			CurrentDevice->Batch.Fill(destination, color);
 		}
 		else
 		{
@@ -495,22 +869,54 @@ namespace
 
 			const SDL_RendererFlip flip = static_cast<SDL_RendererFlip>((doHorizontalFlip ? SDL_FLIP_HORIZONTAL : 0) | (doVerticalFlip ? SDL_FLIP_VERTICAL : 0));
 
-			SDL_SetTextureColorMod(texture, static_cast<uint8_t>(color.R * 255), static_cast<uint8_t>(color.G * 255), static_cast<uint8_t>(color.B * 255));
-			SDL_RenderCopyEx(CurrentDevice->Renderer, texture, &source, &destination, 0.0, nullptr, flip);
+			CurrentDevice->Batch.Copy(texture, color, source, destination, flip);
 		}
 	}
 
-	void DrawRectangle(const Rect& bounding, const Texture* texture, const Color& color, bool doHorizontalFlip, bool doVerticalFlip)
+	void DrawRectangle(const Rect& bounding, Texture* texture, uint32_t color, bool doHorizontalFlip, bool doVerticalFlip)
 	{
-		DrawRectangle(bounding, texture->Source, texture->Surface->w, texture->Surface->h, color, doHorizontalFlip, doVerticalFlip);
+		// Fills keep the alpha, so only copies get a tinted texture.
+		if (bounding.UsesOnlyColor())
+		{
+			DrawRectangle(bounding, texture->Source, texture->Surface->w, texture->Surface->h, color, doHorizontalFlip, doVerticalFlip);
+			return;
+		}
+
+		SDL_Texture* tinted = texture->Tinted(color);
+		DrawRectangle(bounding, tinted, texture->Surface->w, texture->Surface->h, color, doHorizontalFlip, doVerticalFlip);
 	}
 
-	void DrawRectangle(const Rect& bounding, SDL_Texture* texture, const Color& color, bool doHorizontalFlip, bool doVerticalFlip)
+	void DrawRectangle(const Rect& bounding, SDL_Texture* texture, uint32_t color, bool doHorizontalFlip, bool doVerticalFlip)
 	{
 		int width, height;
 		SDL_QueryTexture(texture, nullptr, nullptr, &width, &height);
 		DrawRectangle(bounding, texture, width, height, color, doHorizontalFlip, doVerticalFlip);
 	}
+	// Hashes everything that ends up on screen: the geometry, the textures it samples and where it is clipped.
+	// Returns false if the draw data has callbacks, whose output can't be known in advance.
+	bool HashDrawData(const ImDrawData* drawData, uint64_t& hash)
+	{
+		hash = HashBytes(0, &drawData->DisplaySize, sizeof(drawData->DisplaySize));
+
+		for (int n = 0; n < drawData->CmdListsCount; n++)
+		{
+			const ImDrawList* commandList = drawData->CmdLists[n];
+			hash = HashBytes(hash, commandList->VtxBuffer.Data, commandList->VtxBuffer.Size * sizeof(ImDrawVert));
+			hash = HashBytes(hash, commandList->IdxBuffer.Data, commandList->IdxBuffer.Size * sizeof(ImDrawIdx));
+
+			for (int cmd_i = 0; cmd_i < commandList->CmdBuffer.Size; cmd_i++)
+			{
+				const ImDrawCmd& drawCommand = commandList->CmdBuffer[cmd_i];
+				if (drawCommand.UserCallback) return false;
+
+				hash = HashBytes(hash, &drawCommand.ElemCount, sizeof(drawCommand.ElemCount));
+				hash = HashBytes(hash, &drawCommand.ClipRect, sizeof(drawCommand.ClipRect));
+				hash = HashBytes(hash, &drawCommand.TextureId, sizeof(drawCommand.TextureId));
+			}
+		}
+
+		return true;
+	}
 }
 
 namespace ImGuiSDL
@@ -567,10 +973,13 @@ namespace ImGuiSDL
 
 		ImGuiIO& io = ImGui::GetIO();
 
+		Batcher& batch = CurrentDevice->Batch;
+		batch.Primitives = batch.DrawCalls = batch.StateChanges = 0;
+
 		for (int n = 0; n < drawData->CmdListsCount; n++)
 		{
 			auto commandList = drawData->CmdLists[n];
-			auto vertexBuffer = commandList->VtxBuffer;
+			const auto& vertexBuffer = commandList->VtxBuffer;
 			auto indexBuffer = commandList->IdxBuffer.Data;
 
 			for (int cmd_i = 0; cmd_i < commandList->CmdBuffer.Size; cmd_i++)
@@ -633,11 +1042,11 @@ namespace ImGuiSDL
 
 								if (isWrappedTexture)
 								{
-									DrawRectangle(bounding, static_cast<const Texture*>(drawCommand->TextureId), Color(v0.col), doHorizontalFlip, doVerticalFlip);
+									DrawRectangle(bounding, static_cast<Texture*>(drawCommand->TextureId), v0.col, doHorizontalFlip, doVerticalFlip);
 								}
 								else
 								{
-									DrawRectangle(bounding, static_cast<SDL_Texture*>(drawCommand->TextureId), Color(v0.col), doHorizontalFlip, doVerticalFlip);
+									DrawRectangle(bounding, static_cast<SDL_Texture*>(drawCommand->TextureId), v0.col, doHorizontalFlip, doVerticalFlip);
 								}
 
 								i += 3;  // Additional increment to account for the extra 3 vertices we consumed.
@@ -662,6 +1071,7 @@ namespace ImGuiSDL
 			}
 		}
 
+		CurrentDevice->Batch.Flush();
 		CurrentDevice->DisableClip();
 
 		SDL_SetRenderTarget(CurrentDevice->Renderer, initialRenderTarget);
@@ -673,4 +1083,109 @@ namespace ImGuiSDL
 
 		SDL_SetRenderDrawBlendMode(CurrentDevice->Renderer, blendMode);
 	}
+
+	bool RenderCached(ImDrawData* drawData)
+	{
+		SDL_Renderer* renderer = CurrentDevice->Renderer;
+
+		uint64_t hash;
+		const bool cacheable = HashDrawData(drawData, hash);
+
+		// Without render targets there is nothing to keep the overlay in.
+		if (!SDL_RenderTargetSupported(renderer))
+		{
+			Render(drawData);
+			return true;
+		}
+
+		const int width = static_cast<int>(drawData->DisplaySize.x);
+		const int height = static_cast<int>(drawData->DisplaySize.y);
+		if (width <= 0 || height <= 0) return false;
+
+		const bool resized = !CurrentDevice->Layer || CurrentDevice->LayerWidth != width || CurrentDevice->LayerHeight != height;
+		const bool redraw = resized || !cacheable || hash != CurrentDevice->LayerHash;
+
+		if (resized)
+		{
+			if (CurrentDevice->Layer) SDL_DestroyTexture(CurrentDevice->Layer);
+
+			CurrentDevice->Layer = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_TARGET, width, height);
+			CurrentDevice->LayerWidth = width;
+			CurrentDevice->LayerHeight = height;
+			if (!CurrentDevice->Layer)
+			{
+				Render(drawData);
+				return true;
+			}
+
+			// Blending into the cleared layer leaves it with premultiplied alpha, so that's how it's put on screen.
+			// Renderers without custom blend modes darken translucent parts a little.
+			const SDL_BlendMode premultiplied = SDL_ComposeCustomBlendMode(
+				SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+				SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+			if (SDL_SetTextureBlendMode(CurrentDevice->Layer, premultiplied) != 0)
+			{
+				SDL_SetTextureBlendMode(CurrentDevice->Layer, SDL_BLENDMODE_BLEND);
+			}
+		}
+
+		if (redraw)
+		{
+			SDL_Texture* initialRenderTarget = SDL_GetRenderTarget(renderer);
+			Uint8 initialR, initialG, initialB, initialA;
+			SDL_GetRenderDrawColor(renderer, &initialR, &initialG, &initialB, &initialA);
+
+			SDL_SetRenderTarget(renderer, CurrentDevice->Layer);
+			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+			SDL_RenderClear(renderer);
+			SDL_SetRenderDrawColor(renderer, initialR, initialG, initialB, initialA);
+
+			Render(drawData);
+
+			SDL_SetRenderTarget(renderer, initialRenderTarget);
+
+			// Never matches again if this frame couldn't be cached.
+			CurrentDevice->LayerHash = cacheable ? hash : ~hash;
+		}
+
+		SDL_RenderCopy(renderer, CurrentDevice->Layer, nullptr, nullptr);
+		return redraw;
+	}
+
+	void Invalidate()
+	{
+		if (CurrentDevice->Layer) SDL_DestroyTexture(CurrentDevice->Layer);
+		CurrentDevice->Layer = nullptr;
+
+		CurrentDevice->UniformColorTriangleCache.Clear();
+		CurrentDevice->GenericTriangleCache.Clear();
+	}
+
+	void GetRenderStats(RenderStats& stats)
+	{
+		stats.Primitives = CurrentDevice->Batch.Primitives;
+		stats.DrawCalls = CurrentDevice->Batch.DrawCalls;
+		stats.StateChanges = CurrentDevice->Batch.StateChanges;
+	}
+
+	void SetTriangleCacheCapacity(std::size_t uniformColor, std::size_t generic)
+	{
+		if (uniformColor > 0) CurrentDevice->UniformColorTriangleCache.SetCapacity(uniformColor);
+		if (generic > 0) CurrentDevice->GenericTriangleCache.SetCapacity(generic);
+	}
+
+	template <std::size_t KeySize> void FillCacheStats(const TriangleCache<KeySize>& cache, TriangleCacheStats& stats)
+	{
+		stats.Size = cache.Size();
+		stats.Capacity = cache.Capacity();
+		stats.Hits = cache.Hits;
+		stats.Misses = cache.Misses;
+		stats.Evictions = cache.Evictions;
+	}
+
+	void GetTriangleCacheStats(TriangleCacheStats& uniformColor, TriangleCacheStats& generic)
+	{
+		FillCacheStats(CurrentDevice->UniformColorTriangleCache, uniformColor);
+		FillCacheStats(CurrentDevice->GenericTriangleCache, generic);
+	}
 }
@@ -1,5 +1,8 @@
 ﻿#pragma once
 
+#include <cstddef>
+#include <cstdint>
+
 struct ImDrawData;
 struct SDL_Renderer;
 
@@ -14,4 +17,33 @@ namespace ImGuiSDL
 	// Call this every frame after ImGui::Render with ImGui::GetDrawData(). This will use the SDL_Renderer provided to the interfrace with Initialize
 	// to draw the contents of the draw data to the screen.
 	void Render(ImDrawData* drawData);
+
+	// Like Render, but the overlay is drawn into a layer that is kept between frames, and redrawn only when the draw data differs
+	// from the last frame's. The layer is then copied over whatever is on the render target. Returns whether it had to be redrawn.
+	bool RenderCached(ImDrawData* drawData);
+	// Call this when SDL reports SDL_RENDER_TARGETS_RESET or SDL_RENDER_DEVICE_RESET, as the layer's contents are lost then.
+	// The cached triangles are dropped as well.
+	void Invalidate();
+
+	struct RenderStats
+	{
+		int Primitives, DrawCalls, StateChanges;
+	};
+
+	// Fills in what the last Render drew: the rectangles and triangles, which each used to take a call of their own,
+	// and the draw calls and state changes they took once batched. Frames RenderCached didn't redraw don't count.
+	void GetRenderStats(RenderStats& stats);
+
+	struct TriangleCacheStats
+	{
+		std::size_t Size, Capacity;
+		uint64_t Hits, Misses, Evictions;
+	};
+
+	// Call this after Initialize to set how many triangles each cache keeps rasterized, so it fits the overlay you draw.
+	// Triangles of a single color and textured ones, mostly text, are cached apart. A capacity of 0 leaves that cache alone,
+	// any other empties it.
+	void SetTriangleCacheCapacity(std::size_t uniformColor, std::size_t generic);
+	// Fills in how full the caches are and how they did since Initialize, to size them by.
+	void GetTriangleCacheStats(TriangleCacheStats& uniformColor, TriangleCacheStats& generic);
 }